@@ -0,0 +1,285 @@
+
+#include "caps_cache.h"
+
+#include "gst_tcam_ic4_src.h"
+
+#include <cstring>
+
+#define GST_CAT_DEFAULT ic4_src_debug
+
+
+namespace
+{
+
+// bump when create_caps changes in a way that makes old entries invalid
+constexpr const char* cache_format_version = "8";
+
+// settings that change which caps create_caps generates
+const char* const caps_settings[] = {
+    "BinningHorizontal",
+    "BinningVertical",
+    "DecimationHorizontal",
+    "DecimationVertical",
+    "PixelFormat",
+    "DeviceLinkThroughputLimitMode",
+    "DeviceLinkThroughputLimit",
+};
+
+
+std::string get_value_string(ic4::PropertyMap& props, const char* name)
+{
+    ic4::Error err;
+    auto value = props.getValueString(name, err);
+    if (err.isError())
+    {
+        return {};
+    }
+    return value;
+}
+
+
+std::string describe_integer(ic4::PropertyMap& props, const char* name)
+{
+    ic4::Error err;
+    auto p = props.findInteger(name, err);
+    if (err.isError())
+    {
+        return {};
+    }
+
+    std::string ret = std::to_string(p.minimum(err)) + ":" + std::to_string(p.maximum(err));
+
+    if (p.incrementMode(err) == ic4::PropIncrementMode::Increment)
+    {
+        ret += ":" + std::to_string(p.increment(err));
+    }
+    else
+    {
+        for (auto v : p.validValueSet(err))
+        {
+            ret += "," + std::to_string(v);
+        }
+    }
+    return ret;
+}
+
+
+std::string sha256(const std::string& str)
+{
+    gchar* sum = g_compute_checksum_for_string(G_CHECKSUM_SHA256, str.c_str(), (gssize)str.size());
+    std::string ret = sum;
+    g_free(sum);
+    return ret;
+}
+
+
+std::string cache_file(const ic4::gst::caps_cache_key& key, const char* suffix = ".caps")
+{
+    gchar* path = g_build_filename(ic4::gst::caps_cache_dir().c_str(),
+                                   (key.name + suffix).c_str(),
+                                   nullptr);
+    std::string ret = path;
+    g_free(path);
+    return ret;
+}
+
+} // namespace
+
+
+ic4::gst::caps_cache_key ic4::gst::make_caps_cache_key(ic4::Grabber& grabber)
+{
+    auto props = grabber.devicePropertyMap();
+
+    std::string model = get_value_string(props, "DeviceModelName");
+    if (model.empty())
+    {
+        ic4::Error err;
+        model = grabber.deviceInfo(err).modelName();
+    }
+
+    std::string settings = model;
+    settings += "|" + get_value_string(props, "DeviceFirmwareVersion");
+    settings += "|" + get_value_string(props, "DeviceVersion");
+
+    for (const auto& name : caps_settings)
+    {
+        settings += std::string("|") + name + "=" + get_value_string(props, name);
+    }
+
+    std::string description = cache_format_version;
+    description += "|" IC4SRC_VERSION;
+
+    ic4::Error err;
+    auto p_fmt = props.findEnumeration("PixelFormat", err);
+    if (err.isSuccess())
+    {
+        for (const auto& e : p_fmt.entries(err))
+        {
+            description += "|" + e.name();
+        }
+    }
+    description += "|W=" + describe_integer(props, "Width");
+    description += "|H=" + describe_integer(props, "Height");
+
+    // keep the file name readable, the hash makes it unique
+    std::string name;
+    for (char c : model)
+    {
+        name += g_ascii_isalnum(c) ? c : '_';
+    }
+
+    caps_cache_key key;
+    key.name = name + "-" + sha256(settings).substr(0, 16);
+    key.description_hash = sha256(description);
+
+    return key;
+}
+
+
+std::string ic4::gst::caps_cache_dir()
+{
+    const char* env = g_getenv("IC4SRC_CAPS_CACHE_DIR");
+    if (env && *env)
+    {
+        return env;
+    }
+
+    gchar* dir = g_build_filename(g_get_user_cache_dir(), "ic4src", "caps", nullptr);
+    std::string ret = dir;
+    g_free(dir);
+    return ret;
+}
+
+
+GstCaps* ic4::gst::load_cached_caps(const caps_cache_key& key)
+{
+    std::string path = cache_file(key);
+
+    gchar* content = nullptr;
+    if (!g_file_get_contents(path.c_str(), &content, nullptr, nullptr))
+    {
+        GST_DEBUG("No cached caps in %s", path.c_str());
+        return nullptr;
+    }
+
+    // first line is the description hash, the rest the caps string
+    GstCaps* caps = nullptr;
+    gchar* newline = strchr(content, '\n');
+
+    if (newline)
+    {
+        *newline = '\0';
+        if (key.description_hash == content)
+        {
+            caps = gst_caps_from_string(newline + 1);
+        }
+        else
+        {
+            GST_INFO("Cached caps in %s are outdated", path.c_str());
+        }
+    }
+
+    g_free(content);
+
+    if (caps && gst_caps_is_empty(caps))
+    {
+        gst_caps_unref(caps);
+        caps = nullptr;
+    }
+
+    if (caps)
+    {
+        GST_INFO("Using cached caps from %s", path.c_str());
+    }
+    return caps;
+}
+
+
+namespace
+{
+
+bool write_cache_file(const std::string& path, const std::string& content)
+{
+    std::string dir = ic4::gst::caps_cache_dir();
+
+    if (g_mkdir_with_parents(dir.c_str(), 0755) != 0)
+    {
+        GST_WARNING("Unable to create caps cache directory %s", dir.c_str());
+        return false;
+    }
+
+    GError* err = nullptr;
+    // writes to a temporary file first, concurrent readers never see partial content
+    if (!g_file_set_contents(path.c_str(), content.c_str(), (gssize)content.size(), &err))
+    {
+        GST_WARNING("Unable to write caps cache %s: %s", path.c_str(), err->message);
+        g_error_free(err);
+        return false;
+    }
+
+    GST_DEBUG("Stored %s", path.c_str());
+    return true;
+}
+
+} // namespace
+
+
+void ic4::gst::store_cached_caps(const caps_cache_key& key, const GstCaps* caps)
+{
+    gchar* caps_str = gst_caps_to_string(caps);
+    std::string content = key.description_hash + "\n" + caps_str;
+    g_free(caps_str);
+
+    write_cache_file(cache_file(key), content);
+}
+
+
+bool ic4::gst::load_fps_model(const caps_cache_key& key, fps_model& model)
+{
+    std::string path = cache_file(key, ".fps");
+
+    gchar* content = nullptr;
+    if (!g_file_get_contents(path.c_str(), &content, nullptr, nullptr))
+    {
+        return false;
+    }
+
+    // description hash, frame overhead, line time, bits per pixel, width and link limit,
+    // one per line
+    gchar** lines = g_strsplit(content, "\n", 6);
+    bool valid = g_strv_length(lines) == 6 && key.description_hash == lines[0];
+
+    if (valid)
+    {
+        model.calibrated = true;
+        // locale independent, the files may be shared between users
+        model.frame_overhead_s = g_ascii_strtod(lines[1], nullptr);
+        model.line_time_s = g_ascii_strtod(lines[2], nullptr);
+        model.bits_per_pixel = (int)g_ascii_strtoll(lines[3], nullptr, 10);
+        model.width = g_ascii_strtoll(lines[4], nullptr, 10);
+        model.link_limit = g_ascii_strtod(lines[5], nullptr);
+    }
+
+    g_strfreev(lines);
+    g_free(content);
+
+    return valid;
+}
+
+
+void ic4::gst::store_fps_model(const caps_cache_key& key, const fps_model& model)
+{
+    gchar overhead[G_ASCII_DTOSTR_BUF_SIZE];
+    gchar line_time[G_ASCII_DTOSTR_BUF_SIZE];
+    gchar link_limit[G_ASCII_DTOSTR_BUF_SIZE];
+
+    g_ascii_dtostr(overhead, sizeof(overhead), model.frame_overhead_s);
+    g_ascii_dtostr(line_time, sizeof(line_time), model.line_time_s);
+    g_ascii_dtostr(link_limit, sizeof(link_limit), model.link_limit);
+
+    std::string content = key.description_hash + "\n" + overhead + "\n" + line_time + "\n"
+                          + std::to_string(model.bits_per_pixel) + "\n"
+                          + std::to_string(model.width) + "\n" + link_limit;
+
+    write_cache_file(cache_file(key, ".fps"), content);
+}
@@ -0,0 +1,59 @@
+
+#pragma once
+
+#include "ic4_gst_conversions.h"
+
+#include <gst/gst.h>
+#include <ic4/ic4.h>
+
+#include <string>
+
+namespace ic4::gst
+{
+
+/**
+ * Identifies the caps of a device in its current configuration.
+ *
+ * name selects the cache file and is derived from model, firmware
+ * and the settings that change the caps (binning, decimation, ...).
+ * description_hash covers what create_caps reads from the device description.
+ * A cached entry is only used when both match.
+ */
+struct caps_cache_key
+{
+    std::string name;
+    std::string description_hash;
+};
+
+/**
+ * Build the key for the device opened in grabber.
+ * Only reads properties, the device configuration is not touched.
+ */
+caps_cache_key make_caps_cache_key(ic4::Grabber& grabber);
+
+/**
+ * Directory the cache files are stored in.
+ * $XDG_CACHE_HOME/ic4src/caps unless overwritten by IC4SRC_CAPS_CACHE_DIR.
+ */
+std::string caps_cache_dir();
+
+/**
+ * Returns the cached caps or nullptr when no valid entry exists.
+ */
+GstCaps* load_cached_caps(const caps_cache_key& key);
+
+/**
+ * Store caps for key. Failures are logged and otherwise ignored,
+ * the cache is only an optimization.
+ */
+void store_cached_caps(const caps_cache_key& key, const GstCaps* caps);
+
+/**
+ * Load the framerate model stored for key.
+ * Returns false when no valid entry exists.
+ */
+bool load_fps_model(const caps_cache_key& key, fps_model& model);
+
+void store_fps_model(const caps_cache_key& key, const fps_model& model);
+
+} // namespace ic4::gst
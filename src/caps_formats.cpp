@@ -0,0 +1,64 @@
+#include "caps_formats.h"
+
+
+std::vector<std::string> ic4::gst::get_strings(const GstStructure* struc, const char* field)
+{
+    std::vector<std::string> ret;
+
+    const GValue* value = gst_structure_get_value(struc, field);
+    if (!value)
+    {
+        return ret;
+    }
+
+    if (G_VALUE_HOLDS_STRING(value))
+    {
+        ret.push_back(g_value_get_string(value));
+    }
+    else if (GST_VALUE_HOLDS_LIST(value))
+    {
+        for (guint i = 0; i < gst_value_list_get_size(value); ++i)
+        {
+            const GValue* v = gst_value_list_get_value(value, i);
+            if (G_VALUE_HOLDS_STRING(v))
+            {
+                ret.push_back(g_value_get_string(v));
+            }
+        }
+    }
+    return ret;
+}
+
+
+std::vector<ic4::gst::ic4_gst_table_entry> ic4::gst::get_format_entries(
+    const GstStructure* struc,
+    bool (*filter)(const ic4_gst_table_entry&))
+{
+    std::vector<ic4_gst_table_entry> ret;
+
+    auto add = [&](const ic4_gst_table_entry& entry)
+    {
+        if (gst_structure_has_name(struc, entry.gst_name) && (!filter || filter(entry)))
+        {
+            ret.push_back(entry);
+        }
+    };
+
+    if (!gst_structure_has_field(struc, "format"))
+    {
+        for (const auto& entry : get_ic4_gst_table_view())
+        {
+            add(entry);
+        }
+        return ret;
+    }
+
+    for (const auto& name : get_strings(struc, "format"))
+    {
+        if (auto entry = get_entry(gst_format_to_pixel_format(name.c_str())))
+        {
+            add(*entry);
+        }
+    }
+    return ret;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "format.h"
+
+#include <gst/gst.h>
+
+#include <string>
+#include <vector>
+
+namespace ic4::gst
+{
+
+/**
+ * Values of a string or string list field.
+ * Empty when the field is missing or holds something else.
+ */
+std::vector<std::string> get_strings(const GstStructure* struc, const char* field);
+
+/**
+ * Format table entries the format field of struc names, in the order of the field.
+ * Without the field every format of the media type of struc is possible.
+ * Formats of another media type or unknown to the table are skipped,
+ * so are those filter rejects. A null filter accepts all.
+ */
+std::vector<ic4_gst_table_entry> get_format_entries(const GstStructure* struc,
+                                                    bool (*filter)(const ic4_gst_table_entry&)
+                                                    = nullptr);
+
+} // namespace ic4::gst
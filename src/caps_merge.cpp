@@ -0,0 +1,118 @@
+#include "caps_merge.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+
+struct caps_group
+{
+    // first structure of the group, receives the merged format field
+    // so that the field order stays the same
+    GstStructure* first;
+    // first without its format field, used for comparisons
+    GstStructure* rest;
+    bool has_format;
+    // every format value, in the order they were encountered
+    GValue formats;
+};
+
+
+void append_unique(GValue* list, const GValue* value)
+{
+    for (guint i = 0; i < gst_value_list_get_size(list); ++i)
+    {
+        if (gst_value_compare(gst_value_list_get_value(list, i), value) == GST_VALUE_EQUAL)
+        {
+            return;
+        }
+    }
+    gst_value_list_append_value(list, value);
+}
+
+
+void append_format(GValue* list, const GValue* format)
+{
+    if (GST_VALUE_HOLDS_LIST(format))
+    {
+        for (guint i = 0; i < gst_value_list_get_size(format); ++i)
+        {
+            append_unique(list, gst_value_list_get_value(format, i));
+        }
+        return;
+    }
+    append_unique(list, format);
+}
+
+} // namespace
+
+
+GstCaps* ic4::gst::merge_caps(const GstCaps* caps)
+{
+    if (gst_caps_is_any(caps) || gst_caps_is_empty(caps))
+    {
+        return gst_caps_copy(caps);
+    }
+
+    std::vector<caps_group> groups;
+
+    for (guint i = 0; i < gst_caps_get_size(caps); ++i)
+    {
+        const GstStructure* struc = gst_caps_get_structure(caps, i);
+        const GValue* format = gst_structure_get_value(struc, "format");
+
+        GstStructure* rest = gst_structure_copy(struc);
+        gst_structure_remove_field(rest, "format");
+
+        auto group = std::find_if(groups.begin(), groups.end(), [&](const caps_group& g)
+        {
+            return g.has_format == (format != nullptr) && gst_structure_is_equal(g.rest, rest);
+        });
+
+        if (group == groups.end())
+        {
+            caps_group g = { gst_structure_copy(struc), rest, format != nullptr, G_VALUE_INIT };
+            g_value_init(&g.formats, GST_TYPE_LIST);
+            groups.push_back(g);
+            group = std::prev(groups.end());
+        }
+        else
+        {
+            gst_structure_free(rest);
+        }
+
+        if (format)
+        {
+            append_format(&group->formats, format);
+        }
+    }
+
+    GstCaps* merged = gst_caps_new_empty();
+
+    for (auto& g : groups)
+    {
+        const guint count = gst_value_list_get_size(&g.formats);
+        if (count == 1)
+        {
+            gst_structure_set_value(g.first, "format", gst_value_list_get_value(&g.formats, 0));
+        }
+        else if (count > 1)
+        {
+            gst_structure_take_value(g.first, "format", &g.formats);
+            // ownership moved into the structure
+            g.formats = G_VALUE_INIT;
+        }
+
+        if (G_IS_VALUE(&g.formats))
+        {
+            g_value_unset(&g.formats);
+        }
+        // structures are appended unsimplified, gst_caps_merge_structure
+        // would drop anything that is a subset of an earlier structure
+        gst_caps_append_structure(merged, g.first);
+        gst_structure_free(g.rest);
+    }
+
+    return merged;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <gst/gst.h>
+
+namespace ic4::gst
+{
+
+/**
+ * Canonical compact form of caps generated by create_caps.
+ *
+ * Structures that only differ in their "format" field are merged into
+ * a single structure with a format list, in the position of the first one.
+ * The result describes exactly the same set of formats as caps,
+ * it merely has fewer structures to intersect during negotiation.
+ *
+ * The order of preference is not kept across structures. Merged formats move up
+ * to the first structure with the same fields, e.g. with one structure per format
+ * and readout mode a later format in 1x1 now comes before the first format in 2x2.
+ * Inside a format list the formats keep their order.
+ *
+ * Returns a new reference, caps is not modified.
+ */
+GstCaps* merge_caps(const GstCaps* caps);
+
+} // namespace ic4::gst
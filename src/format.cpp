@@ -1,83 +1,252 @@
-
 #include "format.h"
 #include <ic4/ImageType.h>
-#include <iterator>
 
+#include <algorithm>
+#include <array>
+#include <cstdint>
 #include <cstring>
+#include <iterator>
+#include <string_view>
 #include <system_error>
 
 namespace {
 
+// the GenICam name is the name of the ic4::PixelFormat enumerator
+#define FORMAT(ic4_name, gst_name, gst_format, bpp) \
+    { ic4::PixelFormat::ic4_name, #ic4_name, gst_name, gst_format, bpp }
 
-static const ic4::gst::ic4_gst_table_entry format_list[] = {
-    { ic4::PixelFormat::Mono8, "video/x-raw", "GRAY8" },
-    { ic4::PixelFormat::Mono10p, "video/x-raw", "GRAY10p" },
-    { ic4::PixelFormat::Mono12p, "video/x-raw", "GRAY12p" },
-    { ic4::PixelFormat::Mono12Packed, "video/x-raw", "GRAY12sp" },
-    { ic4::PixelFormat::Mono16, "video/x-raw", "GRAY16_LE" },
-    { ic4::PixelFormat::BayerBG8, "video/x-bayer", "bggr" },
-    { ic4::PixelFormat::BayerBG10p, "video/x-bayer", "bggr10p" },
-    { ic4::PixelFormat::BayerBG12p, "video/x-bayer", "bggr12p" },
-    { ic4::PixelFormat::BayerBG12Packed, "video/x-bayer", "bggr12sp" },
-    { ic4::PixelFormat::BayerBG16, "video/x-bayer", "bggr16" },
-    { ic4::PixelFormat::BayerGB8, "video/x-bayer", "gbrg" },
-    { ic4::PixelFormat::BayerGB10p, "video/x-bayer", "gbrg10p" },
-    { ic4::PixelFormat::BayerGB12p, "video/x-bayer", "gbrg12p" },
-    { ic4::PixelFormat::BayerGB12Packed, "video/x-bayer", "gbrg12sp" },
-    { ic4::PixelFormat::BayerGB16, "video/x-bayer", "gbrg16" },
-    { ic4::PixelFormat::BayerGR8, "video/x-bayer", "grbg" },
-    { ic4::PixelFormat::BayerGR10p, "video/x-bayer", "grbg10p" },
-    { ic4::PixelFormat::BayerGR12p, "video/x-bayer", "grbg12p" },
-    { ic4::PixelFormat::BayerGR12Packed, "video/x-bayer", "grbg12sp" },
-    { ic4::PixelFormat::BayerGR16, "video/x-bayer", "grbg16" },
-    { ic4::PixelFormat::BayerRG8, "video/x-bayer", "rggb" },
-    { ic4::PixelFormat::BayerRG10p, "video/x-bayer", "rggb10p" },
-    { ic4::PixelFormat::BayerRG12p, "video/x-bayer", "rggb12p" },
-    { ic4::PixelFormat::BayerRG12Packed, "video/x-bayer", "rggb12sp" },
-    { ic4::PixelFormat::BayerRG16, "video/x-bayer", "rggb16" },
-
-    { ic4::PixelFormat::BGR8, "video/x-raw", "BGR"},
-    { ic4::PixelFormat::BGRa8, "video/x-raw", "BGRx" },
-    { ic4::PixelFormat::BGRa16, "video/x-raw", "BGRA16_LE" },
-    { ic4::PixelFormat::YUV422_8, "video/x-raw", "YUY2"},
-    { ic4::PixelFormat::YCbCr411_8, "video/x-raw", "Y41B"},
-    // { ic4::PixelFormat::YCbCr422_8,          "YCbCr422_8", "video/x-raw", "YUY2"},
-    { ic4::PixelFormat::YCbCr422_8, "video/x-raw",  "UYVY", },
-    { ic4::PixelFormat::YCbCr411_8_CbYYCrYY, "video/x-raw", "IYU1", },
-    { ic4::PixelFormat::YCbCr411_8_CbYYCrYY, "video/x-raw", "NV12", },
+// formats IC4 does not know are named like their GStreamer format
+#define REPACKED(gst_format, bpp, channel_bits)                                       \
+    {                                                                                  \
+        ic4::gst::repacked_format::gst_format, #gst_format, "video/x-raw", #gst_format, \
+        bpp, channel_bits                                                              \
+    }
+
+constexpr ic4::gst::ic4_gst_table_entry format_list[] = {
+    FORMAT(Mono8, "video/x-raw", "GRAY8", 8),
+    FORMAT(Mono10p, "video/x-raw", "GRAY10p", 10),
+    FORMAT(Mono12p, "video/x-raw", "GRAY12p", 12),
+    FORMAT(Mono12Packed, "video/x-raw", "GRAY12sp", 12),
+    FORMAT(Mono16, "video/x-raw", "GRAY16_LE", 16),
+    FORMAT(BayerBG8, "video/x-bayer", "bggr", 8),
+    FORMAT(BayerBG10p, "video/x-bayer", "bggr10p", 10),
+    FORMAT(BayerBG12p, "video/x-bayer", "bggr12p", 12),
+    FORMAT(BayerBG12Packed, "video/x-bayer", "bggr12sp", 12),
+    FORMAT(BayerBG16, "video/x-bayer", "bggr16", 16),
+    FORMAT(BayerGB8, "video/x-bayer", "gbrg", 8),
+    FORMAT(BayerGB10p, "video/x-bayer", "gbrg10p", 10),
+    FORMAT(BayerGB12p, "video/x-bayer", "gbrg12p", 12),
+    FORMAT(BayerGB12Packed, "video/x-bayer", "gbrg12sp", 12),
+    FORMAT(BayerGB16, "video/x-bayer", "gbrg16", 16),
+    FORMAT(BayerGR8, "video/x-bayer", "grbg", 8),
+    FORMAT(BayerGR10p, "video/x-bayer", "grbg10p", 10),
+    FORMAT(BayerGR12p, "video/x-bayer", "grbg12p", 12),
+    FORMAT(BayerGR12Packed, "video/x-bayer", "grbg12sp", 12),
+    FORMAT(BayerGR16, "video/x-bayer", "grbg16", 16),
+    FORMAT(BayerRG8, "video/x-bayer", "rggb", 8),
+    FORMAT(BayerRG10p, "video/x-bayer", "rggb10p", 10),
+    FORMAT(BayerRG12p, "video/x-bayer", "rggb12p", 12),
+    FORMAT(BayerRG12Packed, "video/x-bayer", "rggb12sp", 12),
+    FORMAT(BayerRG16, "video/x-bayer", "rggb16", 16),
+
+    FORMAT(BGR8, "video/x-raw", "BGR", 24),
+    FORMAT(BGRa8, "video/x-raw", "BGRx", 32),
+    FORMAT(BGRa16, "video/x-raw", "BGRA16_LE", 64),
+    FORMAT(YUV422_8, "video/x-raw", "YUY2", 16),
+    // packed Y0 Y1 Cb Y2 Y3 Cr, GStreamer has no such format, Y41B is planar
+    FORMAT(YCbCr411_8, "tis", "YCbCr411_8", 12),
+    // FORMAT(YCbCr422_8, "video/x-raw", "YUY2", 16),
+    FORMAT(YCbCr422_8, "video/x-raw", "UYVY", 16),
+    FORMAT(YCbCr411_8_CbYYCrYY, "video/x-raw", "IYU1", 12),
+
+    ////// repacked by ic4src, see repack.h
+    // 3 pixels in 32 bits, rounded up
+    REPACKED(GRAY10_LE32, 11, 10),
+    REPACKED(I420, 12, 8),
+    REPACKED(NV12, 12, 8),
 
     ////// polarization formats
-    { ic4::PixelFormat::PolarizedMono8, "video/x-raw", "polarized-GRAY8-v0"},
-    { ic4::PixelFormat::PolarizedMono12p, "video/x-raw", "polarized-GRAY12p-v0"},
-    { ic4::PixelFormat::PolarizedMono12Packed, "video/x-raw", "polarized-GRAY12sp-v0"},
-    { ic4::PixelFormat::PolarizedMono16,  "video/x-raw", "polarized-GRAY16-v0"},
-
-    { ic4::PixelFormat::PolarizedBayerBG8, "video/x-bayer", "polarized-bggr8-v0"},
-    { ic4::PixelFormat::PolarizedBayerBG12p, "video/x-bayer", "polarized-bayer-bggr12p-v0"},
-    { ic4::PixelFormat::PolarizedBayerBG12Packed, "video/x-bayer", "polarized-bayer-bggr12sp-v0"},
-    { ic4::PixelFormat::PolarizedBayerBG16, "video/x-bayer", "polarized-bayer-bggr16-v0"},
-    { ic4::PixelFormat::PolarizedADIMono8, "tis", "polarized-ADI-GRAY8"},
-    { ic4::PixelFormat::PolarizedADIMono16, "tis", "polarized-ADI-GRAY16"},
-    { ic4::PixelFormat::PolarizedADIRGB8, "tis", "polarized-ADI-RGB8"},
-    { ic4::PixelFormat::PolarizedADIRGB16, "tis", "polarized-ADI-RGB16"},
-    { ic4::PixelFormat::PolarizedQuadMono8, "tis", "polarized-quad-GRAY8"},
-    { ic4::PixelFormat::PolarizedQuadMono16, "tis", "polarized-quad-GREY16"},
-    { ic4::PixelFormat::PolarizedQuadBG8, "tis", "polarized-quad-bggr8"},
-    { ic4::PixelFormat::PolarizedQuadBG16, "tis", "polarized-quad-bggr16"},
+    FORMAT(PolarizedMono8, "video/x-raw", "polarized-GRAY8-v0", 8),
+    FORMAT(PolarizedMono12p, "video/x-raw", "polarized-GRAY12p-v0", 12),
+    FORMAT(PolarizedMono12Packed, "video/x-raw", "polarized-GRAY12sp-v0", 12),
+    FORMAT(PolarizedMono16, "video/x-raw", "polarized-GRAY16-v0", 16),
+
+    FORMAT(PolarizedBayerBG8, "video/x-bayer", "polarized-bggr8-v0", 8),
+    FORMAT(PolarizedBayerBG12p, "video/x-bayer", "polarized-bayer-bggr12p-v0", 12),
+    FORMAT(PolarizedBayerBG12Packed, "video/x-bayer", "polarized-bayer-bggr12sp-v0", 12),
+    FORMAT(PolarizedBayerBG16, "video/x-bayer", "polarized-bayer-bggr16-v0", 16),
+    FORMAT(PolarizedADIMono8, "tis", "polarized-ADI-GRAY8", 32),
+    FORMAT(PolarizedADIMono16, "tis", "polarized-ADI-GRAY16", 64),
+    FORMAT(PolarizedADIRGB8, "tis", "polarized-ADI-RGB8", 64),
+    FORMAT(PolarizedADIRGB16, "tis", "polarized-ADI-RGB16", 128),
+    FORMAT(PolarizedQuadMono8, "tis", "polarized-quad-GRAY8", 32),
+    FORMAT(PolarizedQuadMono16, "tis", "polarized-quad-GREY16", 64),
+    FORMAT(PolarizedQuadBG8, "tis", "polarized-quad-bggr8", 32),
+    FORMAT(PolarizedQuadBG16, "tis", "polarized-quad-bggr16", 64),
 }; // format_list
 
+#undef FORMAT
+#undef REPACKED
+
+constexpr size_t format_count = std::size(format_list);
+
+using index_array = std::array<uint8_t, format_count>;
+
+
+template<typename Less> constexpr index_array make_index(Less less)
+{
+    index_array ret = {};
+    for (size_t i = 0; i < format_count; ++i)
+    {
+        ret[i] = (uint8_t)i;
+    }
+    // ties are ordered by table position, the first entry wins for duplicate keys
+    std::sort(ret.begin(),
+              ret.end(),
+              [less](uint8_t a, uint8_t b)
+              {
+                  if (less(format_list[a], format_list[b]))
+                  {
+                      return true;
+                  }
+                  if (less(format_list[b], format_list[a]))
+                  {
+                      return false;
+                  }
+                  return a < b;
+              });
+    return ret;
+}
+
+
+constexpr bool less_pixel_format(const ic4::gst::ic4_gst_table_entry& a,
+                                 const ic4::gst::ic4_gst_table_entry& b)
+{
+    return (int)a.ic4_format < (int)b.ic4_format;
+}
+
+
+constexpr bool less_genicam_name(const ic4::gst::ic4_gst_table_entry& a,
+                                 const ic4::gst::ic4_gst_table_entry& b)
+{
+    return std::string_view(a.genicam_name) < std::string_view(b.genicam_name);
+}
+
+
+// ordered by gst_format first, that way lookups by format alone work as well
+constexpr bool less_gst_format(const ic4::gst::ic4_gst_table_entry& a,
+                               const ic4::gst::ic4_gst_table_entry& b)
+{
+    auto fa = std::string_view(a.gst_format);
+    auto fb = std::string_view(b.gst_format);
+    if (fa != fb)
+    {
+        return fa < fb;
+    }
+    return std::string_view(a.gst_name) < std::string_view(b.gst_name);
+}
+
+
+constexpr index_array by_pixel_format = make_index(less_pixel_format);
+constexpr index_array by_genicam_name = make_index(less_genicam_name);
+constexpr index_array by_gst_format = make_index(less_gst_format);
+
+
+constexpr const ic4::gst::ic4_gst_table_entry* find_pixel_format(ic4::PixelFormat fmt)
+{
+    auto iter = std::lower_bound(by_pixel_format.begin(),
+                                 by_pixel_format.end(),
+                                 (int)fmt,
+                                 [](uint8_t i, int f) { return (int)format_list[i].ic4_format < f; });
+
+    if (iter == by_pixel_format.end() || format_list[*iter].ic4_format != fmt)
+    {
+        return nullptr;
+    }
+    return &format_list[*iter];
+}
+
+
+constexpr const ic4::gst::ic4_gst_table_entry* find_genicam_name(std::string_view name)
+{
+    auto iter = std::lower_bound(by_genicam_name.begin(),
+                                 by_genicam_name.end(),
+                                 name,
+                                 [](uint8_t i, std::string_view n)
+                                 { return std::string_view(format_list[i].genicam_name) < n; });
+
+    if (iter == by_genicam_name.end() || name != format_list[*iter].genicam_name)
+    {
+        return nullptr;
+    }
+    return &format_list[*iter];
+}
+
+
+// gst_name may be empty to match any media type
+constexpr const ic4::gst::ic4_gst_table_entry* find_gst_format(std::string_view gst_name,
+                                                               std::string_view gst_format)
+{
+    auto iter = std::lower_bound(by_gst_format.begin(),
+                                 by_gst_format.end(),
+                                 gst_format,
+                                 [](uint8_t i, std::string_view f)
+                                 { return std::string_view(format_list[i].gst_format) < f; });
+
+    for (; iter != by_gst_format.end() && gst_format == format_list[*iter].gst_format; ++iter)
+    {
+        if (gst_name.empty() || gst_name == format_list[*iter].gst_name)
+        {
+            return &format_list[*iter];
+        }
+    }
+    return nullptr;
+}
 
-} // namespace
 
-std::expected<ic4::gst::ic4_gst_table_entry, std::errc> ic4::gst::get_entry_by_pixel_format_name(const std::string& name)
+// PFNC names end with the channel depth, followed by an optional
+// packing suffix, e.g. Mono12p, BayerRG12Packed or YCbCr411_8_CbYYCrYY
+constexpr int bits_per_channel(std::string_view genicam_name)
 {
-    for (const auto &entry : format_list)
+    int ret = 0;
+    bool in_digits = false;
+    for (char c : genicam_name)
     {
-        if (ic4::to_string(entry.ic4_format) == name)
+        if (c >= '0' && c <= '9')
+        {
+            ret = in_digits ? ret * 10 + (c - '0') : (c - '0');
+            in_digits = true;
+        }
+        else
         {
-            return entry;
+            in_digits = false;
         }
     }
+    return ret;
+}
+
+
+// the indices are built at compile time, so are the sanity checks
+static_assert(format_count < 256, "indices are stored as uint8_t");
+static_assert(find_pixel_format(ic4::PixelFormat::Mono8) != nullptr);
+static_assert(find_genicam_name("BayerRG16")->ic4_format == ic4::PixelFormat::BayerRG16);
+static_assert(find_gst_format("video/x-bayer", "rggb")->ic4_format == ic4::PixelFormat::BayerRG8);
+static_assert(find_gst_format("video/x-raw", "rggb") == nullptr);
+static_assert(bits_per_channel("BayerRG12Packed") == 12);
+static_assert(bits_per_channel("YCbCr411_8_CbYYCrYY") == 8);
+static_assert(bits_per_channel("BGRa16") == 16);
+static_assert(find_gst_format("video/x-raw", "NV12")->ic4_format == ic4::gst::repacked_format::NV12);
+static_assert(find_gst_format("video/x-raw", "IYU1")->ic4_format
+              == ic4::PixelFormat::YCbCr411_8_CbYYCrYY);
+
+} // namespace
+
+std::expected<ic4::gst::ic4_gst_table_entry, std::errc> ic4::gst::get_entry_by_pixel_format_name(std::string_view name)
+{
+    if (auto entry = find_genicam_name(name))
+    {
+        return *entry;
+    }
     return std::unexpected(std::errc::invalid_argument);
 }
 
@@ -85,48 +254,80 @@ std::expected<ic4::gst::ic4_gst_table_entry, std::errc> ic4::gst::get_entry_by_p
 std::vector<ic4::gst::ic4_gst_table_entry> ic4::gst::get_ic4_gst_table()
 
 {
-    auto size = std::size(format_list);
-    std::vector<ic4::gst::ic4_gst_table_entry> ret;
+    return { std::begin(format_list), std::end(format_list) };
+}
+
 
-    ret.reserve(size);
+std::span<const ic4::gst::ic4_gst_table_entry> ic4::gst::get_ic4_gst_table_view()
+{
+    return format_list;
+}
 
-    for (const auto& f : format_list)
+
+std::expected<ic4::gst::ic4_gst_table_entry, std::errc> ic4::gst::get_entry(ic4::PixelFormat fmt)
+{
+    if (auto entry = find_pixel_format(fmt))
     {
-        ret.push_back(f);
+        return *entry;
     }
-
-    return ret;
+    return std::unexpected(std::errc::invalid_argument);
 }
 
-const char* ic4::gst::pixel_format_name_to_gst_format(const std::string& name)
+int ic4::gst::get_bits_per_pixel(ic4::PixelFormat fmt)
 {
+    if (auto entry = find_pixel_format(fmt))
+    {
+        return entry->bits_per_pixel;
+    }
+    return 0;
+}
+
 
-    for (const auto& f : format_list)
+int ic4::gst::get_bits_per_channel(ic4::PixelFormat fmt)
+{
+    if (auto entry = find_pixel_format(fmt))
     {
-        if (ic4::to_string((f.ic4_format)) == name)
+        if (entry->bits_per_channel > 0)
         {
-            return f.gst_format;
+            return entry->bits_per_channel;
         }
+        return bits_per_channel(entry->genicam_name);
     }
+    return 0;
+}
 
 
+const char* ic4::gst::pixel_format_name_to_gst_format(std::string_view name)
+{
+    if (auto entry = find_genicam_name(name))
+    {
+        return entry->gst_format;
+    }
     return nullptr;
+}
+
 
+std::string ic4::gst::get_pixel_format_name(ic4::PixelFormat fmt)
+{
+    if (auto entry = find_pixel_format(fmt))
+    {
+        return entry->genicam_name;
+    }
+    return ic4::to_string(fmt);
 }
 
 
 ic4::PixelFormat ic4::gst::gst_format_to_pixel_format(const char* format_str)
 {
-
-    for (const auto& e : format_list)
+    if (!format_str)
     {
-        if (strcmp(format_str, e.gst_format) == 0)
-        {
-            return e.ic4_format;
-        }
+        return ic4::PixelFormat::Invalid;
     }
 
-
+    if (auto entry = find_gst_format({}, format_str))
+    {
+        return entry->ic4_format;
+    }
     return ic4::PixelFormat::Invalid;
 }
 
@@ -144,31 +345,26 @@ ic4::PixelFormat ic4::gst::gst_caps_to_pixel_format(const GstCaps& caps)
     const char* name = gst_structure_get_name(struc);
     const char* format = gst_structure_get_string(struc, "format");
 
-    for (const auto& e : format_list)
+    if (!format)
     {
-        if (strcmp(name, e.gst_name) == 0
-            && strcmp(format, e.gst_format) == 0)
-        {
-            return e.ic4_format;
-        }
+        return ic4::PixelFormat::Invalid;
     }
 
+    if (auto entry = find_gst_format(name, format))
+    {
+        return entry->ic4_format;
+    }
     return ic4::PixelFormat::Invalid;
 }
 
 GstCaps *ic4::gst::pixel_format_to_gst_caps(const char* fmt) {
 
-    for (const auto& e : format_list)
+    auto entry = find_genicam_name(fmt);
+
+    if (!entry)
     {
-        if (strcmp(fmt, ic4::to_string(e.ic4_format).c_str()) == 0)
-        {
-            std::string s = e.gst_name;
-            s += ",format=";
-            s += e.gst_format;
-            GstCaps* caps = gst_caps_from_string(s.c_str());
-            return caps;
-        }
+        return nullptr;
     }
 
-    return nullptr;
+    return gst_caps_new_simple(entry->gst_name, "format", G_TYPE_STRING, entry->gst_format, nullptr);
 }
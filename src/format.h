@@ -1,6 +1,10 @@
 #pragma once
 
 #include <ic4/ImageType.h>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
 #include <vector>
 #include <gst/gst.h>
 #include <expected>
@@ -12,17 +16,60 @@ namespace ic4::gst
     struct ic4_gst_table_entry
     {
         ic4::PixelFormat ic4_format;
+        // name used by GenICam/ic4::to_string
+        const char* genicam_name;
 
         const char* gst_name;
         const char* gst_format;
+
+        // bits a single pixel occupies in memory
+        int bits_per_pixel;
+
+        // bit depth of a single color channel, 0 derives it from genicam_name
+        int bits_per_channel = 0;
     };
 
 
-    std::expected<ic4_gst_table_entry, std::errc> get_entry_by_pixel_format_name(const std::string&);
+    /**
+     * GStreamer formats without an ic4::PixelFormat.
+     * ic4src repacks device formats into them, see repack.h.
+     * The values lie outside the PFNC range, only the format table knows them.
+     */
+    namespace repacked_format
+    {
+        inline constexpr ic4::PixelFormat GRAY10_LE32 = ic4::PixelFormat(0x7F000001);
+        inline constexpr ic4::PixelFormat I420 = ic4::PixelFormat(0x7F000002);
+        inline constexpr ic4::PixelFormat NV12 = ic4::PixelFormat(0x7F000003);
+    } // namespace repacked_format
+
+    constexpr bool is_repacked_format(ic4::PixelFormat fmt)
+    {
+        return ((uint32_t)fmt & 0xFF000000) == 0x7F000000;
+    }
+
+
+    // all lookups use indices sorted at compile time and never allocate
+
+    std::expected<ic4_gst_table_entry, std::errc> get_entry_by_pixel_format_name(std::string_view);
 
     std::vector<ic4_gst_table_entry> get_ic4_gst_table();
 
-    const char* pixel_format_name_to_gst_format(const std::string& name);
+    // the table itself, in table order, for lookups that have to visit every entry
+    std::span<const ic4_gst_table_entry> get_ic4_gst_table_view();
+
+    std::expected<ic4_gst_table_entry, std::errc> get_entry(ic4::PixelFormat fmt);
+
+    const char* pixel_format_name_to_gst_format(std::string_view name);
+
+    // genicam_name of fmt, ic4::to_string for formats the table does not know
+    std::string get_pixel_format_name(ic4::PixelFormat fmt);
+
+    // returns 0 for unknown formats
+    int get_bits_per_pixel(ic4::PixelFormat fmt);
+
+    // bit depth of a single color channel, e.g. 12 for BayerRG12p and 8 for BGRa8
+    // returns 0 for unknown formats
+    int get_bits_per_channel(ic4::PixelFormat fmt);
 
     ic4::PixelFormat gst_format_to_pixel_format(const char* format_str);
 
@@ -0,0 +1,41 @@
+#include "fps_model.h"
+
+#include <algorithm>
+
+
+double ic4::gst::fps_model::max_fps(int64_t height) const
+{
+    double frame_time = frame_overhead_s + line_time_s * (double)height;
+
+    if (frame_time <= 0.0)
+    {
+        return 0.0;
+    }
+    return 1.0 / frame_time;
+}
+
+
+double ic4::gst::fps_model::max_fps(int64_t height, int bpp, int64_t frame_width) const
+{
+    const double fps = max_fps(height);
+
+    if (fps <= 0.0 || bpp <= 0 || bits_per_pixel <= 0 || width <= 0 || frame_width <= 0
+        || link_limit <= 0.0)
+    {
+        return fps;
+    }
+
+    auto link_time = [&](int64_t w, int bits) -> double
+    {
+        return (double)w * (double)height * (double)bits / 8.0 / link_limit;
+    };
+
+    const double frame_time = 1.0 / fps;
+
+    // a few percent tolerance, the device rounds its framerate limits
+    if (link_time(width, bits_per_pixel) >= frame_time * 0.98)
+    {
+        return 1.0 / link_time(frame_width, bpp);
+    }
+    return 1.0 / std::max(frame_time, link_time(frame_width, bpp));
+}
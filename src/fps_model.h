@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+
+namespace ic4::gst
+{
+
+/**
+ * Maximum framerate as function of the image height.
+ * Sensors read out line by line, a frame takes
+ * frame_overhead_s + height * line_time_s.
+ *
+ * The model is measured with a single pixel format.
+ * Other formats are derived from their bits per pixel
+ * when the device limits its link throughput.
+ */
+struct fps_model
+{
+    bool calibrated = false;
+    double frame_overhead_s = 0.0;
+    double line_time_s = 0.0;
+
+    // bits per pixel of the format the model was measured with, 0 when unknown
+    int bits_per_pixel = 0;
+    // width of the measured frames
+    int64_t width = 0;
+    // DeviceLinkThroughputLimit in bytes per second, 0 when the link is not limited
+    double link_limit = 0.0;
+
+    // maximum framerate for the measured format
+    double max_fps(int64_t height) const;
+
+    /**
+     * Maximum framerate for frames of width pixels with bits_per_pixel.
+     * Binned and skipped modes pass their reduced width.
+     * Where the measured format saturates the link, the link alone
+     * is known to limit the readout and the framerate scales with the frame size.
+     * Otherwise the sensor limit holds and larger formats may still hit the link.
+     */
+    double max_fps(int64_t height, int bits_per_pixel, int64_t width) const;
+};
+
+} // namespace ic4::gst
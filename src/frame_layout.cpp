@@ -0,0 +1,43 @@
+#include "frame_layout.h"
+
+#include "format.h"
+
+#include <gst/video/video.h>
+
+
+bool ic4::gst::get_frame_layout(GstCaps* caps, frame_layout& layout)
+{
+    const GstStructure* struc = gst_caps_get_structure(caps, 0);
+
+    int width = 0;
+    int height = 0;
+    if (!gst_structure_get_int(struc, "width", &width)
+        || !gst_structure_get_int(struc, "height", &height))
+    {
+        return false;
+    }
+
+    auto fmt = gst_caps_to_pixel_format(*caps);
+    const int bpp = get_bits_per_pixel(fmt);
+    if (fmt == ic4::PixelFormat::Invalid || bpp == 0)
+    {
+        return false;
+    }
+
+    layout.format = fmt;
+    layout.width = width;
+    layout.height = height;
+
+    GstVideoInfo info;
+    if (gst_video_info_from_caps(&info, caps) && GST_VIDEO_INFO_N_PLANES(&info) == 1)
+    {
+        layout.pitch = GST_VIDEO_INFO_PLANE_STRIDE(&info, 0);
+        layout.size = GST_VIDEO_INFO_SIZE(&info);
+    }
+    else
+    {
+        layout.pitch = ((size_t)width * bpp + 7) / 8;
+        layout.size = layout.pitch * height;
+    }
+    return true;
+}
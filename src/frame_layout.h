@@ -0,0 +1,29 @@
+#pragma once
+
+#include <gst/gst.h>
+#include <ic4/ImageType.h>
+
+#include <cstddef>
+
+namespace ic4::gst
+{
+
+/**
+ * Memory layout of single plane frames the ic4 elements exchange.
+ */
+struct frame_layout
+{
+    ic4::PixelFormat format = ic4::PixelFormat::Invalid;
+    int width = 0;
+    int height = 0;
+    size_t pitch = 0;
+    size_t size = 0;
+};
+
+/**
+ * Default layout of frames with the given caps.
+ * Formats GstVideoInfo knows use its strides, the rest is unpadded.
+ */
+bool get_frame_layout(GstCaps* caps, frame_layout& layout);
+
+} // namespace ic4::gst
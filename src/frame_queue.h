@@ -0,0 +1,155 @@
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace ic4::gst
+{
+
+/**
+ * Bounded lock-free ring used to hand frames from the
+ * QueueSinkListener callback thread to the GstPushSrc streaming thread.
+ *
+ * push() must only be called by the producer (sink_listener::framesQueued).
+ * pop() may be called by the consumer (gst_ic4_src_create) and by the producer,
+ * the latter is used to discard stale frames.
+ * Every slot carries a sequence number, that way an entry is moved out
+ * of its slot before the producer is allowed to reuse it.
+ *
+ * reset() and clear() are not thread safe and may only be called
+ * while no stream is running.
+ */
+template<typename T> class frame_ring
+{
+public:
+    frame_ring() = default;
+    frame_ring(const frame_ring&) = delete;
+    frame_ring& operator=(const frame_ring&) = delete;
+
+    // capacity is rounded up to the next power of two
+    void reset(size_t capacity)
+    {
+        size_t cap = 1;
+        while (cap < capacity)
+        {
+            cap <<= 1;
+        }
+
+        slots_ = std::make_unique<slot[]>(cap);
+        capacity_ = cap;
+        mask_ = cap - 1;
+        clear();
+    }
+
+    void clear()
+    {
+        for (size_t i = 0; i < capacity_; ++i)
+        {
+            slots_[i].entry = T {};
+            slots_[i].seq.store(i, std::memory_order_relaxed);
+        }
+        head_.store(0, std::memory_order_relaxed);
+        tail_.store(0, std::memory_order_relaxed);
+    }
+
+    size_t capacity() const noexcept
+    {
+        return capacity_;
+    }
+
+    size_t size() const noexcept
+    {
+        const size_t head = head_.load(std::memory_order_acquire);
+        const size_t tail = tail_.load(std::memory_order_acquire);
+        return tail > head ? tail - head : 0;
+    }
+
+    bool empty() const noexcept
+    {
+        return size() == 0;
+    }
+
+    // returns false when the ring is full, entry is left untouched in that case
+    bool push(T&& entry)
+    {
+        if (capacity_ == 0)
+        {
+            return false;
+        }
+
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        slot& s = slots_[tail & mask_];
+
+        // the slot is free once the consumer of the previous round moved its entry out
+        if (s.seq.load(std::memory_order_acquire) != tail)
+        {
+            return false;
+        }
+
+        s.entry = std::move(entry);
+        s.seq.store(tail + 1, std::memory_order_release);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // returns a default constructed T when the ring is empty
+    T pop()
+    {
+        if (capacity_ == 0)
+        {
+            return T {};
+        }
+
+        size_t head = head_.load(std::memory_order_relaxed);
+
+        for (;;)
+        {
+            slot& s = slots_[head & mask_];
+            const size_t seq = s.seq.load(std::memory_order_acquire);
+
+            if (seq == head + 1)
+            {
+                // entry is ready, claim it
+                if (head_.compare_exchange_weak(head, head + 1, std::memory_order_relaxed))
+                {
+                    T ret = std::move(s.entry);
+                    s.entry = T {};
+                    // hand the slot back to the producer for the next round
+                    s.seq.store(head + capacity_, std::memory_order_release);
+                    return ret;
+                }
+                // lost the race, head has been reloaded
+            }
+            else if (seq < head + 1)
+            {
+                // nothing has been pushed into this slot yet
+                return T {};
+            }
+            else
+            {
+                // another thread claimed this slot in the meantime
+                head = head_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    struct slot
+    {
+        std::atomic<size_t> seq = 0;
+        T entry;
+    };
+
+    std::unique_ptr<slot[]> slots_;
+    size_t capacity_ = 0;
+    size_t mask_ = 0;
+
+    // producer and consumer index live on separate cache lines
+    alignas(64) std::atomic<size_t> head_ = 0;
+    alignas(64) std::atomic<size_t> tail_ = 0;
+};
+
+} // namespace ic4::gst
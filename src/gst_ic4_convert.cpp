@@ -0,0 +1,517 @@
+#include "gst_ic4_convert.h"
+
+#include "caps_formats.h"
+#include "caps_merge.h"
+#include "format.h"
+#include "frame_layout.h"
+#include "striped_convert.h"
+
+#include <gst/video/video.h>
+#include <ic4/ic4.h>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+GST_DEBUG_CATEGORY_STATIC(ic4_convert_debug);
+#define GST_CAT_DEFAULT ic4_convert_debug
+
+G_DEFINE_TYPE(GstIC4Convert, gst_ic4_convert, GST_TYPE_BASE_TRANSFORM)
+
+enum
+{
+    PROP_0,
+    PROP_CONVERSION_THREADS,
+    PROP_CPU_AFFINITY,
+};
+
+
+namespace
+{
+
+using ic4::gst::frame_layout;
+using ic4::gst::get_format_entries;
+using ic4::gst::get_frame_layout;
+using ic4::gst::get_strings;
+
+
+// "tis" formats have no GStreamer media type,
+// repacked formats are unknown to IC4 and only produced by ic4src
+bool is_gst_format(const ic4::gst::ic4_gst_table_entry& entry)
+{
+    return strcmp(entry.gst_name, "tis") != 0 && !ic4::gst::is_repacked_format(entry.ic4_format);
+}
+
+
+GstCaps* make_template_caps()
+{
+    GstCaps* caps = gst_caps_new_empty();
+
+    for (const auto& entry : ic4::gst::get_ic4_gst_table_view())
+    {
+        if (!is_gst_format(entry))
+        {
+            continue;
+        }
+        gst_caps_append_structure(caps,
+                                  gst_structure_new(entry.gst_name,
+                                                    "format", G_TYPE_STRING, entry.gst_format,
+                                                    "width", GST_TYPE_INT_RANGE, 1, G_MAXINT,
+                                                    "height", GST_TYPE_INT_RANGE, 1, G_MAXINT,
+                                                    "framerate", GST_TYPE_FRACTION_RANGE, 0, 1, G_MAXINT, 1,
+                                                    nullptr));
+    }
+
+    GstCaps* merged = ic4::gst::merge_caps(caps);
+    gst_caps_unref(caps);
+    return merged;
+}
+
+
+// copy of struc describing the given format, width/height/framerate and the rest are kept
+GstStructure* with_format(const GstStructure* struc, const ic4::gst::ic4_gst_table_entry& entry)
+{
+    GstStructure* s = gst_structure_copy(struc);
+    gst_structure_set_name(s, entry.gst_name);
+    gst_structure_set(s, "format", G_TYPE_STRING, entry.gst_format, nullptr);
+    gst_structure_remove_field(s, "device-format");
+    return s;
+}
+
+
+/**
+ * Caps ic4convert is able to produce from the input caps.
+ * Converted formats name their input in device-format, the way ic4src does.
+ * The unconverted input comes first, fixation prefers passthrough.
+ */
+GstCaps* transform_to_output(const GstCaps* caps)
+{
+    GstCaps* ret = gst_caps_new_empty();
+
+    for (guint i = 0; i < gst_caps_get_size(caps); ++i)
+    {
+        const GstStructure* struc = gst_caps_get_structure(caps, i);
+
+        for (const auto& in_entry : get_format_entries(struc, is_gst_format))
+        {
+            const auto in = in_entry.ic4_format;
+
+            gst_caps_append_structure(ret, with_format(struc, in_entry));
+
+            for (auto out : ic4::enumTransforms(in))
+            {
+                auto out_entry = ic4::gst::get_entry(out);
+                if (out == in || !out_entry || !is_gst_format(*out_entry))
+                {
+                    continue;
+                }
+
+                GstStructure* s = with_format(struc, *out_entry);
+                gst_structure_set(s, "device-format", G_TYPE_STRING, in_entry.gst_format, nullptr);
+                gst_caps_append_structure(ret, s);
+            }
+        }
+    }
+
+    GstCaps* merged = ic4::gst::merge_caps(ret);
+    gst_caps_unref(ret);
+    return merged;
+}
+
+
+/**
+ * Input caps ic4convert is able to convert into the output caps.
+ * A device-format restricts the input to the listed formats and requires a conversion.
+ */
+GstCaps* transform_to_input(const GstCaps* caps)
+{
+    GstCaps* ret = gst_caps_new_empty();
+
+    for (guint i = 0; i < gst_caps_get_size(caps); ++i)
+    {
+        const GstStructure* struc = gst_caps_get_structure(caps, i);
+        const auto device_formats = get_strings(struc, "device-format");
+
+        for (const auto& out_entry : get_format_entries(struc, is_gst_format))
+        {
+            const auto out = out_entry.ic4_format;
+
+            if (device_formats.empty())
+            {
+                gst_caps_append_structure(ret, with_format(struc, out_entry));
+            }
+
+            for (const auto& in_entry : ic4::gst::get_ic4_gst_table_view())
+            {
+                if (in_entry.ic4_format == out || !is_gst_format(in_entry)
+                    || !ic4::canTransform(in_entry.ic4_format, out))
+                {
+                    continue;
+                }
+                if (!device_formats.empty()
+                    && std::find(device_formats.begin(), device_formats.end(), in_entry.gst_format)
+                           == device_formats.end())
+                {
+                    continue;
+                }
+                gst_caps_append_structure(ret, with_format(struc, in_entry));
+            }
+        }
+    }
+
+    GstCaps* merged = ic4::gst::merge_caps(ret);
+    gst_caps_unref(ret);
+    return merged;
+}
+
+} // namespace
+
+
+struct ic4_convert_state
+{
+    frame_layout in;
+    frame_layout out;
+
+    std::unique_ptr<ic4::gst::striped_converter> converter;
+};
+
+
+static GstCaps* gst_ic4_convert_transform_caps(GstBaseTransform* trans,
+                                               GstPadDirection direction,
+                                               GstCaps* caps,
+                                               GstCaps* filter)
+{
+    GstCaps* ret = direction == GST_PAD_SINK ? transform_to_output(caps) : transform_to_input(caps);
+
+    GST_DEBUG_OBJECT(trans,
+                     "%s %" GST_PTR_FORMAT " -> %" GST_PTR_FORMAT,
+                     direction == GST_PAD_SINK ? "output for" : "input for",
+                     static_cast<void*>(caps),
+                     static_cast<void*>(ret));
+
+    if (filter)
+    {
+        GstCaps* tmp = gst_caps_intersect_full(filter, ret, GST_CAPS_INTERSECT_FIRST);
+        gst_caps_unref(ret);
+        ret = tmp;
+    }
+    return ret;
+}
+
+
+static gboolean gst_ic4_convert_set_caps(GstBaseTransform* trans, GstCaps* incaps, GstCaps* outcaps)
+{
+    GstIC4Convert* self = GST_IC4_CONVERT(trans);
+
+    frame_layout in;
+    frame_layout out;
+
+    if (!get_frame_layout(incaps, in) || !get_frame_layout(outcaps, out))
+    {
+        GST_ERROR_OBJECT(self, "Unable to interpret caps %" GST_PTR_FORMAT " -> %" GST_PTR_FORMAT,
+                         static_cast<void*>(incaps),
+                         static_cast<void*>(outcaps));
+        return FALSE;
+    }
+
+    if (in.width != out.width || in.height != out.height)
+    {
+        GST_ERROR_OBJECT(self, "ic4convert does not scale.");
+        return FALSE;
+    }
+
+    const bool passthrough = in.format == out.format;
+
+    if (!passthrough && !ic4::canTransform(in.format, out.format))
+    {
+        GST_ERROR_OBJECT(self,
+                         "IC4 cannot transform from %s to %s.",
+                         ic4::to_string(in.format).c_str(),
+                         ic4::to_string(out.format).c_str());
+        return FALSE;
+    }
+
+    auto cpus = ic4::gst::parse_cpu_list(self->cpu_affinity ? self->cpu_affinity : "");
+    if (!cpus)
+    {
+        GST_ERROR_OBJECT(self, "Invalid cpu-affinity \"%s\", expected a list like \"0,2,4-7\".",
+                         self->cpu_affinity);
+        return FALSE;
+    }
+
+    gst_base_transform_set_passthrough(trans, passthrough);
+
+    GST_INFO_OBJECT(self,
+                    "Converting from %s to %s with %u threads",
+                    ic4::to_string(in.format).c_str(),
+                    ic4::to_string(out.format).c_str(),
+                    self->conversion_threads);
+
+    // the workers survive renegotiation unless the thread settings changed
+    std::unique_ptr<ic4::gst::striped_converter> converter;
+    if (self->state && self->state->converter
+        && self->state->converter->threads() == self->conversion_threads
+        && self->state->converter->cpus() == *cpus)
+    {
+        converter = std::move(self->state->converter);
+    }
+    else if (!passthrough)
+    {
+        converter = std::make_unique<ic4::gst::striped_converter>(self->conversion_threads,
+                                                                  std::move(*cpus));
+    }
+
+    delete self->state;
+    self->state = new ic4_convert_state { in, out, std::move(converter) };
+
+    return TRUE;
+}
+
+
+static gboolean gst_ic4_convert_transform_size(GstBaseTransform* trans,
+                                               GstPadDirection /*direction*/,
+                                               GstCaps* /*caps*/,
+                                               gsize /*size*/,
+                                               GstCaps* othercaps,
+                                               gsize* othersize)
+{
+    // input buffers may be padded, the size only depends on the caps
+    frame_layout layout;
+    if (!get_frame_layout(othercaps, layout))
+    {
+        GST_ERROR_OBJECT(trans, "Unable to compute frame size for %" GST_PTR_FORMAT,
+                         static_cast<void*>(othercaps));
+        return FALSE;
+    }
+    *othersize = layout.size;
+    return TRUE;
+}
+
+
+static GstFlowReturn gst_ic4_convert_transform(GstBaseTransform* trans, GstBuffer* inbuf, GstBuffer* outbuf)
+{
+    GstIC4Convert* self = GST_IC4_CONVERT(trans);
+
+    if (!self->state)
+    {
+        return GST_FLOW_NOT_NEGOTIATED;
+    }
+    const auto& state = *self->state;
+
+    // ic4src describes padded frames with GstVideoMeta
+    size_t in_offset = 0;
+    size_t in_pitch = state.in.pitch;
+    if (GstVideoMeta* meta = gst_buffer_get_video_meta(inbuf))
+    {
+        in_offset = meta->offset[0];
+        in_pitch = meta->stride[0];
+    }
+
+    GstMapInfo in_map;
+    if (!gst_buffer_map(inbuf, &in_map, GST_MAP_READ))
+    {
+        GST_ELEMENT_ERROR(self, RESOURCE, READ, ("Unable to map input buffer."), (nullptr));
+        return GST_FLOW_ERROR;
+    }
+
+    GstMapInfo out_map;
+    if (!gst_buffer_map(outbuf, &out_map, GST_MAP_WRITE))
+    {
+        gst_buffer_unmap(inbuf, &in_map);
+        GST_ELEMENT_ERROR(self, RESOURCE, WRITE, ("Unable to map output buffer."), (nullptr));
+        return GST_FLOW_ERROR;
+    }
+
+    GstFlowReturn ret = GST_FLOW_OK;
+
+    ic4::gst::image_view src = {
+        in_map.data + in_offset, in_pitch, state.in.format, state.in.width, state.in.height,
+    };
+    ic4::gst::image_view dst = {
+        out_map.data, state.out.pitch, state.out.format, state.out.width, state.out.height,
+    };
+
+    std::string message = "Buffer too small.";
+    if (in_offset + in_pitch * state.in.height > in_map.size || state.out.size > out_map.size
+        || !state.converter || !state.converter->convert(src, dst, message))
+    {
+        GST_ELEMENT_ERROR(self, STREAM, FORMAT,
+                          ("Unable to convert %s to %s.",
+                           ic4::to_string(state.in.format).c_str(),
+                           ic4::to_string(state.out.format).c_str()),
+                          ("%s", message.c_str()));
+        ret = GST_FLOW_ERROR;
+    }
+
+    gst_buffer_unmap(outbuf, &out_map);
+    gst_buffer_unmap(inbuf, &in_map);
+
+    return ret;
+}
+
+
+static gboolean gst_ic4_convert_propose_allocation(GstBaseTransform* trans,
+                                                   GstQuery* decide_query,
+                                                   GstQuery* query)
+{
+    // padded input is read through GstVideoMeta, ic4src does not have to copy it
+    if (!gst_base_transform_is_passthrough(trans))
+    {
+        gst_query_add_allocation_meta(query, GST_VIDEO_META_API_TYPE, nullptr);
+    }
+
+    return GST_BASE_TRANSFORM_CLASS(gst_ic4_convert_parent_class)
+        ->propose_allocation(trans, decide_query, query);
+}
+
+
+static gboolean gst_ic4_convert_stop(GstBaseTransform* trans)
+{
+    GstIC4Convert* self = GST_IC4_CONVERT(trans);
+
+    delete self->state;
+    self->state = nullptr;
+
+    return TRUE;
+}
+
+
+static void gst_ic4_convert_set_property(GObject* object,
+                                         guint prop_id,
+                                         const GValue* value,
+                                         GParamSpec* pspec)
+{
+    GstIC4Convert* self = GST_IC4_CONVERT(object);
+
+    switch (prop_id)
+    {
+        case PROP_CONVERSION_THREADS:
+        {
+            self->conversion_threads = g_value_get_uint(value);
+            break;
+        }
+        case PROP_CPU_AFFINITY:
+        {
+            g_free(self->cpu_affinity);
+            self->cpu_affinity = g_value_dup_string(value);
+            break;
+        }
+        default:
+        {
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+        }
+    }
+}
+
+
+static void gst_ic4_convert_get_property(GObject* object,
+                                         guint prop_id,
+                                         GValue* value,
+                                         GParamSpec* pspec)
+{
+    GstIC4Convert* self = GST_IC4_CONVERT(object);
+
+    switch (prop_id)
+    {
+        case PROP_CONVERSION_THREADS:
+        {
+            g_value_set_uint(value, self->conversion_threads);
+            break;
+        }
+        case PROP_CPU_AFFINITY:
+        {
+            g_value_set_string(value, self->cpu_affinity ? self->cpu_affinity : "");
+            break;
+        }
+        default:
+        {
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+        }
+    }
+}
+
+
+static void gst_ic4_convert_init(GstIC4Convert* self)
+{
+    ic4::initLibrary();
+
+    self->state = nullptr;
+    self->conversion_threads = 1;
+    self->cpu_affinity = nullptr;
+}
+
+
+static void gst_ic4_convert_finalize(GObject* object)
+{
+    GstIC4Convert* self = GST_IC4_CONVERT(object);
+
+    delete self->state;
+    self->state = nullptr;
+
+    g_free(self->cpu_affinity);
+    self->cpu_affinity = nullptr;
+
+    G_OBJECT_CLASS(gst_ic4_convert_parent_class)->finalize(object);
+}
+
+
+static void gst_ic4_convert_class_init(GstIC4ConvertClass* klass)
+{
+    GObjectClass* gobject_class = G_OBJECT_CLASS(klass);
+    GstElementClass* element_class = GST_ELEMENT_CLASS(klass);
+    GstBaseTransformClass* transform_class = GST_BASE_TRANSFORM_CLASS(klass);
+
+    gobject_class->finalize = gst_ic4_convert_finalize;
+    gobject_class->set_property = gst_ic4_convert_set_property;
+    gobject_class->get_property = gst_ic4_convert_get_property;
+
+    g_object_class_install_property(
+        gobject_class,
+        PROP_CONVERSION_THREADS,
+        g_param_spec_uint("conversion-threads",
+                          "Conversion threads",
+                          "Threads that convert each frame in horizontal stripes, "
+                          "the result is identical to a single thread.",
+                          1,
+                          256,
+                          1,
+                          static_cast<GParamFlags>(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+                                                   | GST_PARAM_MUTABLE_READY)));
+
+    g_object_class_install_property(
+        gobject_class,
+        PROP_CPU_AFFINITY,
+        g_param_spec_string("cpu-affinity",
+                            "CPU affinity",
+                            "CPUs the conversion threads are pinned to, e.g. \"2,3,4-7\". "
+                            "Empty leaves them to the scheduler.",
+                            "",
+                            static_cast<GParamFlags>(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+                                                     | GST_PARAM_MUTABLE_READY)));
+
+    GST_DEBUG_CATEGORY_INIT(ic4_convert_debug, "ic4convert", 0, "ic4 format conversion");
+
+    gst_element_class_set_static_metadata(
+        element_class, "IC4 Format Conversion", "Filter/Converter/Video",
+        "Converts formats with the transforms ic4src offers through device-format",
+        "The Imaging Source <support@theimagingsource.com>");
+
+    GstCaps* caps = make_template_caps();
+    gst_element_class_add_pad_template(element_class,
+                                       gst_pad_template_new("sink", GST_PAD_SINK, GST_PAD_ALWAYS, caps));
+    gst_element_class_add_pad_template(element_class,
+                                       gst_pad_template_new("src", GST_PAD_SRC, GST_PAD_ALWAYS, caps));
+    gst_caps_unref(caps);
+
+    transform_class->transform_caps = gst_ic4_convert_transform_caps;
+    transform_class->set_caps = gst_ic4_convert_set_caps;
+    transform_class->transform_size = gst_ic4_convert_transform_size;
+    transform_class->transform = gst_ic4_convert_transform;
+    transform_class->propose_allocation = gst_ic4_convert_propose_allocation;
+    transform_class->stop = gst_ic4_convert_stop;
+    transform_class->passthrough_on_same_caps = FALSE;
+}
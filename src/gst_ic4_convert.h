@@ -0,0 +1,37 @@
+
+
+#pragma once
+
+#include <gst/base/gstbasetransform.h>
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_IC4_CONVERT (gst_ic4_convert_get_type())
+#define GST_IC4_CONVERT(obj)                                              \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj), GST_TYPE_IC4_CONVERT, GstIC4Convert))
+#define GST_IS_IC4_CONVERT(obj)                                           \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj), GST_TYPE_IC4_CONVERT))
+
+typedef struct _GstIC4Convert GstIC4Convert;
+typedef struct _GstIC4ConvertClass GstIC4ConvertClass;
+struct ic4_convert_state;
+
+struct _GstIC4Convert {
+  GstBaseTransform element;
+
+  // negotiated formats, only valid between set_caps and stop
+  struct ic4_convert_state *state;
+
+  // stripes frames are converted in, applied with the next set_caps
+  guint conversion_threads;
+  gchar *cpu_affinity;
+};
+
+struct _GstIC4ConvertClass {
+  GstBaseTransformClass parent_class;
+};
+
+GType gst_ic4_convert_get_type(void);
+
+G_END_DECLS
@@ -0,0 +1,595 @@
+#include "gst_ic4_polar_split.h"
+
+#include "caps_formats.h"
+#include "caps_merge.h"
+#include "format.h"
+#include "frame_layout.h"
+#include "polarization.h"
+
+#include <gst/video/video.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+GST_DEBUG_CATEGORY_STATIC(ic4_polar_split_debug);
+#define GST_CAT_DEFAULT ic4_polar_split_debug
+
+G_DEFINE_TYPE(GstIC4PolarSplit, gst_ic4_polar_split, GST_TYPE_BASE_TRANSFORM)
+
+enum
+{
+    PROP_0,
+    PROP_MODE,
+};
+
+
+GType gst_ic4_polar_split_mode_get_type(void)
+{
+    static gsize type = 0;
+
+    if (g_once_init_enter(&type))
+    {
+        static const GEnumValue values[] = {
+            { GST_IC4_POLAR_SPLIT_MODE_ANGLES,
+              "The 0, 45, 90 and 135 degree planes",
+              "angles" },
+            { GST_IC4_POLAR_SPLIT_MODE_AOLP_DOLP,
+              "Angle and degree of linear polarization, mono formats only",
+              "aolp-dolp" },
+            { GST_IC4_POLAR_SPLIT_MODE_ALL,
+              "The four angle planes followed by AoLP and DoLP, mono formats only",
+              "all" },
+            { 0, nullptr, nullptr },
+        };
+
+        GType new_type = g_enum_register_static("GstIC4PolarSplitMode", values);
+        g_once_init_leave(&type, new_type);
+    }
+    return (GType)type;
+}
+
+
+namespace
+{
+
+using ic4::gst::frame_layout;
+using ic4::gst::get_format_entries;
+using ic4::gst::get_frame_layout;
+using ic4::gst::polarization_mode;
+
+
+polarization_mode to_polarization_mode(GstIC4PolarSplitMode mode)
+{
+    switch (mode)
+    {
+        case GST_IC4_POLAR_SPLIT_MODE_AOLP_DOLP:
+            return polarization_mode::aolp_dolp;
+        case GST_IC4_POLAR_SPLIT_MODE_ALL:
+            return polarization_mode::all;
+        default:
+            return polarization_mode::angles;
+    }
+}
+
+
+bool is_polarized(const ic4::gst::ic4_gst_table_entry& entry)
+{
+    return ic4::gst::get_angle_format(entry.ic4_format) != ic4::PixelFormat::Invalid;
+}
+
+
+// format table entries of the polarized formats ic4polarsplit accepts
+const std::vector<ic4::gst::ic4_gst_table_entry>& polarized_formats()
+{
+    static const auto formats = []
+    {
+        std::vector<ic4::gst::ic4_gst_table_entry> ret;
+        for (const auto& entry : ic4::gst::get_ic4_gst_table_view())
+        {
+            if (is_polarized(entry))
+            {
+                ret.push_back(entry);
+            }
+        }
+        return ret;
+    }();
+    return formats;
+}
+
+
+/**
+ * Scale a fixed int or int range field by num / den.
+ * Returns false when no size is left, e.g. for fixed sizes that do not divide.
+ * Missing fields stay missing, other types are not supported.
+ */
+bool scale_field(GstStructure* struc, const char* field, int num, int den)
+{
+    const GValue* value = gst_structure_get_value(struc, field);
+    if (!value)
+    {
+        return true;
+    }
+
+    if (G_VALUE_HOLDS_INT(value))
+    {
+        const gint64 v = (gint64)g_value_get_int(value) * num;
+        if (v % den != 0 || v / den > G_MAXINT)
+        {
+            return false;
+        }
+        gst_structure_set(struc, field, G_TYPE_INT, (int)(v / den), nullptr);
+        return true;
+    }
+
+    if (GST_VALUE_HOLDS_INT_RANGE(value))
+    {
+        const gint64 min = std::max<gint64>(
+            ((gint64)gst_value_get_int_range_min(value) * num + den - 1) / den, 1);
+        const gint64 max = std::min<gint64>((gint64)gst_value_get_int_range_max(value) * num / den,
+                                            G_MAXINT);
+        if (min > max)
+        {
+            return false;
+        }
+        if (min == max)
+        {
+            gst_structure_set(struc, field, G_TYPE_INT, (int)min, nullptr);
+        }
+        else
+        {
+            gst_structure_set(struc, field, GST_TYPE_INT_RANGE, (int)min, (int)max, nullptr);
+        }
+        return true;
+    }
+    return false;
+}
+
+
+/**
+ * Copy of struc describing entry, width and height scaled by the given fractions.
+ * Returns nullptr when the size cannot be scaled.
+ */
+GstStructure* with_format(const GstStructure* struc,
+                          const ic4::gst::ic4_gst_table_entry& entry,
+                          int width_num,
+                          int width_den,
+                          int height_num,
+                          int height_den)
+{
+    GstStructure* s = gst_structure_copy(struc);
+    gst_structure_set_name(s, entry.gst_name);
+    gst_structure_set(s, "format", G_TYPE_STRING, entry.gst_format, nullptr);
+    gst_structure_remove_field(s, "device-format");
+
+    if (!scale_field(s, "width", width_num, width_den)
+        || !scale_field(s, "height", height_num, height_den))
+    {
+        gst_structure_free(s);
+        return nullptr;
+    }
+    return s;
+}
+
+
+GstCaps* make_template_caps(bool output)
+{
+    GstCaps* caps = gst_caps_new_empty();
+
+    for (const auto& polarized : polarized_formats())
+    {
+        auto entry = output ? ic4::gst::get_entry(ic4::gst::get_angle_format(polarized.ic4_format))
+                            : polarized;
+        if (!entry)
+        {
+            continue;
+        }
+        gst_caps_append_structure(caps,
+                                  gst_structure_new(entry->gst_name,
+                                                    "format", G_TYPE_STRING, entry->gst_format,
+                                                    "width", GST_TYPE_INT_RANGE, 1, G_MAXINT,
+                                                    "height", GST_TYPE_INT_RANGE, 1, G_MAXINT,
+                                                    "framerate", GST_TYPE_FRACTION_RANGE, 0, 1, G_MAXINT, 1,
+                                                    nullptr));
+    }
+
+    GstCaps* merged = ic4::gst::merge_caps(caps);
+    gst_caps_unref(caps);
+    return merged;
+}
+
+
+/**
+ * Caps of the stacked planes for polarized input caps.
+ * The planes are half as wide and high as the input, planes * height / 2 lines in total.
+ */
+GstCaps* transform_to_output(const GstCaps* caps, polarization_mode mode)
+{
+    GstCaps* ret = gst_caps_new_empty();
+    const int planes = ic4::gst::polarization_planes(mode);
+
+    for (guint i = 0; i < gst_caps_get_size(caps); ++i)
+    {
+        const GstStructure* struc = gst_caps_get_structure(caps, i);
+
+        for (const auto& in : get_format_entries(struc, is_polarized))
+        {
+            if (mode != polarization_mode::angles
+                && !ic4::gst::can_compute_aolp_dolp(in.ic4_format))
+            {
+                continue;
+            }
+
+            auto out = ic4::gst::get_entry(ic4::gst::get_angle_format(in.ic4_format));
+            if (!out)
+            {
+                continue;
+            }
+            if (GstStructure* s = with_format(struc, *out, 1, 2, planes, 2))
+            {
+                gst_caps_append_structure(ret, s);
+            }
+        }
+    }
+
+    GstCaps* merged = ic4::gst::merge_caps(ret);
+    gst_caps_unref(ret);
+    return merged;
+}
+
+
+// polarized input caps that are split into the output caps
+GstCaps* transform_to_input(const GstCaps* caps, polarization_mode mode)
+{
+    GstCaps* ret = gst_caps_new_empty();
+    const int planes = ic4::gst::polarization_planes(mode);
+
+    for (guint i = 0; i < gst_caps_get_size(caps); ++i)
+    {
+        const GstStructure* struc = gst_caps_get_structure(caps, i);
+
+        for (const auto& out : get_format_entries(struc))
+        {
+            auto in = ic4::gst::get_entry(ic4::gst::get_polarized_format(out.ic4_format));
+            if (!in)
+            {
+                continue;
+            }
+
+            if (mode != polarization_mode::angles
+                && !ic4::gst::can_compute_aolp_dolp(in->ic4_format))
+            {
+                continue;
+            }
+
+            if (GstStructure* s = with_format(struc, *in, 2, 1, 2, planes))
+            {
+                gst_caps_append_structure(ret, s);
+            }
+        }
+    }
+
+    GstCaps* merged = ic4::gst::merge_caps(ret);
+    gst_caps_unref(ret);
+    return merged;
+}
+
+} // namespace
+
+
+struct ic4_polar_split_state
+{
+    frame_layout in;
+    frame_layout out;
+    polarization_mode mode;
+    // angle lines of aolp-dolp, sized once for the negotiated width
+    std::vector<uint8_t> scratch;
+};
+
+
+static GstCaps* gst_ic4_polar_split_transform_caps(GstBaseTransform* trans,
+                                                   GstPadDirection direction,
+                                                   GstCaps* caps,
+                                                   GstCaps* filter)
+{
+    GstIC4PolarSplit* self = GST_IC4_POLAR_SPLIT(trans);
+
+    const auto mode = to_polarization_mode(self->mode);
+
+    GstCaps* ret = direction == GST_PAD_SINK ? transform_to_output(caps, mode)
+                                             : transform_to_input(caps, mode);
+
+    GST_DEBUG_OBJECT(trans,
+                     "%s %" GST_PTR_FORMAT " -> %" GST_PTR_FORMAT,
+                     direction == GST_PAD_SINK ? "output for" : "input for",
+                     static_cast<void*>(caps),
+                     static_cast<void*>(ret));
+
+    if (filter)
+    {
+        GstCaps* tmp = gst_caps_intersect_full(filter, ret, GST_CAPS_INTERSECT_FIRST);
+        gst_caps_unref(ret);
+        ret = tmp;
+    }
+    return ret;
+}
+
+
+static gboolean gst_ic4_polar_split_set_caps(GstBaseTransform* trans,
+                                             GstCaps* incaps,
+                                             GstCaps* outcaps)
+{
+    GstIC4PolarSplit* self = GST_IC4_POLAR_SPLIT(trans);
+
+    frame_layout in;
+    frame_layout out;
+
+    if (!get_frame_layout(incaps, in) || !get_frame_layout(outcaps, out))
+    {
+        GST_ERROR_OBJECT(self, "Unable to interpret caps %" GST_PTR_FORMAT " -> %" GST_PTR_FORMAT,
+                         static_cast<void*>(incaps),
+                         static_cast<void*>(outcaps));
+        return FALSE;
+    }
+
+    const auto mode = to_polarization_mode(self->mode);
+    const int planes = ic4::gst::polarization_planes(mode);
+
+    if (ic4::gst::get_angle_format(in.format) != out.format
+        || (mode != polarization_mode::angles && !ic4::gst::can_compute_aolp_dolp(in.format)))
+    {
+        GST_ERROR_OBJECT(self,
+                         "Unable to split %s into %s.",
+                         ic4::gst::get_pixel_format_name(in.format).c_str(),
+                         ic4::gst::get_pixel_format_name(out.format).c_str());
+        return FALSE;
+    }
+
+    if (in.width % 2 != 0 || in.height % 2 != 0 || out.width != in.width / 2
+        || out.height != planes * in.height / 2)
+    {
+        GST_ERROR_OBJECT(self,
+                         "A %dx%d frame cannot be split into %d planes of %dx%d.",
+                         in.width,
+                         in.height,
+                         planes,
+                         out.width,
+                         out.height / planes);
+        return FALSE;
+    }
+
+    GST_INFO_OBJECT(self,
+                    "Splitting %s into %d planes of %s",
+                    ic4::gst::get_pixel_format_name(in.format).c_str(),
+                    planes,
+                    ic4::gst::get_pixel_format_name(out.format).c_str());
+
+    delete self->state;
+    self->state = new ic4_polar_split_state {
+        in, out, mode,
+        std::vector<uint8_t>(ic4::gst::polarization_scratch_size(mode, out.format, out.width)),
+    };
+
+    return TRUE;
+}
+
+
+static gboolean gst_ic4_polar_split_transform_size(GstBaseTransform* trans,
+                                                   GstPadDirection /*direction*/,
+                                                   GstCaps* /*caps*/,
+                                                   gsize /*size*/,
+                                                   GstCaps* othercaps,
+                                                   gsize* othersize)
+{
+    // input buffers may be padded, the size only depends on the caps
+    frame_layout layout;
+    if (!get_frame_layout(othercaps, layout))
+    {
+        GST_ERROR_OBJECT(trans, "Unable to compute frame size for %" GST_PTR_FORMAT,
+                         static_cast<void*>(othercaps));
+        return FALSE;
+    }
+    *othersize = layout.size;
+    return TRUE;
+}
+
+
+static GstFlowReturn gst_ic4_polar_split_transform(GstBaseTransform* trans,
+                                                   GstBuffer* inbuf,
+                                                   GstBuffer* outbuf)
+{
+    GstIC4PolarSplit* self = GST_IC4_POLAR_SPLIT(trans);
+
+    if (!self->state)
+    {
+        return GST_FLOW_NOT_NEGOTIATED;
+    }
+    auto& state = *self->state;
+
+    // ic4src describes padded frames with GstVideoMeta
+    size_t in_offset = 0;
+    size_t in_pitch = state.in.pitch;
+    if (GstVideoMeta* meta = gst_buffer_get_video_meta(inbuf))
+    {
+        in_offset = meta->offset[0];
+        in_pitch = meta->stride[0];
+    }
+
+    GstMapInfo in_map;
+    if (!gst_buffer_map(inbuf, &in_map, GST_MAP_READ))
+    {
+        GST_ELEMENT_ERROR(self, RESOURCE, READ, ("Unable to map input buffer."), (nullptr));
+        return GST_FLOW_ERROR;
+    }
+
+    GstMapInfo out_map;
+    if (!gst_buffer_map(outbuf, &out_map, GST_MAP_WRITE))
+    {
+        gst_buffer_unmap(inbuf, &in_map);
+        GST_ELEMENT_ERROR(self, RESOURCE, WRITE, ("Unable to map output buffer."), (nullptr));
+        return GST_FLOW_ERROR;
+    }
+
+    GstFlowReturn ret = GST_FLOW_OK;
+
+    ic4::gst::image_view src = {
+        in_map.data + in_offset, in_pitch, state.in.format, state.in.width, state.in.height,
+    };
+    ic4::gst::image_view dst = {
+        out_map.data, state.out.pitch, state.out.format, state.out.width, state.out.height,
+    };
+
+    if (in_offset + in_pitch * state.in.height > in_map.size || state.out.size > out_map.size)
+    {
+        GST_ELEMENT_ERROR(self, STREAM, FORMAT, ("Buffer too small."), (nullptr));
+        ret = GST_FLOW_ERROR;
+    }
+    else if (!ic4::gst::split_polarization(src, state.mode, dst, state.scratch))
+    {
+        GST_ELEMENT_ERROR(self, STREAM, FORMAT,
+                          ("Unable to split %s.",
+                           ic4::gst::get_pixel_format_name(state.in.format).c_str()),
+                          (nullptr));
+        ret = GST_FLOW_ERROR;
+    }
+
+    gst_buffer_unmap(outbuf, &out_map);
+    gst_buffer_unmap(inbuf, &in_map);
+
+    return ret;
+}
+
+
+static gboolean gst_ic4_polar_split_propose_allocation(GstBaseTransform* trans,
+                                                       GstQuery* decide_query,
+                                                       GstQuery* query)
+{
+    // padded input is read through GstVideoMeta, ic4src does not have to copy it
+    gst_query_add_allocation_meta(query, GST_VIDEO_META_API_TYPE, nullptr);
+
+    return GST_BASE_TRANSFORM_CLASS(gst_ic4_polar_split_parent_class)
+        ->propose_allocation(trans, decide_query, query);
+}
+
+
+static gboolean gst_ic4_polar_split_stop(GstBaseTransform* trans)
+{
+    GstIC4PolarSplit* self = GST_IC4_POLAR_SPLIT(trans);
+
+    delete self->state;
+    self->state = nullptr;
+
+    return TRUE;
+}
+
+
+static void gst_ic4_polar_split_set_property(GObject* object,
+                                             guint prop_id,
+                                             const GValue* value,
+                                             GParamSpec* pspec)
+{
+    GstIC4PolarSplit* self = GST_IC4_POLAR_SPLIT(object);
+
+    switch (prop_id)
+    {
+        case PROP_MODE:
+        {
+            self->mode = static_cast<GstIC4PolarSplitMode>(g_value_get_enum(value));
+            break;
+        }
+        default:
+        {
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+        }
+    }
+}
+
+
+static void gst_ic4_polar_split_get_property(GObject* object,
+                                             guint prop_id,
+                                             GValue* value,
+                                             GParamSpec* pspec)
+{
+    GstIC4PolarSplit* self = GST_IC4_POLAR_SPLIT(object);
+
+    switch (prop_id)
+    {
+        case PROP_MODE:
+        {
+            g_value_set_enum(value, self->mode);
+            break;
+        }
+        default:
+        {
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+        }
+    }
+}
+
+
+static void gst_ic4_polar_split_init(GstIC4PolarSplit* self)
+{
+    self->state = nullptr;
+    self->mode = GST_IC4_POLAR_SPLIT_MODE_ANGLES;
+}
+
+
+static void gst_ic4_polar_split_finalize(GObject* object)
+{
+    GstIC4PolarSplit* self = GST_IC4_POLAR_SPLIT(object);
+
+    delete self->state;
+    self->state = nullptr;
+
+    G_OBJECT_CLASS(gst_ic4_polar_split_parent_class)->finalize(object);
+}
+
+
+static void gst_ic4_polar_split_class_init(GstIC4PolarSplitClass* klass)
+{
+    GObjectClass* gobject_class = G_OBJECT_CLASS(klass);
+    GstElementClass* element_class = GST_ELEMENT_CLASS(klass);
+    GstBaseTransformClass* transform_class = GST_BASE_TRANSFORM_CLASS(klass);
+
+    gobject_class->finalize = gst_ic4_polar_split_finalize;
+    gobject_class->set_property = gst_ic4_polar_split_set_property;
+    gobject_class->get_property = gst_ic4_polar_split_get_property;
+
+    g_object_class_install_property(
+        gobject_class,
+        PROP_MODE,
+        g_param_spec_enum("mode",
+                          "Mode",
+                          "Planes stacked from top to bottom into each output frame",
+                          GST_TYPE_IC4_POLAR_SPLIT_MODE,
+                          GST_IC4_POLAR_SPLIT_MODE_ANGLES,
+                          static_cast<GParamFlags>(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+                                                   | GST_PARAM_MUTABLE_READY)));
+
+    GST_DEBUG_CATEGORY_INIT(ic4_polar_split_debug, "ic4polarsplit", 0, "ic4 polarization split");
+
+    gst_element_class_set_static_metadata(
+        element_class, "IC4 Polarization Split", "Filter/Converter/Video",
+        "Splits polarized frames into 0, 45, 90 and 135 degree planes, AoLP and DoLP",
+        "The Imaging Source <support@theimagingsource.com>");
+
+    GstCaps* sink_caps = make_template_caps(false);
+    gst_element_class_add_pad_template(
+        element_class, gst_pad_template_new("sink", GST_PAD_SINK, GST_PAD_ALWAYS, sink_caps));
+    gst_caps_unref(sink_caps);
+
+    GstCaps* src_caps = make_template_caps(true);
+    gst_element_class_add_pad_template(
+        element_class, gst_pad_template_new("src", GST_PAD_SRC, GST_PAD_ALWAYS, src_caps));
+    gst_caps_unref(src_caps);
+
+    transform_class->transform_caps = gst_ic4_polar_split_transform_caps;
+    transform_class->set_caps = gst_ic4_polar_split_set_caps;
+    transform_class->transform_size = gst_ic4_polar_split_transform_size;
+    transform_class->transform = gst_ic4_polar_split_transform;
+    transform_class->propose_allocation = gst_ic4_polar_split_propose_allocation;
+    transform_class->stop = gst_ic4_polar_split_stop;
+    transform_class->passthrough_on_same_caps = FALSE;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <gst/base/gstbasetransform.h>
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_IC4_POLAR_SPLIT (gst_ic4_polar_split_get_type())
+#define GST_IC4_POLAR_SPLIT(obj)                                          \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj), GST_TYPE_IC4_POLAR_SPLIT, GstIC4PolarSplit))
+#define GST_IS_IC4_POLAR_SPLIT(obj)                                       \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj), GST_TYPE_IC4_POLAR_SPLIT))
+
+typedef enum
+{
+    GST_IC4_POLAR_SPLIT_MODE_ANGLES,
+    GST_IC4_POLAR_SPLIT_MODE_AOLP_DOLP,
+    GST_IC4_POLAR_SPLIT_MODE_ALL,
+} GstIC4PolarSplitMode;
+
+#define GST_TYPE_IC4_POLAR_SPLIT_MODE (gst_ic4_polar_split_mode_get_type())
+GType gst_ic4_polar_split_mode_get_type(void);
+
+typedef struct _GstIC4PolarSplit GstIC4PolarSplit;
+typedef struct _GstIC4PolarSplitClass GstIC4PolarSplitClass;
+struct ic4_polar_split_state;
+
+struct _GstIC4PolarSplit {
+  GstBaseTransform element;
+
+  // negotiated layouts, only valid between set_caps and stop
+  struct ic4_polar_split_state *state;
+
+  // planes stacked into the output, applied with the next caps negotiation
+  GstIC4PolarSplitMode mode;
+};
+
+struct _GstIC4PolarSplitClass {
+  GstBaseTransformClass parent_class;
+};
+
+GType gst_ic4_polar_split_get_type(void);
+
+G_END_DECLS
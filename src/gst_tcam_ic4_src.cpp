@@ -5,6 +5,8 @@
 #include "ic4_gst_conversions.h"
 #include "ic4src_gst_device_provider.h"
 #include "gst_tcam_ic4_src.h"
+#include "gst_ic4_convert.h"
+#include "gst_ic4_polar_split.h"
 #include "ic4/DeviceEnum.h"
 #include "ic4/ImageType.h"
 #include "ic4/Grabber.h"
@@ -15,8 +17,12 @@
 #include <algorithm>
 #include <mutex>
 #include <condition_variable>
+#include <cstring>
+#include <cstdio>
+#include <vector>
 
 #include "ic4_device_state.h"
+#include "ic4_buffer_pool.h"
 
 #include "format.h"
 
@@ -53,6 +59,7 @@ G_DEFINE_TYPE_WITH_CODE(
 enum {
     SIGNAL_DEVICE_OPEN,
     SIGNAL_DEVICE_CLOSE,
+    SIGNAL_SET_ROI_OFFSET,
     SIGNAL_LAST,
 };
 
@@ -62,8 +69,119 @@ enum {
     PROP_SERIAL,
     PROP_DEVICE_TYPE,
     PROP_DEVICE_PROP,
+    PROP_BUFFER_BINDINGS,
+    PROP_TIMESTAMP_MODE,
+    PROP_BUFFER_COUNT,
+    PROP_MAX_BUFFER_MEMORY,
+    PROP_STATISTICS,
+    PROP_STATS_INTERVAL,
+    PROP_DROP_POLICY,
+    PROP_ALLOCATION_MODE,
+    PROP_CAPS_CACHE,
+    PROP_ROI_OFFSET_X,
+    PROP_ROI_OFFSET_Y,
+    PROP_DEVICE_FORMAT_SELECTION,
+    PROP_CONVERSION_THREADS,
+    PROP_CPU_AFFINITY,
 };
 
+GType gst_ic4_src_timestamp_mode_get_type(void)
+{
+    static gsize type = 0;
+
+    if (g_once_init_enter(&type))
+    {
+        static const GEnumValue values[] = {
+            { GST_IC4_SRC_TIMESTAMP_MODE_DEVICE,
+              "Device timestamps, anchored to the arrival of the first frame",
+              "device" },
+            { GST_IC4_SRC_TIMESTAMP_MODE_ARRIVAL,
+              "Host time at which the frame was delivered by IC4",
+              "arrival" },
+            { GST_IC4_SRC_TIMESTAMP_MODE_SMOOTHED,
+              "Device timestamps mapped onto the pipeline clock with drift compensation",
+              "smoothed" },
+            { 0, nullptr, nullptr },
+        };
+
+        GType new_type = g_enum_register_static("GstIC4SrcTimestampMode", values);
+        g_once_init_leave(&type, new_type);
+    }
+    return (GType)type;
+}
+
+GType gst_ic4_src_drop_policy_get_type(void)
+{
+    static gsize type = 0;
+
+    if (g_once_init_enter(&type))
+    {
+        static const GEnumValue values[] = {
+            { GST_IC4_SRC_DROP_POLICY_NEWEST,
+              "Discard waiting frames in favor of the latest one",
+              "newest" },
+            { GST_IC4_SRC_DROP_POLICY_OLDEST,
+              "Keep waiting frames, discard incoming frames when no buffer is free",
+              "oldest" },
+            { GST_IC4_SRC_DROP_POLICY_BLOCK,
+              "Stall frame delivery until downstream accepted the previous frame",
+              "block" },
+            { 0, nullptr, nullptr },
+        };
+
+        GType new_type = g_enum_register_static("GstIC4SrcDropPolicy", values);
+        g_once_init_leave(&type, new_type);
+    }
+    return (GType)type;
+}
+
+GType gst_ic4_src_allocation_mode_get_type(void)
+{
+    static gsize type = 0;
+
+    if (g_once_init_enter(&type))
+    {
+        static const GEnumValue values[] = {
+            { GST_IC4_SRC_ALLOCATION_MODE_SYSTEM,
+              "Buffers are allocated by IC4",
+              "system" },
+            { GST_IC4_SRC_ALLOCATION_MODE_MEMFD,
+              "Every buffer is a memfd, pushed as GstFdMemory",
+              "memfd" },
+            { 0, nullptr, nullptr },
+        };
+
+        GType new_type = g_enum_register_static("GstIC4SrcAllocationMode", values);
+        g_once_init_leave(&type, new_type);
+    }
+    return (GType)type;
+}
+
+GType gst_ic4_src_device_format_selection_get_type(void)
+{
+    static gsize type = 0;
+
+    if (g_once_init_enter(&type))
+    {
+        static const GEnumValue values[] = {
+            { GST_IC4_SRC_DEVICE_FORMAT_SELECTION_CURRENT,
+              "Keep the current device PixelFormat if IC4 can convert it",
+              "current" },
+            { GST_IC4_SRC_DEVICE_FORMAT_SELECTION_BANDWIDTH,
+              "Device PixelFormat with the lowest link bandwidth that keeps the requested precision",
+              "bandwidth" },
+            { GST_IC4_SRC_DEVICE_FORMAT_SELECTION_PRECISION,
+              "Device PixelFormat with the highest bit depth",
+              "precision" },
+            { 0, nullptr, nullptr },
+        };
+
+        GType new_type = g_enum_register_static("GstIC4SrcDeviceFormatSelection", values);
+        g_once_init_leave(&type, new_type);
+    }
+    return (GType)type;
+}
+
 static guint gst_ic4src_signals[SIGNAL_LAST] = {
     0,
 };
@@ -96,6 +214,7 @@ static bool ic4_src_open_camera(GstIC4Src *self)
             ("serial", G_TYPE_STRING, serial.c_str(), nullptr));
 
         self->device->streaming_ = false;
+        self->device->notify_stream();
 
         // the device is considered lost.
         // might as well inform via all possible channels to keep
@@ -117,6 +236,17 @@ static bool ic4_src_open_camera(GstIC4Src *self)
 
     self->device->dev_lost_token_ = self->device->grabber->eventAddDeviceLost(lost_cb);
 
+    // one-time calibration, afterwards caps queries never have to write to the device
+    self->device->ensure_fps_model();
+
+    self->device->watch_caps_properties();
+
+    // these influence the latency we report
+    for (const auto& name : { "ExposureTime", "AcquisitionFrameRate" })
+    {
+        self->device->add_property_watch(name, [self] { self->device->latency_dirty_ = true; });
+    }
+
     g_signal_emit(G_OBJECT(self), gst_ic4src_signals[SIGNAL_DEVICE_OPEN], 0);
 
     return true;
@@ -130,19 +260,18 @@ static void ic4_src_close_camera(GstIC4Src *self) {
         return;
     }
 
-    if (self->device->grabber->isStreaming())
-    {
-        self->device->grabber->streamStop();
-    }
-
-    self->device->streaming_ = false;
+    self->device->stop_stream();
 
     g_signal_emit(G_OBJECT(self),
                   gst_ic4src_signals[SIGNAL_DEVICE_CLOSE],
                   0);
 
     self->device->grabber->eventRemoveDeviceLost(self->device->dev_lost_token_);
+    self->device->remove_property_watches();
+    self->device->invalidate_caps();
 
+    // the sink belongs to the stream of this grabber
+    self->device->release_sink();
     self->device->grabber = nullptr;
 }
 
@@ -180,6 +309,66 @@ static GstCaps* gst_ic4_src_fixate_caps(GstBaseSrc* bsrc, GstCaps* caps)
 }
 
 
+/**
+ * Returns the product of the "binning" and "skipping" factors of struc.
+ */
+static int gst_ic4_src_readout_factor(const GstStructure* struc)
+{
+    int factor = 1;
+
+    for (const char* field : { "binning", "skipping" })
+    {
+        const char* str = gst_structure_get_string(struc, field);
+        int x = 1;
+        int y = 1;
+        if (str && sscanf(str, "%dx%d", &x, &y) == 2 && x > 0 && y > 0)
+        {
+            factor *= x * y;
+        }
+    }
+    return factor;
+}
+
+
+/**
+ * Reorder caps so that structures containing width x height come last.
+ * Negotiation tries structures from the end,
+ * that way the current resolution is kept when the height bands allow it.
+ * Takes ownership of caps, returns new caps.
+ */
+static GstCaps* gst_ic4_src_prefer_size(GstCaps* caps, int width, int height)
+{
+    GstCaps* other = gst_caps_new_empty();
+    GstCaps* matching = gst_caps_new_empty();
+
+    GValue w = G_VALUE_INIT;
+    GValue h = G_VALUE_INIT;
+    g_value_init(&w, G_TYPE_INT);
+    g_value_init(&h, G_TYPE_INT);
+    g_value_set_int(&w, width);
+    g_value_set_int(&h, height);
+
+    for (guint i = 0; i < gst_caps_get_size(caps); ++i)
+    {
+        const GstStructure* struc = gst_caps_get_structure(caps, i);
+        const GValue* sw = gst_structure_get_value(struc, "width");
+        const GValue* sh = gst_structure_get_value(struc, "height");
+
+        bool contains = (!sw || gst_value_can_intersect(sw, &w))
+                        && (!sh || gst_value_can_intersect(sh, &h));
+
+        gst_caps_append_structure(contains ? matching : other, gst_structure_copy(struc));
+    }
+
+    g_value_unset(&w);
+    g_value_unset(&h);
+    gst_caps_unref(caps);
+
+    gst_caps_append(other, matching);
+    return other;
+}
+
+
 static gboolean gst_ic4_src_negotiate(GstBaseSrc* basesrc)
 {
     GstIC4Src* self = (GstIC4Src*) basesrc;
@@ -212,6 +401,13 @@ static gboolean gst_ic4_src_negotiate(GstBaseSrc* basesrc)
     if (!gst_caps_is_empty(peercaps) && !gst_caps_is_any(peercaps))
     {
         GstCaps* tmp = gst_caps_intersect_full(src_caps, peercaps, GST_CAPS_INTERSECT_FIRST);
+
+        {
+            auto p = self->device->grabber->devicePropertyMap();
+            tmp = gst_ic4_src_prefer_size(tmp,
+                                          (int)p.getValueInt64(ic4::PropId::Width),
+                                          (int)p.getValueInt64(ic4::PropId::Height));
+        }
         //GST_DEBUG("tmp intersect: %" GST_PTR_FORMAT, static_cast<void*>(tmp));
         GstCaps* icaps = nullptr;
 
@@ -235,6 +431,20 @@ static gboolean gst_ic4_src_negotiate(GstBaseSrc* basesrc)
 
             GstStructure* struc =  gst_caps_get_structure(ipcaps, 0);
 
+            // binned/skipped modes are only used when the peer asks
+            // for a resolution the mode can deliver, otherwise keep the full sensor
+            if (gst_ic4_src_readout_factor(struc) > 1)
+            {
+                const GValue* w = gst_structure_get_value(struc, "width");
+                const GValue* h = gst_structure_get_value(struc, "height");
+
+                if (!w || !h || !gst_value_is_fixed(w) || !gst_value_is_fixed(h))
+                {
+                    gst_caps_unref(ipcaps);
+                    continue;
+                }
+            }
+
             if (gst_structure_get_field_type(struc, "width") == GST_TYPE_INT_RANGE)
             {
 
@@ -469,6 +679,270 @@ static GstCaps* gst_ic4_src_get_caps (GstBaseSrc* src,
 }
 
 
+/**
+ * Write the caps field, e.g. binning=2x2, to the given device properties.
+ * Caps without the field reset the device to 1x1.
+ */
+static bool gst_ic4_src_apply_readout_mode(ic4::PropertyMap& p,
+                                           const GstStructure* struc,
+                                           const char* field,
+                                           const char* horizontal,
+                                           const char* vertical)
+{
+    ic4::Error err;
+    auto p_x = p.findInteger(horizontal, err);
+    auto p_y = p.findInteger(vertical, err);
+
+    const char* str = gst_structure_get_string(struc, field);
+
+    if (!p_x.is_valid() || !p_y.is_valid())
+    {
+        if (str && strcmp(str, "1x1") != 0)
+        {
+            GST_ERROR("Device does not support %s %s", field, str);
+            return false;
+        }
+        return true;
+    }
+
+    int x = 1;
+    int y = 1;
+
+    if (str && (sscanf(str, "%dx%d", &x, &y) != 2 || x < 1 || y < 1))
+    {
+        GST_ERROR("Unable to interpret %s '%s'", field, str);
+        return false;
+    }
+
+    // ensure we are always in a defined state
+    if (p_x.getValue(err) != x && !p_x.setValue(x, err))
+    {
+        GST_ERROR("Unable to set %s: %s", horizontal, err.message().c_str());
+        return false;
+    }
+    if (p_y.getValue(err) != y && !p_y.setValue(y, err))
+    {
+        GST_ERROR("Unable to set %s: %s", vertical, err.message().c_str());
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * Device PixelFormat IC4 converts into sink_format,
+ * used when the caps do not contain a device-format.
+ * Returns PixelFormat::Invalid when no device format can be converted.
+ */
+static ic4::PixelFormat gst_ic4_src_select_device_format(ic4::PropertyMap& p,
+                                                         ic4::PixelFormat sink_format,
+                                                         GstIC4SrcDeviceFormatSelection selection)
+{
+    ic4::Error err;
+    auto current = ic4::PixelFormat((int32_t)p.getValueInt64(ic4::PropId::PixelFormat, err));
+
+    if (selection == GST_IC4_SRC_DEVICE_FORMAT_SELECTION_CURRENT)
+    {
+        return ic4::gst::can_convert(current, sink_format) ? current : ic4::PixelFormat::Invalid;
+    }
+
+    auto is_mono = [](ic4::PixelFormat f)
+    {
+        return ic4::to_string(f).find("Mono") != std::string::npos;
+    };
+
+    // same candidates create_caps lists as device-format
+    std::vector<ic4::PixelFormat> candidates;
+    for (const auto& f : p.findEnumeration("PixelFormat", err).entries(err))
+    {
+        auto pf = ic4::PixelFormat(f.intValue());
+        if (ic4::gst::get_bits_per_pixel(pf) > 0 && ic4::gst::can_convert(pf, sink_format))
+        {
+            candidates.push_back(pf);
+        }
+    }
+
+    // a mono device format would lose the colors
+    if (!is_mono(sink_format)
+        && std::any_of(candidates.begin(), candidates.end(), [&](auto f) { return !is_mono(f); }))
+    {
+        std::erase_if(candidates, is_mono);
+    }
+
+    if (candidates.empty())
+    {
+        return ic4::PixelFormat::Invalid;
+    }
+
+    int max_depth = 0;
+    for (auto f : candidates)
+    {
+        max_depth = std::max(max_depth, ic4::gst::get_bits_per_channel(f));
+    }
+
+    // wider device formats only when the sink format is able to hold the precision
+    int wanted_depth = max_depth;
+    if (selection == GST_IC4_SRC_DEVICE_FORMAT_SELECTION_BANDWIDTH)
+    {
+        wanted_depth = std::min(ic4::gst::get_bits_per_channel(sink_format), max_depth);
+    }
+
+    auto best = ic4::PixelFormat::Invalid;
+    int best_bpp = 0;
+
+    for (auto f : candidates)
+    {
+        const int bpp = ic4::gst::get_bits_per_pixel(f);
+
+        if (ic4::gst::get_bits_per_channel(f) < wanted_depth)
+        {
+            continue;
+        }
+
+        // on equal bandwidth keep the current format, that saves a device write
+        if (best == ic4::PixelFormat::Invalid || bpp < best_bpp
+            || (bpp == best_bpp && f == current))
+        {
+            best = f;
+            best_bpp = bpp;
+        }
+    }
+
+    GST_DEBUG("Selected device format %s for %s (%d bits per pixel)",
+              ic4::to_string(best).c_str(),
+              ic4::gst::get_pixel_format_name(sink_format).c_str(),
+              best_bpp);
+
+    return best;
+}
+
+
+static GstCaps* gst_ic4_src_caps_without_framerate(GstCaps* caps)
+{
+    GstCaps* ret = gst_caps_copy(caps);
+    gst_structure_remove_field(gst_caps_get_structure(ret, 0), "framerate");
+    return ret;
+}
+
+
+/**
+ * Change the framerate of the running stream without touching the sink.
+ * Devices that lock AcquisitionFrameRate during acquisition get a short
+ * acquisition stop, the stream and its buffers stay set up.
+ */
+static bool gst_ic4_src_set_framerate(GstIC4Src* self, ic4::PropertyMap& p, double fps)
+{
+    ic4::Error err;
+
+    if (!p.setValue(ic4::PropId::AcquisitionFrameRate, fps, err))
+    {
+        auto& grabber = *self->device->grabber;
+
+        if (!grabber.acquisitionStop(err))
+        {
+            GST_WARNING_OBJECT(self, "Unable to stop acquisition: %s", err.message().c_str());
+            return false;
+        }
+
+        bool set = p.setValue(ic4::PropId::AcquisitionFrameRate, fps, err);
+        if (!set)
+        {
+            GST_WARNING_OBJECT(self, "Unable to set AcquisitionFrameRate: %s", err.message().c_str());
+        }
+
+        if (!grabber.acquisitionStart(err))
+        {
+            GST_ERROR_OBJECT(self, "Unable to restart acquisition: %s", err.message().c_str());
+            return false;
+        }
+        if (!set)
+        {
+            return false;
+        }
+    }
+
+    GST_INFO_OBJECT(self, "Changed framerate to %f without restarting the stream", fps);
+
+    // inputs for the next automatic buffer count, the latency follows via property notification
+    self->device->stream_fps_ = fps;
+    return true;
+}
+
+
+/**
+ * Prepare the output buffers create converts frames into,
+ * unpacking or repacking device formats or with the striped converter.
+ * Clears the conversion state when create passes the QueueSink frames on.
+ */
+static bool gst_ic4_src_setup_conversion(GstIC4Src* self,
+                                         ic4_device_state& state,
+                                         ic4::gst::packing unpack,
+                                         ic4::PixelFormat repack_format,
+                                         ic4::PixelFormat convert_format,
+                                         GstCaps* caps,
+                                         int width,
+                                         int height)
+{
+    state.unpack_ = unpack;
+    state.repack_format_ = repack_format;
+    state.convert_format_ = convert_format;
+    state.set_convert_pool(nullptr);
+
+    if (!state.converts_frames())
+    {
+        return true;
+    }
+
+    if (convert_format != ic4::PixelFormat::Invalid
+        && (!state.converter_ || state.converter_->threads() != state.conversion_threads_
+            || state.converter_->cpus() != state.conversion_cpus_))
+    {
+        state.converter_ = std::make_unique<ic4::gst::striped_converter>(state.conversion_threads_,
+                                                                         state.conversion_cpus_);
+    }
+
+    // formats GstVideoInfo knows use the GStreamer default layout, bayer is unpadded
+    if (self->has_video_info)
+    {
+        state.convert_stride_ = GST_VIDEO_INFO_PLANE_STRIDE(&self->video_info, 0);
+    }
+    else if (unpack != ic4::gst::packing::none)
+    {
+        state.convert_stride_ = width * 2;
+    }
+    else
+    {
+        state.convert_stride_ = (width * ic4::gst::get_bits_per_pixel(convert_format) + 7) / 8;
+    }
+
+    if (repack_format != ic4::PixelFormat::Invalid)
+    {
+        state.repack_scratch_.resize(ic4::gst::repack_scratch_size(self->video_info));
+    }
+
+    // repacked formats may have more than one plane
+    const size_t size = self->has_video_info ? GST_VIDEO_INFO_SIZE(&self->video_info)
+                                             : state.convert_stride_ * height;
+
+    GstBufferPool* pool = gst_buffer_pool_new();
+    GstStructure* config = gst_buffer_pool_get_config(pool);
+    gst_buffer_pool_config_set_params(config, caps, (guint)size, 2, 0);
+
+    if (!gst_buffer_pool_set_config(pool, config) || !gst_buffer_pool_set_active(pool, TRUE))
+    {
+        GST_ERROR_OBJECT(self, "Unable to set up buffers for converted frames.");
+        gst_object_unref(pool);
+        state.unpack_ = ic4::gst::packing::none;
+        state.repack_format_ = ic4::PixelFormat::Invalid;
+        state.convert_format_ = ic4::PixelFormat::Invalid;
+        return false;
+    }
+
+    state.set_convert_pool(pool);
+    return true;
+}
+
+
 static gboolean gst_ic4_src_set_caps(GstBaseSrc* src, GstCaps* caps)
 {
     GstIC4Src *self = GST_IC4_SRC(src);
@@ -489,9 +963,33 @@ static gboolean gst_ic4_src_set_caps(GstBaseSrc* src, GstCaps* caps)
     gst_structure_get_fraction(struc, "framerate", &num, &denom);
 
     double fps = (double)num/denom;
+    self->fps = fps;
+
+    // bayer and the packed formats are unknown to GstVideoInfo,
+    // buffers of those formats are pushed without GstVideoMeta
+    self->has_video_info = gst_video_info_from_caps(&self->video_info, caps);
 
     auto p = self->device->grabber->devicePropertyMap();
 
+    if (self->device->grabber->isStreaming() && self->device->stream_caps_)
+    {
+        // everything but the framerate has to match the running stream
+        GstCaps* stream_caps = gst_ic4_src_caps_without_framerate(caps);
+        bool same_stream = gst_caps_is_equal(stream_caps, self->device->stream_caps_);
+        gst_caps_unref(stream_caps);
+
+        if (same_stream)
+        {
+            if (gst_ic4_src_set_framerate(self, p, fps))
+            {
+                return TRUE;
+            }
+            GST_INFO_OBJECT(self, "Unable to change the framerate in place, restarting the stream.");
+        }
+    }
+    // only valid again once the new stream is set up
+    self->device->set_stream_caps(nullptr);
+
     const ic4::PixelFormat fmt = ic4::gst::gst_caps_to_pixel_format(*caps);
 
     if (fmt == ic4::PixelFormat::Invalid)
@@ -500,43 +998,17 @@ static gboolean gst_ic4_src_set_caps(GstBaseSrc* src, GstCaps* caps)
         return FALSE;
     }
 
+    // readout modes change the Width/Height limits, they have to be applied first
+    if (!gst_ic4_src_apply_readout_mode(p, struc, "binning", "BinningHorizontal", "BinningVertical")
+        || !gst_ic4_src_apply_readout_mode(p, struc, "skipping", "DecimationHorizontal", "DecimationVertical"))
+    {
+        return FALSE;
+    }
+
     p.setValue("Width", width);
     p.setValue("Height", height);
     p.setValue("AcquisitionFrameRate", fps);
 
-    // if (gst_structure_has_field(struc, "binning"))
-    // {
-    //     std::string field_value = gst_structure_get_string(struc, "binning");
-
-    //     uint32_t to_fill_horizontal;
-    //     uint32_t to_fill_vertical;
-
-    //     const std::string delimiter = "x";
-    //     std::string token_horizontal = field_value.substr(0, field_value.find(delimiter));
-    //     std::string token_vertical = field_value.substr(field_value.find(delimiter) + 1);
-
-    //     try
-    //     {
-    //         to_fill_horizontal = std::atoi(token_horizontal.c_str());
-    //         to_fill_vertical = std::atoi(token_vertical.c_str());
-    //     }
-    //     catch (const std::exception& e)
-    //     {
-    //         GST_ERROR("Error while handling binning string '%s'", field_value.c_str());
-    //         to_fill_horizontal = 1;
-    //         to_fill_vertical = 1;
-    //     }
-    //     p.setValue("BinningHorizontal", to_fill_horizontal);
-    //     p.setValue("BinningVertical", to_fill_vertical);
-    // }
-    // else
-    // {
-    //     // ensure we are always in a defined state
-    //     p.setValue("BinningHorizontal", 1);
-    //     p.setValue("BinningVertical", 1);
-    // }
-
-
     ic4::QueueSinkListener& listener = *self->device->listener.get();
 
     PixelFormat sink_format = fmt;
@@ -610,21 +1082,21 @@ static gboolean gst_ic4_src_set_caps(GstBaseSrc* src, GstCaps* caps)
         {
             GST_INFO("Given caps are not in the device PixelFormat list. IC4 will attempt a conversion.");
 
-            auto dev_format = ic4::PixelFormat((int32_t)p.getValueInt64(ic4::PropId::PixelFormat));
-            auto transform_valid = ic4::canTransform(dev_format, sink_format);
+            auto dev_format = gst_ic4_src_select_device_format(p, sink_format, self->device_format_selection);
 
-            if (transform_valid)
+            if (dev_format != ic4::PixelFormat::Invalid)
             {
+                p.setValue("PixelFormat", ic4::to_string(dev_format));
+
                 GST_INFO("IC4 will convert from %s to %s",
                          ic4::to_string(dev_format).c_str(),
-                         ic4::to_string(sink_format).c_str());
+                         ic4::gst::get_pixel_format_name(sink_format).c_str());
             }
             else
             {
-                GST_ERROR("IC4 cannot transform from %s to %s. Please select "
+                GST_ERROR("IC4 cannot transform any device format to %s. Please select "
                           "different formats.",
-                          ic4::to_string(dev_format).c_str(),
-                          ic4::to_string(sink_format).c_str());
+                          ic4::gst::get_pixel_format_name(sink_format).c_str());
                 return FALSE;
             }
         }
@@ -635,31 +1107,178 @@ static gboolean gst_ic4_src_set_caps(GstBaseSrc* src, GstCaps* caps)
     }
 
             auto dev_format = ic4::PixelFormat((int32_t)p.getValueInt64(ic4::PropId::PixelFormat));
-            auto transform_valid = ic4::canTransform(dev_format, sink_format);
 
-            if (transform_valid)
+            // packed formats are taken as they are and unpacked in create
+            const auto unpack = ic4::gst::can_unpack(dev_format, sink_format)
+                                    ? ic4::gst::get_packing(dev_format)
+                                    : ic4::gst::packing::none;
+            // GStreamer formats IC4 does not know are repacked in create
+            const auto repack_format = ic4::gst::can_repack(dev_format, sink_format)
+                                           ? sink_format
+                                           : ic4::PixelFormat::Invalid;
+            auto transform_valid = unpack != ic4::gst::packing::none
+                                   || repack_format != ic4::PixelFormat::Invalid
+                                   || ic4::canTransform(dev_format, sink_format);
+
+            // with conversion-threads, create transforms single plane formats in stripes
+            const bool single_plane = !self->has_video_info
+                                      || GST_VIDEO_INFO_N_PLANES(&self->video_info) == 1;
+            const auto convert_format = unpack == ic4::gst::packing::none
+                                                && repack_format == ic4::PixelFormat::Invalid
+                                                && dev_format != sink_format && transform_valid
+                                                && self->device->conversion_threads_ > 0
+                                                && single_plane
+                                            ? sink_format
+                                            : ic4::PixelFormat::Invalid;
+
+            if (unpack != ic4::gst::packing::none)
+            {
+                GST_INFO("Unpacking %s to %s",
+                         ic4::to_string(dev_format).c_str(),
+                         ic4::gst::get_pixel_format_name(sink_format).c_str());
+            }
+            else if (repack_format != ic4::PixelFormat::Invalid)
+            {
+                GST_INFO("Repacking %s to %s",
+                         ic4::to_string(dev_format).c_str(),
+                         ic4::gst::get_pixel_format_name(sink_format).c_str());
+            }
+            else if (convert_format != ic4::PixelFormat::Invalid)
+            {
+                GST_INFO("Converting from %s to %s with %u threads",
+                         ic4::to_string(dev_format).c_str(),
+                         ic4::gst::get_pixel_format_name(sink_format).c_str(),
+                         self->device->conversion_threads_);
+            }
+            else if (transform_valid)
             {
                 GST_INFO("IC4 will convert from %s to %s",
                          ic4::to_string(dev_format).c_str(),
-                         ic4::to_string(sink_format).c_str());
+                         ic4::gst::get_pixel_format_name(sink_format).c_str());
             }
             else
             {
                 GST_ERROR("IC4 cannot transform from %s to %s. Please select "
                           "different formats.",
                           ic4::to_string(dev_format).c_str(),
-                          ic4::to_string(sink_format).c_str());
+                          ic4::gst::get_pixel_format_name(sink_format).c_str());
                 return FALSE;
             }
 
-    self->device->sink = ic4::QueueSink::create(listener, sink_format);
+    // create is not draining the ring while set_caps runs on the streaming thread
+    self->device->stop_stream();
+
+    // the new configuration may lack a framerate model,
+    // the device is reconfigured anyway, so calibrate now
+    self->device->ensure_fps_model();
+
+    if (!self->pool)
+    {
+        self->pool = gst_ic4_buffer_pool_new();
+    }
+
+    auto& state = *self->device;
+
+    // when create converts, the QueueSink delivers the device format
+    const PixelFormat queue_format = unpack != ic4::gst::packing::none
+                                             || repack_format != ic4::PixelFormat::Invalid
+                                             || convert_format != ic4::PixelFormat::Invalid
+                                         ? dev_format
+                                         : sink_format;
+
+    // inputs for the automatic buffer count
+    self->device->stream_fps_ = fps;
+    self->device->hold_time_ = gst_ic4_buffer_pool_get_hold_time(GST_IC4_BUFFER_POOL(self->pool));
+
+    const ic4::ImageType queue_type(queue_format, width, height);
+
+    // the buffers of the existing sink can hold frames up to sink_frame_size_.
+    // sinkConnected only adds buffers, a sink with more than needed is replaced
+    // so that lowering buffer-count or max-buffer-memory takes effect
+    const bool reuse_sink = state.sink
+                            && state.sink_format_ == queue_format
+                            && state.sink_allocation_mode_ == self->allocation_mode
+                            && ic4_device_state::frame_size(queue_type) <= state.sink_frame_size_
+                            && state.sink_buffer_count_ <= state.compute_buffer_count(queue_type)
+                            && (state.max_buffer_memory_ == 0
+                                || state.sink_buffer_count_ * state.sink_frame_size_
+                                       <= state.max_buffer_memory_);
+
+    if (!reuse_sink)
+    {
+        // the new sink comes with new buffers
+        gst_ic4_buffer_pool_flush(GST_IC4_BUFFER_POOL(self->pool));
+        state.release_sink();
+    }
+
+    if (!gst_buffer_pool_set_active(self->pool, TRUE))
+    {
+        GST_ERROR_OBJECT(self, "Unable to activate buffer pool.");
+        return FALSE;
+    }
+
+    if (reuse_sink)
+    {
+        GST_INFO_OBJECT(self, "Reusing QueueSink and its %zu buffers.", state.sink_buffer_count_);
+    }
+    else
+    {
+        std::shared_ptr<ic4::gst::memfd_allocator> allocator;
+        if (self->allocation_mode == GST_IC4_SRC_ALLOCATION_MODE_MEMFD)
+        {
+            allocator = std::make_shared<ic4::gst::memfd_allocator>();
+        }
+        gst_ic4_buffer_pool_set_memfd_allocator(GST_IC4_BUFFER_POOL(self->pool), allocator);
+
+        ic4::QueueSink::Config sink_config;
+        sink_config.acceptedPixelFormats = { queue_format };
+        sink_config.allocator = allocator;
+
+        ic4::Error err;
+        state.sink = ic4::QueueSink::create(listener, sink_config, err);
+
+        if (!state.sink)
+        {
+            GST_ERROR_OBJECT(self, "Unable to create QueueSink: %s", err.message().c_str());
+            return FALSE;
+        }
+        state.sink_format_ = queue_format;
+        state.sink_allocation_mode_ = self->allocation_mode;
+    }
+
+    if (!gst_ic4_src_setup_conversion(self,
+                                      state,
+                                      unpack,
+                                      repack_format,
+                                      convert_format,
+                                      caps,
+                                      width,
+                                      height))
+    {
+        return FALSE;
+    }
 
+    self->device->reset_timestamps();
+    self->device->reset_drop_accounting();
+    self->device->reset_counters();
+    self->device->latency_dirty_ = true;
     self->device->grabber->streamSetup(self->device->sink);
+    self->device->streaming_ = true;
+
+    GstCaps* stream_caps = gst_ic4_src_caps_without_framerate(caps);
+    self->device->set_stream_caps(stream_caps);
+    gst_caps_unref(stream_caps);
 
     return TRUE;
 }
 
 
+static gboolean gst_ic4_src_set_roi_offset(GstIC4Src* self, gint x, gint y)
+{
+    return self->device->set_roi_offset(x, y);
+}
+
+
 static GstStateChangeReturn
 gst_ic4_src_change_state(GstElement* element, GstStateChange change)
 {
@@ -707,10 +1326,12 @@ gst_ic4_src_change_state(GstElement* element, GstStateChange change)
         {
             //GST_INFO("paused->ready");
 
-            self->device->streaming_ = false;
-            if (self->device->grabber->isStreaming())
+            self->device->stop_stream();
+
+            if (self->pool)
             {
-                self->device->grabber->streamStop();
+                gst_ic4_buffer_pool_flush(GST_IC4_BUFFER_POOL(self->pool));
+                gst_buffer_pool_set_active(self->pool, FALSE);
             }
             break;
         }
@@ -733,75 +1354,575 @@ gst_ic4_src_change_state(GstElement* element, GstStateChange change)
     return ret;
 }
 
-struct destroy_transfer
+static gboolean gst_ic4_src_decide_allocation(GstBaseSrc* src, GstQuery* query)
 {
-    GstIC4Src* self;
-    std::shared_ptr<ic4::ImageBuffer> frame;
-};
+    GstIC4Src* self = GST_IC4_SRC(src);
 
+    // buffers come from our own pool,
+    // the query only tells us how downstream can deal with the ic4 memory layout
+    self->downstream_video_meta =
+        gst_query_find_allocation_meta(query, GST_VIDEO_META_API_TYPE, nullptr);
 
-static void buffer_destroy(gpointer data)
-{
-    destroy_transfer* trans = static_cast<destroy_transfer*>(data);
+    GST_DEBUG_OBJECT(self,
+                     "Downstream %s GstVideoMeta",
+                     self->downstream_video_meta ? "supports" : "does not support");
 
-    delete trans;
+    return GST_BASE_SRC_CLASS(gst_ic4_src_parent_class)->decide_allocation(src, query);
 }
 
 
-static GstFlowReturn gst_ic4_src_create(GstPushSrc* push_src, GstBuffer** buffer)
+/**
+ * Compute the plane layout of an ic4 buffer with the given pitch.
+ * Planes of subsampled formats keep their size ratio to the first plane.
+ * Returns true when the layout differs from the GStreamer default.
+ */
+static bool gst_ic4_src_get_plane_layout(const GstVideoInfo& info,
+                                         size_t pitch,
+                                         gsize offset[GST_VIDEO_MAX_PLANES],
+                                         gint stride[GST_VIDEO_MAX_PLANES])
 {
+    const guint n_planes = GST_VIDEO_INFO_N_PLANES(&info);
+    const gint default_stride = GST_VIDEO_INFO_PLANE_STRIDE(&info, 0);
 
-    GstIC4Src* self = GST_IC4_SRC(push_src);
+    bool padded = false;
+    gsize plane_offset = 0;
 
-    int cnt = 0;
-    int cnt_max = 10;
+    for (guint i = 0; i < n_planes; ++i)
+    {
+        const gint plane_default_stride = GST_VIDEO_INFO_PLANE_STRIDE(&info, i);
 
-get_buf:
-    std::unique_lock<std::mutex> lck(self->device->stream_mtx_);
+        stride[i] = (gint)((gint64)plane_default_stride * (gint64)pitch / default_stride);
+        offset[i] = plane_offset;
 
-    self->device->stream_cv_.wait(lck);
+        // number of lines in this plane, derived from the default layout
+        gsize plane_end = i + 1 < n_planes ? GST_VIDEO_INFO_PLANE_OFFSET(&info, i + 1)
+                                           : GST_VIDEO_INFO_SIZE(&info);
+        gsize lines = (plane_end - GST_VIDEO_INFO_PLANE_OFFSET(&info, i)) / plane_default_stride;
 
-    if (!self->device->is_streaming())
-    {
+        plane_offset += lines * stride[i];
+
+        if (stride[i] != plane_default_stride
+            || offset[i] != GST_VIDEO_INFO_PLANE_OFFSET(&info, i))
+        {
+            padded = true;
+        }
+    }
+    return padded;
+}
+
+
+/**
+ * Copy a padded frame into a buffer with the GStreamer default layout.
+ * Used when downstream cannot interpret GstVideoMeta.
+ */
+static GstBuffer* gst_ic4_src_copy_frame(const GstVideoInfo& info,
+                                         const ic4::ImageBuffer& frame,
+                                         const gsize offset[GST_VIDEO_MAX_PLANES],
+                                         const gint stride[GST_VIDEO_MAX_PLANES])
+{
+    GstBuffer* buffer = gst_buffer_new_allocate(nullptr, GST_VIDEO_INFO_SIZE(&info), nullptr);
+
+    if (!buffer)
+    {
+        return nullptr;
+    }
+
+    GstMapInfo map;
+    if (!gst_buffer_map(buffer, &map, GST_MAP_WRITE))
+    {
+        gst_buffer_unref(buffer);
+        return nullptr;
+    }
+
+    const auto* src = static_cast<const guint8*>(frame.ptr());
+    const guint n_planes = GST_VIDEO_INFO_N_PLANES(&info);
+
+    for (guint i = 0; i < n_planes; ++i)
+    {
+        const gint dst_stride = GST_VIDEO_INFO_PLANE_STRIDE(&info, i);
+        const gsize dst_offset = GST_VIDEO_INFO_PLANE_OFFSET(&info, i);
+
+        gsize plane_end = i + 1 < n_planes ? GST_VIDEO_INFO_PLANE_OFFSET(&info, i + 1)
+                                           : GST_VIDEO_INFO_SIZE(&info);
+        gsize lines = (plane_end - dst_offset) / dst_stride;
+        gsize line_size = std::min(dst_stride, stride[i]);
+
+        for (gsize line = 0; line < lines; ++line)
+        {
+            if (offset[i] + line * stride[i] + line_size > frame.bufferSize())
+            {
+                break;
+            }
+            memcpy(map.data + dst_offset + line * dst_stride,
+                   src + offset[i] + line * stride[i],
+                   line_size);
+        }
+    }
+
+    gst_buffer_unmap(buffer, &map);
+    return buffer;
+}
+
+
+/**
+ * Unpack a frame of a packed device format into a buffer of the negotiated 16 bit format.
+ */
+static GstBuffer* gst_ic4_src_unpack_frame(ic4_device_state& state, const ic4::ImageBuffer& frame)
+{
+    GstBuffer* buffer = nullptr;
+
+    if (gst_buffer_pool_acquire_buffer(state.convert_pool_, &buffer, nullptr) != GST_FLOW_OK)
+    {
+        return nullptr;
+    }
+
+    GstMapInfo map;
+    if (!gst_buffer_map(buffer, &map, GST_MAP_WRITE))
+    {
+        gst_buffer_unref(buffer);
+        return nullptr;
+    }
+
+    const auto* src = static_cast<const guint8*>(frame.ptr());
+    const size_t width = frame.imageType().width();
+    const size_t pitch = frame.pitch();
+    const size_t line_size = ic4::gst::packed_line_size(state.unpack_, width);
+    const size_t lines = std::min<size_t>(frame.imageType().height(),
+                                          map.size / state.convert_stride_);
+
+    for (size_t line = 0; line < lines; ++line)
+    {
+        if (line * pitch + line_size > frame.bufferSize())
+        {
+            break;
+        }
+        ic4::gst::unpack_line(state.unpack_,
+                              src + line * pitch,
+                              reinterpret_cast<uint16_t*>(map.data + line * state.convert_stride_),
+                              width);
+    }
+
+    gst_buffer_unmap(buffer, &map);
+    return buffer;
+}
+
+
+/**
+ * Repack a frame of the device format into a buffer of the negotiated GStreamer format,
+ * planes are placed in the default layout.
+ */
+static GstBuffer* gst_ic4_src_repack_frame(GstIC4Src* self, const ic4::ImageBuffer& frame)
+{
+    GstBuffer* buffer = nullptr;
+
+    if (gst_buffer_pool_acquire_buffer(self->device->convert_pool_, &buffer, nullptr) != GST_FLOW_OK)
+    {
+        return nullptr;
+    }
+
+    GstMapInfo map;
+    if (!gst_buffer_map(buffer, &map, GST_MAP_WRITE))
+    {
+        gst_buffer_unref(buffer);
+        return nullptr;
+    }
+
+    const auto& type = frame.imageType();
+
+    // only read, the view requires a mutable pointer
+    ic4::gst::image_view src = {
+        static_cast<uint8_t*>(const_cast<void*>(frame.ptr())), frame.pitch(), type.pixelFormat(),
+        type.width(), type.height(),
+    };
+
+    bool ok = map.size >= GST_VIDEO_INFO_SIZE(&self->video_info)
+              && frame.bufferSize() >= src.pitch * src.height
+              && ic4::gst::repack_frame(src,
+                                        self->video_info,
+                                        map.data,
+                                        self->device->repack_scratch_);
+
+    gst_buffer_unmap(buffer, &map);
+
+    if (!ok)
+    {
+        gst_buffer_unref(buffer);
+        return nullptr;
+    }
+    return buffer;
+}
+
+
+/**
+ * Transform a frame of the device format into a buffer of the negotiated format
+ * with the striped converter.
+ */
+static GstBuffer* gst_ic4_src_convert_frame(GstIC4Src* self,
+                                            ic4_device_state& state,
+                                            const ic4::ImageBuffer& frame)
+{
+    GstBuffer* buffer = nullptr;
+
+    if (gst_buffer_pool_acquire_buffer(state.convert_pool_, &buffer, nullptr) != GST_FLOW_OK)
+    {
+        return nullptr;
+    }
+
+    GstMapInfo map;
+    if (!gst_buffer_map(buffer, &map, GST_MAP_WRITE))
+    {
+        gst_buffer_unref(buffer);
+        return nullptr;
+    }
+
+    const auto& type = frame.imageType();
+
+    // ic4 only reads from the source, the view requires a mutable pointer
+    ic4::gst::image_view src = {
+        static_cast<uint8_t*>(const_cast<void*>(frame.ptr())), frame.pitch(), type.pixelFormat(),
+        type.width(), type.height(),
+    };
+    ic4::gst::image_view dst = {
+        map.data, state.convert_stride_, state.convert_format_, type.width(), type.height(),
+    };
+
+    std::string message;
+    bool ok = dst.pitch * dst.height <= map.size && state.converter_->convert(src, dst, message);
+
+    gst_buffer_unmap(buffer, &map);
+
+    if (!ok)
+    {
+        GST_ERROR_OBJECT(self,
+                         "Unable to convert %s to %s: %s",
+                         ic4::to_string(src.format).c_str(),
+                         ic4::to_string(dst.format).c_str(),
+                         message.c_str());
+        gst_buffer_unref(buffer);
+        return nullptr;
+    }
+    return buffer;
+}
+
+
+/**
+ * Inform the application about lost frames.
+ * Posts at most one message per second, the counters are cumulative.
+ */
+static void gst_ic4_src_post_drop_message(GstIC4Src* self)
+{
+    auto& drops = self->device->drops_;
+
+    GstClockTime now = gst_util_get_timestamp();
+
+    if (drops.last_message != 0 && now - drops.last_message < GST_SECOND)
+    {
+        return;
+    }
+
+    GST_WARNING_OBJECT(self,
+                       "%" G_GUINT64_FORMAT " frames dropped since the last report. "
+                       "Total: %" G_GUINT64_FORMAT,
+                       drops.frames_dropped - drops.reported_dropped,
+                       drops.frames_dropped);
+
+    GstStructure* struc = gst_structure_new("ic4src-frames-dropped",
+                                            "frames_dropped",
+                                            G_TYPE_UINT64,
+                                            drops.frames_dropped,
+                                            "frames_dropped_since_last_report",
+                                            G_TYPE_UINT64,
+                                            drops.frames_dropped - drops.reported_dropped,
+                                            "device_underruns",
+                                            G_TYPE_UINT64,
+                                            drops.stream_stats.device_underrun,
+                                            "transmission_errors",
+                                            G_TYPE_UINT64,
+                                            drops.stream_stats.device_transmission_error,
+                                            "transform_underruns",
+                                            G_TYPE_UINT64,
+                                            drops.stream_stats.transform_underrun,
+                                            "sink_underruns",
+                                            G_TYPE_UINT64,
+                                            drops.stream_stats.sink_underrun,
+                                            nullptr);
+
+    gst_element_post_message(GST_ELEMENT(self),
+                             gst_message_new_element(GST_OBJECT(self), struc));
+
+    drops.last_message = now;
+    drops.reported_dropped = drops.frames_dropped;
+}
+
+
+/**
+ * Convert the arrival time of a frame to running time and
+ * apply the configured timestamp-mode.
+ *
+ * arrival is a gst_util_get_timestamp() value,
+ * device_ns the device timestamp or 0 if the device does not provide one.
+ * running_now receives the current running time.
+ */
+static GstClockTime gst_ic4_src_get_timestamp(GstIC4Src* self,
+                                              GstClockTime arrival,
+                                              uint64_t device_ns,
+                                              GstClockTime& running_now)
+{
+    running_now = GST_CLOCK_TIME_NONE;
+
+    GstClock* clock = gst_element_get_clock(GST_ELEMENT(self));
+
+    if (!clock)
+    {
+        return GST_CLOCK_TIME_NONE;
+    }
+
+    GstClockTime clock_now = gst_clock_get_time(clock);
+    GstClockTime base_time = gst_element_get_base_time(GST_ELEMENT(self));
+    gst_object_unref(clock);
+
+    if (clock_now > base_time)
+    {
+        running_now = clock_now - base_time;
+    }
+
+    // time the frame has been waiting since framesQueued
+    GstClockTime waited = gst_util_get_timestamp() - arrival;
+
+    GstClockTime arrival_running = 0;
+    if (clock_now > base_time + waited)
+    {
+        arrival_running = clock_now - base_time - waited;
+    }
+
+    auto& state = *self->device;
+
+    if (state.ts_reset_pending_.exchange(false))
+    {
+        state.reset_timestamps();
+    }
+
+    if (device_ns == 0 || self->timestamp_mode == GST_IC4_SRC_TIMESTAMP_MODE_ARRIVAL)
+    {
+        return arrival_running;
+    }
+
+    if (self->timestamp_mode == GST_IC4_SRC_TIMESTAMP_MODE_DEVICE)
+    {
+        if (!GST_CLOCK_TIME_IS_VALID(state.ts_first_running_) || device_ns < state.ts_first_device_)
+        {
+            // first frame or device clock reset, re-anchor
+            state.ts_first_running_ = arrival_running;
+            state.ts_first_device_ = device_ns;
+        }
+        return state.ts_first_running_ + (device_ns - state.ts_first_device_);
+    }
+
+    return state.ts_estimator_.update(device_ns, arrival_running);
+}
+
+
+static GstFlowReturn gst_ic4_src_create(GstPushSrc* push_src, GstBuffer** buffer)
+{
+
+    GstIC4Src* self = GST_IC4_SRC(push_src);
+
+    self->device->stats_create_begin();
+
+    auto frame = self->device->wait_for_frame();
+
+    if (!frame.buffer)
+    {
+        if (self->device->is_flushing())
+        {
+            return GST_FLOW_FLUSHING;
+        }
         return GST_FLOW_EOS;
     }
 
+    self->device->stats_frame_ready();
+
     ic4::Error err;
-    auto frame = self->device->sink->popOutputBuffer(err);
 
-    if (!frame)
+    // read before the frame is handed to the pool
+    ic4::ImageBuffer::MetaData meta_data = frame.buffer->metaData(err);
+    bool has_meta_data = err.isSuccess();
+
+    GstClockTime running_now = GST_CLOCK_TIME_NONE;
+    GstClockTime pts = gst_ic4_src_get_timestamp(self,
+                                                 frame.arrival,
+                                                 has_meta_data ? meta_data.device_timestamp_ns : 0,
+                                                 running_now);
+
+    if (GST_CLOCK_TIME_IS_VALID(pts) && GST_CLOCK_TIME_IS_VALID(running_now) && running_now > pts)
     {
-        GST_ERROR("Unable to retrieve buffer: %s", err.message().c_str());
+        self->device->update_transfer_time(running_now - pts);
+    }
 
-        if (cnt >= cnt_max)
+    if (has_meta_data && self->device->account_frame(meta_data.device_frame_number))
+    {
+        gst_ic4_src_post_drop_message(self);
+    }
+
+    ic4_device_state::roi_change roi;
+    if (self->device->roi_change_applied(has_meta_data ? meta_data.device_timestamp_ns : 0,
+                                         frame.arrival,
+                                         roi))
+    {
+        gst_element_post_message(
+            GST_ELEMENT(self),
+            gst_message_new_element(GST_OBJECT(self),
+                                    gst_structure_new("ic4src-roi-changed",
+                                                      "offset-x", G_TYPE_INT64, roi.offset_x,
+                                                      "offset-y", G_TYPE_INT64, roi.offset_y,
+                                                      "frame-number", G_TYPE_UINT64,
+                                                      has_meta_data ? meta_data.device_frame_number : 0,
+                                                      "pts", G_TYPE_UINT64, pts,
+                                                      nullptr)));
+    }
+
+    if (self->stats_interval > 0
+        && self->device->stats_post_due(self->stats_interval * GST_MSECOND))
+    {
+        gst_element_post_message(
+            GST_ELEMENT(self),
+            gst_message_new_element(GST_OBJECT(self), self->device->build_statistics()));
+    }
+
+    if (self->device->latency_changed())
+    {
+        // the bin will query us for the new values
+        gst_element_post_message(GST_ELEMENT(self), gst_message_new_latency(GST_OBJECT(self)));
+    }
+
+    gsize plane_offset[GST_VIDEO_MAX_PLANES] = {};
+    gint plane_stride[GST_VIDEO_MAX_PLANES] = {};
+    bool padded = false;
+
+    const bool convert = self->device->converts_frames();
+
+    // converted frames are written in the default layout
+    if (self->has_video_info && !convert)
+    {
+        padded = gst_ic4_src_get_plane_layout(self->video_info,
+                                              frame.buffer->pitch(),
+                                              plane_offset,
+                                              plane_stride);
+    }
+
+    // a reused QueueSink may hold buffers larger than the current frames
+    gsize payload = 0;
+    if (!self->has_video_info || GST_VIDEO_INFO_N_PLANES(&self->video_info) == 1)
+    {
+        payload = frame.buffer->pitch() * frame.buffer->imageType().height();
+    }
+
+    GstBuffer* new_buf = nullptr;
+
+    if (convert)
+    {
+        if (self->device->unpack_ != ic4::gst::packing::none)
         {
+            new_buf = gst_ic4_src_unpack_frame(*self->device, *frame.buffer);
+        }
+        else if (self->device->repack_format_ != ic4::PixelFormat::Invalid)
+        {
+            new_buf = gst_ic4_src_repack_frame(self, *frame.buffer);
+        }
+        else
+        {
+            new_buf = gst_ic4_src_convert_frame(self, *self->device, *frame.buffer);
+        }
+        // the device frame is no longer needed, ic4 can refill it right away
+        frame.buffer.reset();
 
-            //return GST_FLOW_ERROR;
+        if (!new_buf)
+        {
+            GST_ERROR_OBJECT(self, "Unable to convert frame.");
+            return GST_FLOW_ERROR;
         }
-        cnt++;
-        goto get_buf;
     }
-    cnt = 0;
+    else if (padded && !self->downstream_video_meta)
+    {
+        // downstream would assume the default layout, copy the lines into place
+        new_buf = gst_ic4_src_copy_frame(self->video_info,
+                                         *frame.buffer,
+                                         plane_offset,
+                                         plane_stride);
+        frame.buffer.reset();
+
+        if (!new_buf)
+        {
+            GST_ERROR_OBJECT(self, "Unable to copy padded frame.");
+            return GST_FLOW_ERROR;
+        }
+    }
+    else
+    {
+        // the pool binds the payload size with the buffer,
+        // resizing here would allocate a sub-memory for every frame
+        GstFlowReturn ret = gst_ic4_buffer_pool_acquire_frame(GST_IC4_BUFFER_POOL(self->pool),
+                                                              std::move(frame.buffer),
+                                                              payload,
+                                                              &new_buf);
+        if (ret != GST_FLOW_OK)
+        {
+            return ret;
+        }
 
-    destroy_transfer* trans = new destroy_transfer;
-    trans->self = self;
-    trans->frame = frame;
+        if (self->has_video_info)
+        {
+            // pooled like the buffer, only the layout is updated for reused buffers
+            GstVideoMeta* vmeta = gst_buffer_get_video_meta(new_buf);
 
-    GstBuffer* new_buf =
-        gst_buffer_new_wrapped_full(static_cast<GstMemoryFlags>(GST_MEMORY_FLAG_READONLY),
-                                    frame->ptr(),
-                                    frame->bufferSize(),
-                                    0,
-                                    frame->bufferSize(),
-                                    trans,
-                                    buffer_destroy);
+            if (vmeta && vmeta->format == GST_VIDEO_INFO_FORMAT(&self->video_info)
+                && vmeta->width == (guint)GST_VIDEO_INFO_WIDTH(&self->video_info)
+                && vmeta->height == (guint)GST_VIDEO_INFO_HEIGHT(&self->video_info))
+            {
+                for (guint i = 0; i < vmeta->n_planes; ++i)
+                {
+                    vmeta->offset[i] = plane_offset[i];
+                    vmeta->stride[i] = plane_stride[i];
+                }
+            }
+            else
+            {
+                if (vmeta)
+                {
+                    gst_buffer_remove_meta(new_buf, GST_META_CAST(vmeta));
+                }
+                vmeta = gst_buffer_add_video_meta_full(new_buf,
+                                                       GST_VIDEO_FRAME_FLAG_NONE,
+                                                       GST_VIDEO_INFO_FORMAT(&self->video_info),
+                                                       GST_VIDEO_INFO_WIDTH(&self->video_info),
+                                                       GST_VIDEO_INFO_HEIGHT(&self->video_info),
+                                                       GST_VIDEO_INFO_N_PLANES(&self->video_info),
+                                                       plane_offset,
+                                                       plane_stride);
+                GST_META_FLAG_SET(vmeta, GST_META_FLAG_POOLED);
+            }
+        }
+    }
 
 #ifdef ENABLE_TCAM_STATS
 
-    ic4::ImageBuffer::MetaData meta_data = frame->metaData(err);
-    if (err.isSuccess())
+    if (has_meta_data)
     {
-        GstStructure* struc = gst_structure_new_empty("TcamStatistics");
+        // the meta is pooled together with the buffer,
+        // update the existing structure instead of allocating a new one
+        TcamStatisticsMeta* meta = gst_buffer_get_tcam_statistics_meta(new_buf);
+        GstStructure* struc = nullptr;
+
+        if (meta)
+        {
+            struc = meta->structure;
+        }
+        else
+        {
+            struc = gst_structure_new_empty("TcamStatistics");
+        }
+
+        const auto& drops = self->device->drops_;
 
         gst_structure_set(struc,
                           "frame_count",
@@ -809,7 +1930,7 @@ get_buf:
                           meta_data.device_frame_number,
                           "frames_dropped",
                           G_TYPE_UINT64,
-                          0, // potentially implementable
+                          drops.frames_dropped,
                           "capture_time_ns",
                           G_TYPE_UINT64,
                           0, // driver time not supported by gentl
@@ -818,23 +1939,108 @@ get_buf:
                           meta_data.device_timestamp_ns,
                           "is_damaged",
                           G_TYPE_BOOLEAN,
-                          FALSE, // seen as not supported, at this time
+                          drops.is_damaged,
+                          "frame_gap",
+                          G_TYPE_UINT64,
+                          drops.frame_gap,
+                          "device_underruns",
+                          G_TYPE_UINT64,
+                          drops.stream_stats.device_underrun,
+                          "transmission_errors",
+                          G_TYPE_UINT64,
+                          drops.stream_stats.device_transmission_error,
+                          "transform_underruns",
+                          G_TYPE_UINT64,
+                          drops.stream_stats.transform_underrun,
+                          "sink_underruns",
+                          G_TYPE_UINT64,
+                          drops.stream_stats.sink_underrun,
+                          "policy_drops",
+                          G_TYPE_UINT64,
+                          self->device->policy_drops_.load(),
                           nullptr);
 
-        gst_buffer_add_tcam_statistics_meta(new_buf, struc);
+        if (!meta)
+        {
+            meta = gst_buffer_add_tcam_statistics_meta(new_buf, struc);
+            GST_META_FLAG_SET(meta, GST_META_FLAG_POOLED);
+        }
     }
 
 #endif
 
+    GST_BUFFER_PTS(new_buf) = pts;
+    GST_BUFFER_DTS(new_buf) = pts;
+    if (self->fps > 0.0)
+    {
+        GST_BUFFER_DURATION(new_buf) = (GstClockTime)(GST_SECOND / self->fps);
+    }
+
     *buffer = new_buf;
     gst_buffer_set_flags(*buffer, GST_BUFFER_FLAG_LIVE);
 
+    self->device->stats_create_end();
+
     //GST_INFO("Create func end");
 
     return GST_FLOW_OK;
 }
 
 
+static gboolean gst_ic4_src_query(GstBaseSrc* src, GstQuery* query)
+{
+    GstIC4Src* self = GST_IC4_SRC(src);
+
+    switch (GST_QUERY_TYPE(query))
+    {
+        case GST_QUERY_LATENCY:
+        {
+            GstClockTime min_latency = 0;
+            GstClockTime max_latency = 0;
+
+            if (!self->device->is_streaming()
+                || !self->device->get_latency(min_latency, max_latency))
+            {
+                GST_DEBUG_OBJECT(self, "Device not streaming, unable to report latency");
+                return FALSE;
+            }
+
+            GST_DEBUG_OBJECT(self,
+                             "Reporting latency min %" GST_TIME_FORMAT " max %" GST_TIME_FORMAT,
+                             GST_TIME_ARGS(min_latency),
+                             GST_TIME_ARGS(max_latency));
+
+            gst_query_set_latency(query, TRUE, min_latency, max_latency);
+            return TRUE;
+        }
+        default:
+        {
+            return GST_BASE_SRC_CLASS(gst_ic4_src_parent_class)->query(src, query);
+        }
+    }
+}
+
+
+static gboolean gst_ic4_src_unlock(GstBaseSrc* src)
+{
+    GstIC4Src* self = GST_IC4_SRC(src);
+
+    self->device->set_flushing(true);
+
+    return TRUE;
+}
+
+
+static gboolean gst_ic4_src_unlock_stop(GstBaseSrc* src)
+{
+    GstIC4Src* self = GST_IC4_SRC(src);
+
+    self->device->set_flushing(false);
+
+    return TRUE;
+}
+
+
 bool is_gst_state_equal_or_greater(GstElement* self, GstState state) noexcept
 {
     GstState cur_state = GST_STATE_NULL;
@@ -924,6 +2130,99 @@ static void gst_ic4_src_set_property(GObject* object,
             self->device->set_properties_from_string(string_value);
             break;
         }
+        case PROP_TIMESTAMP_MODE:
+        {
+            self->timestamp_mode = static_cast<GstIC4SrcTimestampMode>(g_value_get_enum(value));
+            // create owns the timestamp state
+            self->device->ts_reset_pending_ = true;
+            break;
+        }
+        case PROP_BUFFER_COUNT:
+        {
+            // applied with the next stream start
+            self->device->buffer_count_ = g_value_get_uint(value);
+            break;
+        }
+        case PROP_MAX_BUFFER_MEMORY:
+        {
+            self->device->max_buffer_memory_ = g_value_get_uint64(value);
+            break;
+        }
+        case PROP_STATS_INTERVAL:
+        {
+            self->stats_interval = g_value_get_uint(value);
+            break;
+        }
+        case PROP_CAPS_CACHE:
+        {
+            self->device->caps_cache_enabled_ = g_value_get_boolean(value);
+            break;
+        }
+        case PROP_ALLOCATION_MODE:
+        {
+            self->allocation_mode =
+                static_cast<GstIC4SrcAllocationMode>(g_value_get_enum(value));
+            break;
+        }
+        case PROP_DROP_POLICY:
+        {
+            self->device->drop_policy_ =
+                static_cast<GstIC4SrcDropPolicy>(g_value_get_enum(value));
+            // release a framesQueued that waits in block mode
+            self->device->notify_stream();
+            break;
+        }
+        case PROP_DEVICE_FORMAT_SELECTION:
+        {
+            self->device_format_selection =
+                static_cast<GstIC4SrcDeviceFormatSelection>(g_value_get_enum(value));
+            break;
+        }
+        case PROP_CONVERSION_THREADS:
+        {
+            // applied with the next stream start
+            self->device->conversion_threads_ = g_value_get_uint(value);
+            break;
+        }
+        case PROP_CPU_AFFINITY:
+        {
+            const char* str = g_value_get_string(value);
+            auto cpus = ic4::gst::parse_cpu_list(str ? str : "");
+            if (!cpus)
+            {
+                GST_ERROR_OBJECT(self,
+                                 "Invalid cpu-affinity \"%s\", expected a list like \"0,2,4-7\".",
+                                 str);
+                break;
+            }
+            self->device->cpu_affinity_ = str ? str : "";
+            self->device->conversion_cpus_ = std::move(*cpus);
+            break;
+        }
+        case PROP_ROI_OFFSET_X:
+        case PROP_ROI_OFFSET_Y:
+        {
+            if (!self->device->is_open())
+            {
+                GST_ERROR_OBJECT(self, "No device open. Unable to set ROI offset.");
+                break;
+            }
+            auto props = self->device->grabber->devicePropertyMap();
+            ic4::Error err;
+            int64_t x = props.getValueInt64(ic4::PropId::OffsetX, err);
+            int64_t y = props.getValueInt64(ic4::PropId::OffsetY, err);
+
+            if (prop_id == PROP_ROI_OFFSET_X)
+            {
+                x = g_value_get_int(value);
+            }
+            else
+            {
+                y = g_value_get_int(value);
+            }
+            self->device->set_roi_offset(x, y);
+            break;
+        }
         default: {
             G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
             break;
@@ -955,6 +2254,90 @@ static void gst_ic4_src_get_property(GObject* object,
             g_value_set_string(value, "ic4");
             break;
         }
+        case PROP_BUFFER_BINDINGS:
+        {
+            guint64 count = 0;
+            if (self->pool)
+            {
+                count = gst_ic4_buffer_pool_get_binding_count(GST_IC4_BUFFER_POOL(self->pool));
+            }
+            g_value_set_uint64(value, count);
+            break;
+        }
+        case PROP_TIMESTAMP_MODE:
+        {
+            g_value_set_enum(value, self->timestamp_mode);
+            break;
+        }
+        case PROP_BUFFER_COUNT:
+        {
+            g_value_set_uint(value, self->device->buffer_count_);
+            break;
+        }
+        case PROP_MAX_BUFFER_MEMORY:
+        {
+            g_value_set_uint64(value, self->device->max_buffer_memory_);
+            break;
+        }
+        case PROP_STATISTICS:
+        {
+            g_value_take_boxed(value, self->device->build_statistics());
+            break;
+        }
+        case PROP_STATS_INTERVAL:
+        {
+            g_value_set_uint(value, self->stats_interval);
+            break;
+        }
+        case PROP_DROP_POLICY:
+        {
+            g_value_set_enum(value, self->device->drop_policy_);
+            break;
+        }
+        case PROP_ALLOCATION_MODE:
+        {
+            g_value_set_enum(value, self->allocation_mode);
+            break;
+        }
+        case PROP_CAPS_CACHE:
+        {
+            g_value_set_boolean(value, self->device->caps_cache_enabled_);
+            break;
+        }
+        case PROP_DEVICE_FORMAT_SELECTION:
+        {
+            g_value_set_enum(value, self->device_format_selection);
+            break;
+        }
+        case PROP_CONVERSION_THREADS:
+        {
+            g_value_set_uint(value, self->device->conversion_threads_);
+            break;
+        }
+        case PROP_CPU_AFFINITY:
+        {
+            g_value_set_string(value, self->device->cpu_affinity_.c_str());
+            break;
+        }
+        case PROP_ROI_OFFSET_X:
+        case PROP_ROI_OFFSET_Y:
+        {
+            gint64 val = -1;
+            if (self->device->is_open())
+            {
+                auto props = self->device->grabber->devicePropertyMap();
+                ic4::Error err;
+                val = props.getValueInt64(prop_id == PROP_ROI_OFFSET_X ? ic4::PropId::OffsetX
+                                                                       : ic4::PropId::OffsetY,
+                                          err);
+                if (err.isError())
+                {
+                    val = -1;
+                }
+            }
+            g_value_set_int(value, (gint)val);
+            break;
+        }
         default:
         {
             G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
@@ -971,6 +2354,8 @@ static void gst_ic4_src_init(GstIC4Src* self)
     ic4::initLibrary();
 
     self->device = new ic4_device_state();
+    self->timestamp_mode = GST_IC4_SRC_TIMESTAMP_MODE_SMOOTHED;
+    self->device_format_selection = GST_IC4_SRC_DEVICE_FORMAT_SELECTION_BANDWIDTH;
 }
 
 static void gst_ic4_src_finalize(GObject *object)
@@ -984,6 +2369,12 @@ static void gst_ic4_src_finalize(GObject *object)
         self->device = nullptr;
     }
 
+    if (self->pool)
+    {
+        gst_object_unref(self->pool);
+        self->pool = nullptr;
+    }
+
     ic4::exitLibrary();
 }
 
@@ -1026,6 +2417,133 @@ static void gst_ic4_src_class_init(GstIC4SrcClass *klass)
                                     static_cast<GParamFlags>(G_PARAM_WRITABLE |
                                                              G_PARAM_STATIC_STRINGS)));
 
+    g_object_class_install_property(
+        gobject_class,
+        PROP_BUFFER_BINDINGS,
+        g_param_spec_uint64("buffer-bindings",
+                            "Buffer bindings",
+                            "Number of GstBuffers and GstMemorys created to wrap ic4 image "
+                            "buffers. Stays constant once every ic4 buffer has been delivered "
+                            "once and the frame size does not change. "
+                            "Copied and converted frames are not counted.",
+                            0,
+                            G_MAXUINT64,
+                            0,
+                            static_cast<GParamFlags>(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property(
+        gobject_class,
+        PROP_TIMESTAMP_MODE,
+        g_param_spec_enum("timestamp-mode",
+                          "Timestamp mode",
+                          "Source of the buffer PTS/DTS",
+                          GST_TYPE_IC4_SRC_TIMESTAMP_MODE,
+                          GST_IC4_SRC_TIMESTAMP_MODE_SMOOTHED,
+                          static_cast<GParamFlags>(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property(
+        gobject_class,
+        PROP_BUFFER_COUNT,
+        g_param_spec_uint("buffer-count",
+                          "Buffer count",
+                          "Number of buffers IC4 allocates for the stream. "
+                          "0 selects the count from framerate and downstream hold time. "
+                          "Applied with the next stream start.",
+                          0,
+                          G_MAXUINT,
+                          0,
+                          static_cast<GParamFlags>(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property(
+        gobject_class,
+        PROP_MAX_BUFFER_MEMORY,
+        g_param_spec_uint64("max-buffer-memory",
+                            "Maximum buffer memory",
+                            "Upper limit in bytes for the memory of all stream buffers. "
+                            "0 for unlimited. Applied with the next stream start.",
+                            0,
+                            G_MAXUINT64,
+                            0,
+                            static_cast<GParamFlags>(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property(
+        gobject_class,
+        PROP_STATISTICS,
+        g_param_spec_boxed("statistics",
+                           "Stream statistics",
+                           "Counters of the current stream, "
+                           "including the IC4 stream statistics.",
+                           GST_TYPE_STRUCTURE,
+                           static_cast<GParamFlags>(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property(
+        gobject_class,
+        PROP_STATS_INTERVAL,
+        g_param_spec_uint("stats-interval",
+                          "Statistics interval",
+                          "Milliseconds between ic4src-statistics bus messages. 0 disables them.",
+                          0,
+                          G_MAXUINT,
+                          0,
+                          static_cast<GParamFlags>(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property(
+        gobject_class,
+        PROP_DROP_POLICY,
+        g_param_spec_enum("drop-policy",
+                          "Drop policy",
+                          "Which frames are lost when downstream is slower than the device",
+                          GST_TYPE_IC4_SRC_DROP_POLICY,
+                          GST_IC4_SRC_DROP_POLICY_OLDEST,
+                          static_cast<GParamFlags>(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property(
+        gobject_class,
+        PROP_ALLOCATION_MODE,
+        g_param_spec_enum("allocation-mode",
+                          "Allocation mode",
+                          "Memory the stream buffers are allocated from. "
+                          "Applied with the next stream start.",
+                          GST_TYPE_IC4_SRC_ALLOCATION_MODE,
+                          GST_IC4_SRC_ALLOCATION_MODE_SYSTEM,
+                          static_cast<GParamFlags>(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property(
+        gobject_class,
+        PROP_CAPS_CACHE,
+        g_param_spec_boolean("caps-cache",
+                             "Caps cache",
+                             "Store the device caps on disk and reuse them "
+                             "instead of probing the device.",
+                             TRUE,
+                             static_cast<GParamFlags>(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property(
+        gobject_class,
+        PROP_ROI_OFFSET_X,
+        g_param_spec_int("roi-offset-x",
+                         "ROI offset x",
+                         "Device OffsetX, can be changed while streaming. "
+                         "-1 when no device is open.",
+                         -1,
+                         G_MAXINT,
+                         -1,
+                         static_cast<GParamFlags>(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+                                                  | GST_PARAM_MUTABLE_PLAYING)));
+
+    g_object_class_install_property(
+        gobject_class,
+        PROP_ROI_OFFSET_Y,
+        g_param_spec_int("roi-offset-y",
+                         "ROI offset y",
+                         "Device OffsetY, can be changed while streaming. "
+                         "-1 when no device is open.",
+                         -1,
+                         G_MAXINT,
+                         -1,
+                         static_cast<GParamFlags>(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+                                                  | GST_PARAM_MUTABLE_PLAYING)));
+
     gst_ic4src_signals[SIGNAL_DEVICE_OPEN] =
         g_signal_new("device-open", G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_LAST,
                      0, nullptr, nullptr, nullptr, G_TYPE_NONE, 0, G_TYPE_NONE);
@@ -1033,6 +2551,49 @@ static void gst_ic4_src_class_init(GstIC4SrcClass *klass)
         g_signal_new("device-close", G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_LAST,
                      0, nullptr, nullptr, nullptr, G_TYPE_NONE, 0, G_TYPE_NONE);
 
+    g_object_class_install_property(
+        gobject_class,
+        PROP_DEVICE_FORMAT_SELECTION,
+        g_param_spec_enum("device-format-selection",
+                          "Device format selection",
+                          "Device PixelFormat for caps that IC4 has to convert "
+                          "and that do not contain a device-format",
+                          GST_TYPE_IC4_SRC_DEVICE_FORMAT_SELECTION,
+                          GST_IC4_SRC_DEVICE_FORMAT_SELECTION_BANDWIDTH,
+                          static_cast<GParamFlags>(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property(
+        gobject_class,
+        PROP_CONVERSION_THREADS,
+        g_param_spec_uint("conversion-threads",
+                          "Conversion threads",
+                          "Threads that convert frames in horizontal stripes "
+                          "when IC4 transforms the device format. "
+                          "0 converts in the IC4 QueueSink. Applied with the next stream start.",
+                          0,
+                          256,
+                          0,
+                          static_cast<GParamFlags>(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property(
+        gobject_class,
+        PROP_CPU_AFFINITY,
+        g_param_spec_string("cpu-affinity",
+                            "CPU affinity",
+                            "CPUs the conversion threads are pinned to, e.g. \"2,3,4-7\". "
+                            "Empty leaves them to the scheduler. "
+                            "Applied with the next stream start.",
+                            "",
+                            static_cast<GParamFlags>(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+    // moves OffsetX and OffsetY together, returns FALSE when the change was rejected
+    gst_ic4src_signals[SIGNAL_SET_ROI_OFFSET] =
+        g_signal_new_class_handler("set-roi-offset", G_TYPE_FROM_CLASS(klass),
+                                   static_cast<GSignalFlags>(G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION),
+                                   G_CALLBACK(gst_ic4_src_set_roi_offset),
+                                   nullptr, nullptr, nullptr,
+                                   G_TYPE_BOOLEAN, 2, G_TYPE_INT, G_TYPE_INT);
+
     GST_DEBUG_CATEGORY_INIT(ic4_src_debug, "ic4src", 0,
                             "tcam interface");
 
@@ -1049,6 +2610,10 @@ static void gst_ic4_src_class_init(GstIC4SrcClass *klass)
     gstbasesrc_class->set_caps = gst_ic4_src_set_caps;
     gstbasesrc_class->fixate = gst_ic4_src_fixate_caps;
     gstbasesrc_class->negotiate = gst_ic4_src_negotiate;
+    gstbasesrc_class->unlock = gst_ic4_src_unlock;
+    gstbasesrc_class->query = gst_ic4_src_query;
+    gstbasesrc_class->unlock_stop = gst_ic4_src_unlock_stop;
+    gstbasesrc_class->decide_allocation = gst_ic4_src_decide_allocation;
 
     gstpushsrc_class->create = gst_ic4_src_create;
 }
@@ -1061,6 +2626,10 @@ static gboolean plugin_init(GstPlugin* plugin)
                                  TYPE_IC4_SRC_DEVICE_PROVIDER);
     gst_element_register(plugin, "ic4src", GST_RANK_PRIMARY,
                          GST_TYPE_IC4_SRC);
+    gst_element_register(plugin, "ic4convert", GST_RANK_NONE,
+                         GST_TYPE_IC4_CONVERT);
+    gst_element_register(plugin, "ic4polarsplit", GST_RANK_NONE,
+                         GST_TYPE_IC4_POLAR_SPLIT);
 
     GST_DEBUG_CATEGORY_INIT(ic4_src_debug, "ic4src", 0,
                             "tcam interface");
@@ -4,6 +4,7 @@
 
 #include <gst/base/gstpushsrc.h>
 #include <gst/gst.h>
+#include <gst/video/video.h>
 
 G_BEGIN_DECLS
 
@@ -17,6 +18,45 @@ G_BEGIN_DECLS
 #define GST_IS_IC4_SRC_CLASS(obj)                                         \
   (G_TYPE_CHECK_CLASS_TYPE((klass), GST_TYPE_IC4_SRC))
 
+typedef enum
+{
+    GST_IC4_SRC_TIMESTAMP_MODE_DEVICE,
+    GST_IC4_SRC_TIMESTAMP_MODE_ARRIVAL,
+    GST_IC4_SRC_TIMESTAMP_MODE_SMOOTHED,
+} GstIC4SrcTimestampMode;
+
+#define GST_TYPE_IC4_SRC_TIMESTAMP_MODE (gst_ic4_src_timestamp_mode_get_type())
+GType gst_ic4_src_timestamp_mode_get_type(void);
+
+typedef enum
+{
+    GST_IC4_SRC_DROP_POLICY_NEWEST,
+    GST_IC4_SRC_DROP_POLICY_OLDEST,
+    GST_IC4_SRC_DROP_POLICY_BLOCK,
+} GstIC4SrcDropPolicy;
+
+#define GST_TYPE_IC4_SRC_DROP_POLICY (gst_ic4_src_drop_policy_get_type())
+GType gst_ic4_src_drop_policy_get_type(void);
+
+typedef enum
+{
+    GST_IC4_SRC_ALLOCATION_MODE_SYSTEM,
+    GST_IC4_SRC_ALLOCATION_MODE_MEMFD,
+} GstIC4SrcAllocationMode;
+
+#define GST_TYPE_IC4_SRC_ALLOCATION_MODE (gst_ic4_src_allocation_mode_get_type())
+GType gst_ic4_src_allocation_mode_get_type(void);
+
+typedef enum
+{
+    GST_IC4_SRC_DEVICE_FORMAT_SELECTION_CURRENT,
+    GST_IC4_SRC_DEVICE_FORMAT_SELECTION_BANDWIDTH,
+    GST_IC4_SRC_DEVICE_FORMAT_SELECTION_PRECISION,
+} GstIC4SrcDeviceFormatSelection;
+
+#define GST_TYPE_IC4_SRC_DEVICE_FORMAT_SELECTION (gst_ic4_src_device_format_selection_get_type())
+GType gst_ic4_src_device_format_selection_get_type(void);
+
 typedef struct _GstIC4Src GstIC4Src;
 typedef struct _GstIC4SrcClass GstIC4SrcClass;
 struct ic4_device_state;
@@ -28,6 +68,23 @@ struct _GstIC4Src {
 
   struct ic4_device_state *device;
   gdouble fps;
+
+  GstIC4SrcTimestampMode timestamp_mode;
+
+  // milliseconds between statistics bus messages, 0 disables them
+  guint stats_interval;
+
+  // negotiated format, only valid for formats GstVideoInfo knows
+  GstVideoInfo video_info;
+  gboolean has_video_info;
+  // downstream announced GstVideoMeta support in the allocation query
+  gboolean downstream_video_meta;
+
+  // applied with the next stream start
+  GstIC4SrcAllocationMode allocation_mode;
+
+  // device PixelFormat for caps without device-format that IC4 has to convert
+  GstIC4SrcDeviceFormatSelection device_format_selection;
 };
 
 struct _GstIC4SrcClass {
@@ -0,0 +1,366 @@
+
+#include "ic4_buffer_pool.h"
+
+#include "gst_tcam_ic4_src.h"
+
+#include <algorithm>
+#include <gst/allocators/allocators.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#define GST_CAT_DEFAULT ic4_src_debug
+
+
+namespace
+{
+
+struct pool_slot
+{
+    // memory of the ic4::ImageBuffer this slot is bound to
+    void* data = nullptr;
+    size_t size = 0;
+
+    GstBuffer* buffer = nullptr;
+    GstMemory* memory = nullptr;
+
+    // set while the GstBuffer is downstream
+    std::shared_ptr<ic4::ImageBuffer> frame;
+    bool in_use = false;
+    // gst_util_get_timestamp() when the buffer was handed out
+    GstClockTime acquired = 0;
+    // set when the QueueSink was replaced while the buffer was downstream
+    bool retired = false;
+};
+
+
+void free_slot(pool_slot& slot)
+{
+    if (slot.buffer)
+    {
+        gst_buffer_unref(slot.buffer);
+        slot.buffer = nullptr;
+    }
+    if (slot.memory)
+    {
+        gst_memory_unref(slot.memory);
+        slot.memory = nullptr;
+    }
+}
+
+} // namespace
+
+
+struct ic4_buffer_pool_state
+{
+    std::mutex mtx;
+
+    std::vector<std::unique_ptr<pool_slot>> slots;
+
+    // slot that will be returned by the next acquire_buffer call
+    pool_slot* pending = nullptr;
+
+    // GstBuffers and GstMemorys created to wrap ic4 buffers
+    std::atomic<guint64> bindings = 0;
+
+    // moving average of the time downstream holds a buffer
+    std::atomic<GstClockTime> hold_time = 0;
+
+    // set when the QueueSink buffers are memfds
+    std::shared_ptr<ic4::gst::memfd_allocator> memfd;
+    GstAllocator* fd_allocator = nullptr;
+};
+
+
+G_DEFINE_TYPE(GstIC4BufferPool, gst_ic4_buffer_pool, GST_TYPE_BUFFER_POOL)
+
+
+static GstFlowReturn gst_ic4_buffer_pool_acquire_buffer(GstBufferPool* bpool,
+                                                        GstBuffer** buffer,
+                                                        GstBufferPoolAcquireParams* /*params*/)
+{
+    GstIC4BufferPool* self = GST_IC4_BUFFER_POOL(bpool);
+
+    std::lock_guard<std::mutex> lck(self->state->mtx);
+
+    if (!self->state->pending)
+    {
+        GST_ERROR_OBJECT(self, "Buffers can only be acquired via gst_ic4_buffer_pool_acquire_frame");
+        return GST_FLOW_ERROR;
+    }
+
+    *buffer = self->state->pending->buffer;
+    self->state->pending = nullptr;
+
+    return GST_FLOW_OK;
+}
+
+
+static void gst_ic4_buffer_pool_release_buffer(GstBufferPool* bpool, GstBuffer* buffer)
+{
+    GstIC4BufferPool* self = GST_IC4_BUFFER_POOL(bpool);
+
+    // released outside of the lock,
+    // this hands the buffer back to the QueueSink
+    std::shared_ptr<ic4::ImageBuffer> frame;
+
+    {
+        std::lock_guard<std::mutex> lck(self->state->mtx);
+
+        auto& slots = self->state->slots;
+        auto iter = std::find_if(slots.begin(),
+                                 slots.end(),
+                                 [buffer](const auto& s) { return s->buffer == buffer; });
+
+        if (iter == slots.end())
+        {
+            // not ours, let the parent class free it
+            GST_BUFFER_POOL_CLASS(gst_ic4_buffer_pool_parent_class)->free_buffer(bpool, buffer);
+            return;
+        }
+
+        pool_slot& slot = **iter;
+
+        frame = std::move(slot.frame);
+        slot.in_use = false;
+
+        GstClockTime held = gst_util_get_timestamp() - slot.acquired;
+        GstClockTime avg = self->state->hold_time;
+        self->state->hold_time = avg == 0 ? held : avg + ((gint64)held - (gint64)avg) / 16;
+
+        if (slot.retired)
+        {
+            free_slot(slot);
+            slots.erase(iter);
+        }
+        else if (gst_buffer_n_memory(buffer) != 1
+                 || gst_buffer_peek_memory(buffer, 0) != slot.memory)
+        {
+            // downstream replaced our memory, restore the binding
+            gst_buffer_remove_all_memory(buffer);
+            gst_buffer_append_memory(buffer, gst_memory_ref(slot.memory));
+            GST_BUFFER_FLAG_UNSET(buffer, GST_BUFFER_FLAG_TAG_MEMORY);
+        }
+    }
+}
+
+
+static void gst_ic4_buffer_pool_init(GstIC4BufferPool* self)
+{
+    self->state = new ic4_buffer_pool_state();
+}
+
+
+static void gst_ic4_buffer_pool_finalize(GObject* object)
+{
+    GstIC4BufferPool* self = GST_IC4_BUFFER_POOL(object);
+
+    if (self->state)
+    {
+        for (auto& slot : self->state->slots)
+        {
+            free_slot(*slot);
+        }
+        if (self->state->fd_allocator)
+        {
+            gst_object_unref(self->state->fd_allocator);
+        }
+        delete self->state;
+        self->state = nullptr;
+    }
+
+    G_OBJECT_CLASS(gst_ic4_buffer_pool_parent_class)->finalize(object);
+}
+
+
+static void gst_ic4_buffer_pool_class_init(GstIC4BufferPoolClass* klass)
+{
+    GObjectClass* gobject_class = G_OBJECT_CLASS(klass);
+    GstBufferPoolClass* pool_class = GST_BUFFER_POOL_CLASS(klass);
+
+    gobject_class->finalize = gst_ic4_buffer_pool_finalize;
+
+    pool_class->acquire_buffer = gst_ic4_buffer_pool_acquire_buffer;
+    pool_class->release_buffer = gst_ic4_buffer_pool_release_buffer;
+}
+
+
+GstBufferPool* gst_ic4_buffer_pool_new()
+{
+    GstBufferPool* pool = GST_BUFFER_POOL(g_object_new(GST_TYPE_IC4_BUFFER_POOL, nullptr));
+    gst_object_ref_sink(pool);
+
+    // buffers are never preallocated, they are created when an ic4 buffer is first seen
+    GstStructure* config = gst_buffer_pool_get_config(pool);
+    gst_buffer_pool_config_set_params(config, nullptr, 0, 0, 0);
+    gst_buffer_pool_set_config(pool, config);
+
+    return pool;
+}
+
+
+static GstMemory* wrap_memory(ic4_buffer_pool_state& state,
+                              void* data,
+                              size_t maxsize,
+                              size_t size)
+{
+    int fd = state.memfd ? state.memfd->find_fd(data) : -1;
+    if (fd >= 0)
+    {
+        // the fd stays owned by the allocator, it is closed when ic4 frees the buffer
+        GstMemory* mem = gst_fd_allocator_alloc(state.fd_allocator,
+                                                fd,
+                                                maxsize,
+                                                GST_FD_MEMORY_FLAG_DONT_CLOSE);
+        // still exclusive, no copy or sub-memory is created
+        gst_memory_resize(mem, 0, size);
+        GST_MINI_OBJECT_FLAG_SET(mem, GST_MEMORY_FLAG_READONLY);
+        return mem;
+    }
+    return gst_memory_new_wrapped(GST_MEMORY_FLAG_READONLY, data, maxsize, 0, size, nullptr, nullptr);
+}
+
+
+GstFlowReturn gst_ic4_buffer_pool_acquire_frame(GstIC4BufferPool* pool,
+                                                std::shared_ptr<ic4::ImageBuffer>&& frame,
+                                                size_t payload,
+                                                GstBuffer** buffer)
+{
+    void* data = frame->ptr();
+    size_t size = frame->bufferSize();
+
+    if (payload == 0 || payload > size)
+    {
+        payload = size;
+    }
+
+    {
+        std::lock_guard<std::mutex> lck(pool->state->mtx);
+
+        auto& slots = pool->state->slots;
+        auto iter = std::find_if(slots.begin(),
+                                 slots.end(),
+                                 [data, size](const auto& s)
+                                 { return !s->retired && s->data == data && s->size == size; });
+
+        pool_slot* slot = nullptr;
+
+        if (iter != slots.end())
+        {
+            slot = iter->get();
+        }
+        else
+        {
+            // warm-up, first time this ic4 buffer is delivered
+            auto new_slot = std::make_unique<pool_slot>();
+            new_slot->data = data;
+            new_slot->size = size;
+            new_slot->memory = wrap_memory(*pool->state, data, size, payload);
+            new_slot->buffer = gst_buffer_new();
+            gst_buffer_append_memory(new_slot->buffer, gst_memory_ref(new_slot->memory));
+
+            slot = new_slot.get();
+            slots.push_back(std::move(new_slot));
+
+            pool->state->bindings += 2;
+
+            GST_DEBUG_OBJECT(pool, "Bound new GstBuffer to ic4 buffer %p. Pool size: %zu",
+                             data, slots.size());
+        }
+
+        if (slot->in_use)
+        {
+            GST_ERROR_OBJECT(pool, "ic4 buffer %p delivered while still in use downstream", data);
+            return GST_FLOW_ERROR;
+        }
+
+        if (slot->memory->size != payload)
+        {
+            // a reused QueueSink delivers frames of a different size,
+            // rebind once instead of resizing every frame
+            GstMemory* memory = wrap_memory(*pool->state, data, size, payload);
+            gst_buffer_replace_all_memory(slot->buffer, gst_memory_ref(memory));
+            GST_BUFFER_FLAG_UNSET(slot->buffer, GST_BUFFER_FLAG_TAG_MEMORY);
+            gst_memory_unref(slot->memory);
+            slot->memory = memory;
+
+            pool->state->bindings++;
+
+            GST_DEBUG_OBJECT(pool, "Rebound ic4 buffer %p to frames of %zu bytes", data, payload);
+        }
+
+        slot->frame = std::move(frame);
+        slot->in_use = true;
+        slot->acquired = gst_util_get_timestamp();
+        pool->state->pending = slot;
+    }
+
+    GstFlowReturn ret = gst_buffer_pool_acquire_buffer(GST_BUFFER_POOL(pool), buffer, nullptr);
+
+    if (ret != GST_FLOW_OK)
+    {
+        // pool is inactive, hand the ic4 buffer back
+        std::shared_ptr<ic4::ImageBuffer> unused;
+
+        std::lock_guard<std::mutex> lck(pool->state->mtx);
+
+        pool_slot* slot = pool->state->pending;
+        if (slot)
+        {
+            unused = std::move(slot->frame);
+            slot->in_use = false;
+            pool->state->pending = nullptr;
+        }
+    }
+    return ret;
+}
+
+
+void gst_ic4_buffer_pool_set_memfd_allocator(
+    GstIC4BufferPool* pool,
+    const std::shared_ptr<ic4::gst::memfd_allocator>& allocator)
+{
+    std::lock_guard<std::mutex> lck(pool->state->mtx);
+
+    pool->state->memfd = allocator;
+
+    if (allocator && !pool->state->fd_allocator)
+    {
+        pool->state->fd_allocator = gst_fd_allocator_new();
+    }
+}
+
+
+void gst_ic4_buffer_pool_flush(GstIC4BufferPool* pool)
+{
+    std::lock_guard<std::mutex> lck(pool->state->mtx);
+
+    auto& slots = pool->state->slots;
+
+    for (auto iter = slots.begin(); iter != slots.end();)
+    {
+        if ((*iter)->in_use)
+        {
+            (*iter)->retired = true;
+            ++iter;
+        }
+        else
+        {
+            free_slot(**iter);
+            iter = slots.erase(iter);
+        }
+    }
+    pool->state->pending = nullptr;
+}
+
+
+guint64 gst_ic4_buffer_pool_get_binding_count(GstIC4BufferPool* pool)
+{
+    return pool->state->bindings;
+}
+
+
+GstClockTime gst_ic4_buffer_pool_get_hold_time(GstIC4BufferPool* pool)
+{
+    return pool->state->hold_time;
+}
@@ -0,0 +1,91 @@
+
+#pragma once
+
+#include "memfd_allocator.h"
+
+#include <gst/gst.h>
+#include <ic4/ImageBuffer.h>
+#include <memory>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_IC4_BUFFER_POOL (gst_ic4_buffer_pool_get_type())
+#define GST_IC4_BUFFER_POOL(obj)                                          \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj), GST_TYPE_IC4_BUFFER_POOL, GstIC4BufferPool))
+#define GST_IS_IC4_BUFFER_POOL(obj)                                       \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj), GST_TYPE_IC4_BUFFER_POOL))
+
+typedef struct _GstIC4BufferPool GstIC4BufferPool;
+typedef struct _GstIC4BufferPoolClass GstIC4BufferPoolClass;
+struct ic4_buffer_pool_state;
+
+/**
+ * Buffer pool whose GstBuffers are bound to the ic4::ImageBuffers of a QueueSink.
+ *
+ * The first time an ic4 buffer is seen a GstBuffer/GstMemory pair wrapping
+ * its memory is created. Afterwards that pair is reused every time the
+ * ic4 buffer is delivered again. When downstream releases the GstBuffer the
+ * ic4 buffer is handed back to the QueueSink.
+ */
+struct _GstIC4BufferPool
+{
+    GstBufferPool parent;
+
+    struct ic4_buffer_pool_state* state;
+};
+
+struct _GstIC4BufferPoolClass
+{
+    GstBufferPoolClass parent_class;
+};
+
+GType gst_ic4_buffer_pool_get_type(void);
+
+G_END_DECLS
+
+/**
+ * Create a new, configured pool.
+ * The pool still has to be activated with gst_buffer_pool_set_active.
+ */
+GstBufferPool* gst_ic4_buffer_pool_new();
+
+/**
+ * Allocator the ic4 buffers of the next QueueSink come from.
+ * Buffers allocated by it are wrapped as GstFdMemory.
+ * nullptr wraps the plain memory.
+ */
+void gst_ic4_buffer_pool_set_memfd_allocator(
+    GstIC4BufferPool* pool,
+    const std::shared_ptr<ic4::gst::memfd_allocator>& allocator);
+
+/**
+ * Acquire the GstBuffer bound to frame.
+ * The memory of the GstBuffer covers the first payload bytes of frame,
+ * 0 selects the whole ic4 buffer. Its size is bound together with the buffer,
+ * a changed payload rebinds the memory once.
+ * The pool keeps frame alive until the GstBuffer is released.
+ */
+GstFlowReturn gst_ic4_buffer_pool_acquire_frame(GstIC4BufferPool* pool,
+                                                std::shared_ptr<ic4::ImageBuffer>&& frame,
+                                                size_t payload,
+                                                GstBuffer** buffer);
+
+/**
+ * Forget all bindings.
+ * Has to be called when the QueueSink, and thus its buffers, is replaced.
+ * Buffers that are still in use are freed once downstream releases them.
+ */
+void gst_ic4_buffer_pool_flush(GstIC4BufferPool* pool);
+
+/**
+ * Number of GstBuffers and GstMemorys this pool created to wrap ic4 buffers.
+ * Stays constant once all buffers of the QueueSink have been seen
+ * and the frame size does not change.
+ */
+guint64 gst_ic4_buffer_pool_get_binding_count(GstIC4BufferPool* pool);
+
+/**
+ * Average time downstream holds on to a buffer.
+ * Returns 0 when no buffer has been released yet.
+ */
+GstClockTime gst_ic4_buffer_pool_get_hold_time(GstIC4BufferPool* pool);
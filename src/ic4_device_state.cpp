@@ -1,5 +1,7 @@
 
 #include "ic4_device_state.h"
+#include "caps_cache.h"
+#include "format.h"
 #include "gst/gstinfo.h"
 #include "ic4/Properties.h"
 #include "ic4_tcam_property.h"
@@ -166,6 +168,661 @@ bool ic4_device_state::open_device()
 }
 
 
+void ic4_device_state::ensure_fps_model()
+{
+    if (!is_open() || grabber->isStreaming())
+    {
+        return;
+    }
+
+    auto key = ic4::gst::make_caps_cache_key(*grabber);
+
+    if (fps_model_key_ == key.name)
+    {
+        return;
+    }
+
+    ic4::gst::fps_model model;
+    if (!caps_cache_enabled_ || !ic4::gst::load_fps_model(key, model))
+    {
+        auto props = grabber->devicePropertyMap();
+        auto calibrated = ic4::gst::calibrate_fps_model(props);
+        if (calibrated)
+        {
+            model = *calibrated;
+            if (caps_cache_enabled_)
+            {
+                ic4::gst::store_fps_model(key, model);
+            }
+        }
+    }
+
+    fps_model_ = model;
+    fps_model_key_ = key.name;
+
+    // the framerate ranges change with the model
+    invalidate_caps();
+}
+
+
+void ic4_device_state::watch_caps_properties()
+{
+    static const char* const caps_properties[] = {
+        "PixelFormat",
+        "Width",
+        "Height",
+        "BinningHorizontal",
+        "BinningVertical",
+        "DecimationHorizontal",
+        "DecimationVertical",
+        "DeviceLinkThroughputLimitMode",
+        "DeviceLinkThroughputLimit",
+    };
+
+    for (const auto& name : caps_properties)
+    {
+        add_property_watch(name, [this] { invalidate_caps(); });
+    }
+    invalidate_caps();
+}
+
+
+GstCaps* ic4_device_state::get_caps()
+{
+    if (!is_open())
+    {
+        GST_WARNING("No device opened.");
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lck(caps_mtx_);
+
+    // reset before building, a change during the build invalidates again
+    if (caps_ && !caps_dirty_.exchange(false))
+    {
+        caps_hits_++;
+        GST_LOG("Caps cache hit (%" G_GUINT64_FORMAT " hits, %" G_GUINT64_FORMAT " rebuilds)",
+                caps_hits_.load(), caps_rebuilds_.load());
+        return gst_caps_ref(caps_);
+    }
+    caps_dirty_ = false;
+
+    GstCaps* caps = build_caps();
+
+    if (caps_)
+    {
+        gst_caps_unref(caps_);
+    }
+    caps_ = caps ? gst_caps_ref(caps) : nullptr;
+
+    caps_rebuilds_++;
+    GST_DEBUG("Rebuilt caps (%" G_GUINT64_FORMAT " hits, %" G_GUINT64_FORMAT " rebuilds)",
+              caps_hits_.load(), caps_rebuilds_.load());
+
+    return caps;
+}
+
+
+GstCaps* ic4_device_state::build_caps()
+{
+    // nothing in here may write to the device
+    auto key = ic4::gst::make_caps_cache_key(*grabber);
+
+    if (caps_cache_enabled_)
+    {
+        if (auto caps = ic4::gst::load_cached_caps(key))
+        {
+            return caps;
+        }
+    }
+
+    ic4::gst::fps_model model;
+    if (fps_model_key_ == key.name)
+    {
+        model = fps_model_;
+    }
+    else if (caps_cache_enabled_)
+    {
+        ic4::gst::load_fps_model(key, model);
+    }
+
+    auto props = grabber->devicePropertyMap();
+    GstCaps* caps = ic4::gst::create_caps(props, model);
+
+    // caps without model only describe the current resolution well
+    if (caps_cache_enabled_ && model.calibrated && caps && !gst_caps_is_empty(caps))
+    {
+        ic4::gst::store_cached_caps(key, caps);
+    }
+    return caps;
+}
+
+
+queued_frame ic4_device_state::wait_for_frame()
+{
+    // fast path, frames are ready, no need to touch the mutex
+    auto frame = ready_frames_.pop();
+
+    if (!frame.buffer)
+    {
+        std::unique_lock<std::mutex> lck(stream_mtx_);
+
+        stream_cv_.wait(lck,
+                        [this]
+                        {
+                            return !ready_frames_.empty() || flushing_ || !streaming_;
+                        });
+
+        frame = ready_frames_.pop();
+    }
+
+    if (frame.buffer && drop_policy_ == GST_IC4_SRC_DROP_POLICY_BLOCK)
+    {
+        // framesQueued may be waiting for room
+        notify_stream();
+    }
+    return frame;
+}
+
+
+void ic4_device_state::hand_off_frame(queued_frame&& frame)
+{
+    switch (drop_policy_.load(std::memory_order_relaxed))
+    {
+        case GST_IC4_SRC_DROP_POLICY_NEWEST:
+        {
+            // only the latest frame is of interest,
+            // everything still waiting goes back to the QueueSink right away
+            while (ready_frames_.pop().buffer)
+            {
+                policy_drops_++;
+            }
+            break;
+        }
+        case GST_IC4_SRC_DROP_POLICY_BLOCK:
+        {
+            // stall the ic4 delivery until create took the previous frame.
+            // Frames pile up in the QueueSink, a free running device
+            // loses frames only once all buffers are filled.
+            std::unique_lock<std::mutex> lck(stream_mtx_);
+            stream_cv_.wait(lck,
+                            [this]
+                            {
+                                return ready_frames_.empty() || flushing_ || !streaming_
+                                       || stopping_;
+                            });
+            break;
+        }
+        case GST_IC4_SRC_DROP_POLICY_OLDEST:
+        default:
+        {
+            // keep everything, once downstream holds all buffers
+            // the QueueSink discards incoming frames (sink_underrun)
+            break;
+        }
+    }
+
+    if (!ready_frames_.push(std::move(frame)))
+    {
+        // cannot happen as long as the ring is larger than the buffer count
+        GST_WARNING("Frame handoff queue is full. Dropping frame.");
+        policy_drops_++;
+    }
+}
+
+
+void ic4_device_state::stop_stream()
+{
+    stopping_ = true;
+    notify_stream();
+
+    if (grabber->isStreaming())
+    {
+        grabber->streamStop();
+    }
+    ready_frames_.clear();
+
+    // framesQueued cannot run anymore, it would set streaming_ again
+    streaming_ = false;
+    stopping_ = false;
+    notify_stream();
+}
+
+
+bool ic4_device_state::account_frame(uint64_t frame_number)
+{
+    auto& d = drops_;
+
+    d.frame_gap = 0;
+    if (d.has_frame_number && frame_number > d.last_frame_number + 1)
+    {
+        d.frame_gap = frame_number - d.last_frame_number - 1;
+        d.frames_dropped += d.frame_gap;
+
+        std::lock_guard<std::mutex> lck(stats_mtx_);
+        counters_.frames_dropped = d.frames_dropped;
+    }
+    // a smaller number means the device counter was reset, nothing was lost
+    d.has_frame_number = true;
+    d.last_frame_number = frame_number;
+
+    d.is_damaged = false;
+    if (d.frame_gap == 0)
+    {
+        return false;
+    }
+
+    // ic4 discards incomplete frames, every transmission error leaves a gap.
+    // Querying the statistics only then keeps the grabber lock out of the common path.
+    ic4::Error err;
+    auto stats = grabber->streamStatistics(err);
+    if (err.isSuccess())
+    {
+        // the best we can do is flag the frame following a transmission error
+        d.is_damaged = stats.device_transmission_error > d.stream_stats.device_transmission_error;
+        d.stream_stats = stats;
+    }
+
+    return true;
+}
+
+
+bool ic4_device_state::set_roi_offset(int64_t x, int64_t y)
+{
+    if (!is_open())
+    {
+        GST_ERROR("No device open. Unable to set ROI offset.");
+        return false;
+    }
+
+    auto props = grabber->devicePropertyMap();
+    ic4::Error err;
+
+    auto p_x = props.find(ic4::PropId::OffsetX, err);
+    auto p_y = props.find(ic4::PropId::OffsetY, err);
+
+    if (!p_x.is_valid() || !p_y.is_valid())
+    {
+        GST_ERROR("Device does not have OffsetX/OffsetY.");
+        return false;
+    }
+
+    // check both offsets first, that way a rejected change
+    // never leaves the ROI half moved
+    auto check = [&err](ic4::PropInteger& p, int64_t val) -> bool
+    {
+        if (p.isLocked(err))
+        {
+            GST_ERROR("%s is locked. Changing it requires a stream restart.", p.name().c_str());
+            return false;
+        }
+
+        const int64_t min = p.minimum(err);
+        const int64_t max = p.maximum(err);
+        const int64_t inc = p.increment(err);
+
+        if (val < min || val > max || (inc > 1 && (val - min) % inc != 0))
+        {
+            GST_ERROR("%s=%" G_GINT64_FORMAT " is invalid. Range is [%" G_GINT64_FORMAT
+                      ", %" G_GINT64_FORMAT ", %" G_GINT64_FORMAT "].",
+                      p.name().c_str(), val, min, max, inc);
+            return false;
+        }
+        return true;
+    };
+
+    if (!check(p_x, x) || !check(p_y, y))
+    {
+        return false;
+    }
+
+    const int64_t old_x = p_x.getValue(err);
+    if (err.isError())
+    {
+        GST_ERROR("Unable to read OffsetX: %s", err.message().c_str());
+        return false;
+    }
+
+    if (!p_x.setValue(x, err))
+    {
+        GST_ERROR("Unable to set OffsetX: %s", err.message().c_str());
+        return false;
+    }
+
+    if (!p_y.setValue(y, err))
+    {
+        GST_ERROR("Unable to set OffsetY: %s", err.message().c_str());
+
+        // the device may still reject OffsetY, move OffsetX back
+        ic4::Error restore_err;
+        if (!p_x.setValue(old_x, restore_err))
+        {
+            GST_ERROR("Unable to restore OffsetX=%" G_GINT64_FORMAT ": %s",
+                      old_x, restore_err.message().c_str());
+        }
+        return false;
+    }
+
+    roi_change change;
+    change.pending = true;
+    change.offset_x = x;
+    change.offset_y = y;
+    change.written = gst_util_get_timestamp();
+
+    // frames that start after this point in device time use the new offsets
+    if (props.executeCommand(ic4::PropId::TimestampLatch, err))
+    {
+        int64_t latched = props.getValueInt64(ic4::PropId::TimestampLatchValue, err);
+        if (err.isSuccess() && latched > 0)
+        {
+            change.device_ns = (uint64_t)latched;
+        }
+    }
+
+    GST_DEBUG("ROI offset is now %" G_GINT64_FORMAT "x%" G_GINT64_FORMAT, x, y);
+
+    std::lock_guard<std::mutex> lck(roi_mtx_);
+    roi_change_ = change;
+    return true;
+}
+
+
+bool ic4_device_state::roi_change_applied(uint64_t device_ns, GstClockTime arrival, roi_change& change)
+{
+    std::lock_guard<std::mutex> lck(roi_mtx_);
+
+    if (!roi_change_.pending)
+    {
+        return false;
+    }
+
+    if (roi_change_.device_ns != 0 && device_ns != 0)
+    {
+        if (device_ns < roi_change_.device_ns)
+        {
+            return false;
+        }
+    }
+    else
+    {
+        // without a device clock, only frames that arrive a full frame period
+        // after the write can be sure to have been exposed afterwards
+        GstClockTime period = stream_fps_ > 0.0 ? (GstClockTime)(GST_SECOND / stream_fps_) : 0;
+        if (!GST_CLOCK_TIME_IS_VALID(arrival) || arrival < roi_change_.written + period)
+        {
+            return false;
+        }
+    }
+
+    change = roi_change_;
+    roi_change_.pending = false;
+    return true;
+}
+
+
+void ic4_device_state::stats_create_begin()
+{
+    GstClockTime now = gst_util_get_timestamp();
+
+    std::lock_guard<std::mutex> lck(stats_mtx_);
+    auto& c = counters_;
+
+    if (GST_CLOCK_TIME_IS_VALID(c.create_end))
+    {
+        GstClockTime push_time = now - c.create_end;
+        c.pushes++;
+        c.push_time_total += push_time;
+        c.push_time_max = std::max(c.push_time_max, push_time);
+    }
+    c.create_begin = now;
+}
+
+
+void ic4_device_state::stats_frame_ready()
+{
+    GstClockTime now = gst_util_get_timestamp();
+
+    std::lock_guard<std::mutex> lck(stats_mtx_);
+    auto& c = counters_;
+
+    if (GST_CLOCK_TIME_IS_VALID(c.create_begin))
+    {
+        GstClockTime wait_time = now - c.create_begin;
+        c.wait_time_total += wait_time;
+        c.wait_time_max = std::max(c.wait_time_max, wait_time);
+    }
+
+    if (GST_CLOCK_TIME_IS_VALID(c.last_frame))
+    {
+        double interval = (double)(now - c.last_frame);
+        // exponential moving average, roughly the last 16 frames
+        c.frame_interval_ns = c.frame_interval_ns == 0.0
+                                  ? interval
+                                  : c.frame_interval_ns + (interval - c.frame_interval_ns) / 16.0;
+    }
+    c.last_frame = now;
+    c.frames_pushed++;
+}
+
+
+void ic4_device_state::stats_create_end()
+{
+    GstClockTime now = gst_util_get_timestamp();
+
+    std::lock_guard<std::mutex> lck(stats_mtx_);
+    counters_.create_end = now;
+}
+
+
+bool ic4_device_state::stats_post_due(GstClockTime interval)
+{
+    GstClockTime now = gst_util_get_timestamp();
+
+    std::lock_guard<std::mutex> lck(stats_mtx_);
+    auto& c = counters_;
+
+    if (!GST_CLOCK_TIME_IS_VALID(c.last_post))
+    {
+        // first frame of the stream, start the interval
+        c.last_post = now;
+        return false;
+    }
+
+    if (now - c.last_post < interval)
+    {
+        return false;
+    }
+    c.last_post = now;
+    return true;
+}
+
+
+GstStructure* ic4_device_state::build_statistics()
+{
+    stream_counters c;
+    {
+        std::lock_guard<std::mutex> lck(stats_mtx_);
+        c = counters_;
+    }
+
+    double fps = c.frame_interval_ns > 0.0 ? (double)GST_SECOND / c.frame_interval_ns : 0.0;
+
+    GstStructure* struc = gst_structure_new(
+        "ic4src-statistics",
+        "frames_pushed", G_TYPE_UINT64, c.frames_pushed,
+        "frames_dropped", G_TYPE_UINT64, c.frames_dropped,
+        "policy_drops", G_TYPE_UINT64, policy_drops_.load(),
+        "achieved_fps", G_TYPE_DOUBLE, fps,
+        "queue_size", G_TYPE_UINT64, (guint64)ready_frames_.size(),
+        "queue_high_water", G_TYPE_UINT64, (guint64)queue_high_water_.load(),
+        "buffer_count", G_TYPE_UINT64, (guint64)active_buffer_count_,
+        "wait_time_avg_ns", G_TYPE_UINT64,
+        c.frames_pushed ? c.wait_time_total / c.frames_pushed : 0,
+        "wait_time_max_ns", G_TYPE_UINT64, c.wait_time_max,
+        "push_time_avg_ns", G_TYPE_UINT64, c.pushes ? c.push_time_total / c.pushes : 0,
+        "push_time_max_ns", G_TYPE_UINT64, c.push_time_max,
+        "caps_cache_hits", G_TYPE_UINT64, caps_hits_.load(),
+        "caps_rebuilds", G_TYPE_UINT64, caps_rebuilds_.load(),
+        nullptr);
+
+    if (is_open())
+    {
+        ic4::Error err;
+        auto stats = grabber->streamStatistics(err);
+        if (err.isSuccess())
+        {
+            gst_structure_set(struc,
+                              "device_delivered", G_TYPE_UINT64, stats.device_delivered,
+                              "device_transmission_error", G_TYPE_UINT64,
+                              stats.device_transmission_error,
+                              "device_underrun", G_TYPE_UINT64, stats.device_underrun,
+                              "transform_delivered", G_TYPE_UINT64, stats.transform_delivered,
+                              "transform_underrun", G_TYPE_UINT64, stats.transform_underrun,
+                              "sink_delivered", G_TYPE_UINT64, stats.sink_delivered,
+                              "sink_underrun", G_TYPE_UINT64, stats.sink_underrun,
+                              "sink_ignored", G_TYPE_UINT64, stats.sink_ignored,
+                              nullptr);
+        }
+        else
+        {
+            GST_DEBUG("Unable to retrieve stream statistics: %s", err.message().c_str());
+        }
+    }
+
+    return struc;
+}
+
+
+size_t ic4_device_state::frame_size(const ic4::ImageType& type)
+{
+    int bpp = ic4::gst::get_bits_per_pixel(type.pixelFormat());
+    if (bpp == 0)
+    {
+        // unknown, assume the worst
+        bpp = 64;
+    }
+    return (size_t)type.width() * type.height() * bpp / 8;
+}
+
+
+size_t ic4_device_state::compute_buffer_count(const ic4::ImageType& type)
+{
+    // bounds for the automatic mode
+    static constexpr size_t min_auto_count = 4;
+    static constexpr size_t max_auto_count = 256;
+    // bursts downstream has to be able to absorb on top of the average hold time
+    static constexpr double burst_tolerance_s = 0.1;
+
+    const guint64 frame_size = ic4_device_state::frame_size(type);
+
+    size_t count = buffer_count_;
+
+    if (count == 0)
+    {
+        double hold_s = (double)hold_time_ / GST_SECOND;
+
+        count = (size_t)std::ceil(stream_fps_ * (hold_s + burst_tolerance_s)) + 2;
+        count = std::clamp(count, min_auto_count, max_auto_count);
+
+        GST_DEBUG("Automatic buffer count: fps %f, hold time %" GST_TIME_FORMAT " -> %zu",
+                  stream_fps_, GST_TIME_ARGS(hold_time_), count);
+    }
+
+    if (max_buffer_memory_ > 0 && frame_size > 0)
+    {
+        // at least two, otherwise capture and delivery cannot overlap
+        size_t mem_count = std::max<guint64>(max_buffer_memory_ / frame_size, 2);
+
+        if (mem_count * frame_size > max_buffer_memory_)
+        {
+            GST_WARNING("max-buffer-memory of %" G_GUINT64_FORMAT " bytes cannot hold "
+                        "two frames of %" G_GUINT64_FORMAT " bytes. Exceeding the limit.",
+                        max_buffer_memory_,
+                        frame_size);
+        }
+
+        if (mem_count < count)
+        {
+            GST_INFO("Limiting buffer count to %zu due to max-buffer-memory", mem_count);
+            count = mem_count;
+        }
+    }
+
+    return count;
+}
+
+
+bool ic4_device_state::get_latency(GstClockTime& min, GstClockTime& max)
+{
+    if (!is_open())
+    {
+        return false;
+    }
+
+    auto props = grabber->devicePropertyMap();
+    ic4::Error err;
+
+    // in us
+    double exposure = props.getValueDouble(ic4::PropId::ExposureTime, err);
+    if (err.isError())
+    {
+        exposure = 0.0;
+    }
+
+    double fps = props.getValueDouble(ic4::PropId::AcquisitionFrameRate, err);
+    GstClockTime frame_period = 0;
+    if (err.isSuccess() && fps > 0.0)
+    {
+        frame_period = (GstClockTime)(GST_SECOND / fps);
+    }
+
+    // an image is available once it was exposed, read out and transferred
+    min = (GstClockTime)(exposure * GST_USECOND) + frame_period
+          + (GstClockTime)transfer_time_ns_.load(std::memory_order_relaxed);
+
+    // in the worst case every buffer of the sink is queued in front of it
+    size_t buffer_count = std::max<size_t>(active_buffer_count_, 1);
+    max = min + (buffer_count - 1) * frame_period;
+
+    return true;
+}
+
+
+void ic4_device_state::add_property_watch(const std::string& name, std::function<void()> cb)
+{
+    ic4::Error err;
+    auto prop = grabber->devicePropertyMap().find(name, err);
+
+    if (err.isError() || !prop.is_valid())
+    {
+        GST_DEBUG("Property %s does not exist. Not watching it.", name.c_str());
+        return;
+    }
+
+    auto token = prop.eventAddNotification([cb](ic4::Property&) { cb(); }, err);
+
+    if (err.isError())
+    {
+        GST_WARNING("Unable to register notification for %s: %s",
+                    name.c_str(), err.message().c_str());
+        return;
+    }
+
+    property_watches_.push_back({ prop, token });
+}
+
+
+void ic4_device_state::remove_property_watches()
+{
+    for (auto& w : property_watches_)
+    {
+        ic4::Error err;
+        w.property.eventRemoveNotification(w.token, err);
+    }
+    property_watches_.clear();
+}
+
+
 bool ic4_device_state::set_properties_from_string(const std::string &str)
 {
     if (!grabber)
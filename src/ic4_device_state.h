@@ -2,13 +2,22 @@
 #pragma once
 
 #include "ic4_gst_conversions.h"
+#include "frame_queue.h"
+#include "gst_tcam_ic4_src.h"
+#include "striped_convert.h"
+#include "timestamp_estimator.h"
+#include "unpack.h"
 
+#include <algorithm>
 #include <atomic>
 #include <condition_variable>
+#include <functional>
 #include <gst/gst.h>
 #include <ic4/ic4.h>
+#include <cmath>
 #include <memory>
 #include <mutex>
+#include <vector>
 
 #ifdef ENABLE_TCAM_PROP
 #include <tcamprop1.0_base/tcamprop_property_interface.h>
@@ -65,6 +74,13 @@ struct src_interface_list : tcamprop1::property_list_interface
 // found in src.cpp
 struct sink_listener;
 
+struct queued_frame
+{
+    std::shared_ptr<ic4::ImageBuffer> buffer;
+    // gst_util_get_timestamp() at the time framesQueued delivered the frame
+    GstClockTime arrival = GST_CLOCK_TIME_NONE;
+};
+
 struct ic4_device_state
 {
     std::shared_ptr<ic4::Grabber> grabber;
@@ -74,12 +90,279 @@ struct ic4_device_state
     std::shared_ptr<sink_listener> listener;
     void* dev_lost_token_ = nullptr;
 
+    struct property_watch
+    {
+        ic4::Property property;
+        void* token = nullptr;
+    };
+    std::vector<property_watch> property_watches_;
+
     std::atomic<bool> streaming_ = false;
+    std::atomic<bool> flushing_ = false;
+    // set while stop_stream waits for framesQueued to return
+    std::atomic<bool> stopping_ = false;
     std::mutex stream_mtx_;
     std::condition_variable stream_cv_;
 
+    // frames popped from the QueueSink, waiting for gst_ic4_src_create
+    ic4::gst::frame_ring<queued_frame> ready_frames_;
+
+    // how framesQueued treats frames when downstream is slower than the device
+    std::atomic<GstIC4SrcDropPolicy> drop_policy_ = GST_IC4_SRC_DROP_POLICY_OLDEST;
+    // frames discarded by the drop policy since stream start
+    std::atomic<uint64_t> policy_drops_ = 0;
+
+    // timestamp state, reset with every stream start
+    ic4::gst::timestamp_estimator ts_estimator_;
+    uint64_t ts_first_device_ = 0;
+    GstClockTime ts_first_running_ = GST_CLOCK_TIME_NONE;
+    // set by timestamp-mode, the streaming thread resets the state with the next frame
+    std::atomic<bool> ts_reset_pending_ = false;
+
+    // only call from the streaming thread or while not streaming
+    void reset_timestamps()
+    {
+        ts_estimator_.reset();
+        ts_first_device_ = 0;
+        ts_first_running_ = GST_CLOCK_TIME_NONE;
+    }
+
+    // drop accounting, reset with every stream start
+    struct drop_accounting
+    {
+        bool has_frame_number = false;
+        uint64_t last_frame_number = 0;
+        // sum of all gaps in device_frame_number
+        uint64_t frames_dropped = 0;
+        // gap right in front of the current frame
+        uint64_t frame_gap = 0;
+
+        // stream statistics as of the most recent gap
+        ic4::Grabber::StreamStatistics stream_stats = {};
+        // transmission errors occurred since the previous frame
+        bool is_damaged = false;
+
+        // rate limiting of drop messages
+        GstClockTime last_message = 0;
+        uint64_t reported_dropped = 0;
+    };
+    drop_accounting drops_;
+
+    void reset_drop_accounting()
+    {
+        drops_ = {};
+        policy_drops_ = 0;
+    }
+
+    /**
+     * Update drop counters with the frame that is about to be pushed.
+     * frame_number is the device frame number.
+     * The stream statistics are only queried when there is a gap.
+     * Returns true when frames were lost in front of this one.
+     */
+    bool account_frame(uint64_t frame_number);
+
+    // counters reported by the statistics property, reset with every stream start
+    struct stream_counters
+    {
+        uint64_t frames_pushed = 0;
+        uint64_t frames_dropped = 0;
+
+        // moving average of the interval between frames
+        double frame_interval_ns = 0.0;
+        GstClockTime last_frame = GST_CLOCK_TIME_NONE;
+
+        // time gst_ic4_src_create waited for a frame
+        GstClockTime wait_time_total = 0;
+        GstClockTime wait_time_max = 0;
+
+        // time between create returning and being called again,
+        // i.e. the time downstream needed to process a pushed buffer
+        uint64_t pushes = 0;
+        GstClockTime push_time_total = 0;
+        GstClockTime push_time_max = 0;
+
+        GstClockTime create_begin = GST_CLOCK_TIME_NONE;
+        GstClockTime create_end = GST_CLOCK_TIME_NONE;
+
+        // last time the statistics were posted on the bus
+        GstClockTime last_post = GST_CLOCK_TIME_NONE;
+    };
+    std::mutex stats_mtx_;
+    stream_counters counters_;
+    // highest number of frames waiting in ready_frames_, updated by framesQueued
+    std::atomic<size_t> queue_high_water_ = 0;
+
+    void reset_counters()
+    {
+        std::lock_guard<std::mutex> lck(stats_mtx_);
+        counters_ = {};
+        queue_high_water_ = 0;
+    }
+
+    // called by gst_ic4_src_create when it starts waiting for a frame
+    void stats_create_begin();
+    // called by gst_ic4_src_create once it received a frame
+    void stats_frame_ready();
+    // called by gst_ic4_src_create right before it returns a buffer
+    void stats_create_end();
+
+    /**
+     * Returns true and updates the post time when
+     * interval has passed since statistics were last posted.
+     */
+    bool stats_post_due(GstClockTime interval);
+
+    /**
+     * Snapshot of all stream counters, including the ic4 stream statistics.
+     * Safe to call from any thread.
+     * Returns a new GstStructure named ic4src-statistics.
+     */
+    GstStructure* build_statistics();
+
+    // latency state
+    // set by property notifications when ExposureTime/AcquisitionFrameRate change
+    std::atomic<bool> latency_dirty_ = true;
+    // moving average of (running time when the buffer is pushed - PTS).
+    // With timestamp-mode=arrival the PTS is taken when the frame is queued,
+    // the average then only measures the wait in the handoff queue, not the transfer.
+    // Written by create, read by latency queries from other threads.
+    std::atomic<double> transfer_time_ns_ = 0.0;
+    double transfer_time_reported_ns_ = 0.0;
+
+    void update_transfer_time(GstClockTime delay)
+    {
+        // exponential moving average, roughly the last 32 frames.
+        // create is the only writer, load and store do not have to be one operation
+        double avg = transfer_time_ns_.load(std::memory_order_relaxed);
+        transfer_time_ns_.store(avg + ((double)delay - avg) / 32.0, std::memory_order_relaxed);
+    }
+
+    /**
+     * Returns true when the latency has to be recomputed.
+     * Resets the internal change detection.
+     */
+    bool latency_changed()
+    {
+        bool changed = latency_dirty_.exchange(false);
+
+        // only react to significant changes of the measured part
+        const double transfer_time = transfer_time_ns_.load(std::memory_order_relaxed);
+        if (std::abs(transfer_time - transfer_time_reported_ns_) > (double)GST_MSECOND)
+        {
+            changed = true;
+        }
+
+        if (changed)
+        {
+            transfer_time_reported_ns_ = transfer_time;
+        }
+        return changed;
+    }
+
+    /**
+     * Compute the latency of the current stream from
+     * exposure, framerate, queue depth and measured transfer time.
+     * Returns false when no device is open.
+     */
+    bool get_latency(GstClockTime& min, GstClockTime& max);
+
+    /**
+     * Register a notification for the device property name.
+     * Properties that do not exist are ignored.
+     * All notifications are removed by remove_property_watches.
+     */
+    void add_property_watch(const std::string& name, std::function<void()> cb);
+    void remove_property_watches();
+
     std::string identifier_;
 
+    // number of buffers the QueueSink allocates, 0 selects the count automatically
+    guint buffer_count_ = 0;
+    // upper limit for the memory of all QueueSink buffers in bytes, 0 for unlimited
+    guint64 max_buffer_memory_ = 0;
+
+    // inputs for the automatic buffer count, set before the stream is set up
+    double stream_fps_ = 0.0;
+    GstClockTime hold_time_ = 0;
+
+    // buffer count of the current stream
+    size_t active_buffer_count_ = 0;
+
+    size_t compute_buffer_count(const ic4::ImageType& type);
+
+    // bytes a frame of type occupies, estimated from the format table
+    static size_t frame_size(const ic4::ImageType& type);
+
+    // what the buffers of sink were allocated for,
+    // set_caps reuses a sink whose buffers are large enough
+    ic4::PixelFormat sink_format_ = ic4::PixelFormat::Invalid;
+    GstIC4SrcAllocationMode sink_allocation_mode_ = GST_IC4_SRC_ALLOCATION_MODE_SYSTEM;
+    size_t sink_frame_size_ = 0;
+    size_t sink_buffer_count_ = 0;
+
+    // caps of the running stream without framerate,
+    // set_caps only adjusts the framerate when the rest matches
+    GstCaps* stream_caps_ = nullptr;
+
+    void set_stream_caps(GstCaps* caps)
+    {
+        gst_caps_replace(&stream_caps_, caps);
+    }
+
+    // drop the QueueSink and its buffers, the next set_caps creates a new one
+    void release_sink()
+    {
+        sink = nullptr;
+        sink_format_ = ic4::PixelFormat::Invalid;
+        sink_frame_size_ = 0;
+        sink_buffer_count_ = 0;
+        set_stream_caps(nullptr);
+        unpack_ = ic4::gst::packing::none;
+        repack_format_ = ic4::PixelFormat::Invalid;
+        convert_format_ = ic4::PixelFormat::Invalid;
+        set_convert_pool(nullptr);
+    }
+
+    // threads create uses for IC4 transforms, 0 leaves the conversion to the QueueSink
+    guint conversion_threads_ = 0;
+    // cpus the conversion workers are pinned to, set through cpu-affinity
+    std::string cpu_affinity_;
+    std::vector<int> conversion_cpus_;
+
+    // create converts frames itself instead of the QueueSink,
+    // unpacking or repacking device formats or with striped IC4 transforms.
+    // packing of the device format when unpacking, packing::none otherwise
+    ic4::gst::packing unpack_ = ic4::gst::packing::none;
+    // negotiated format when create repacks, see repack.h, Invalid otherwise
+    ic4::PixelFormat repack_format_ = ic4::PixelFormat::Invalid;
+    // negotiated format when converter_ transforms the frames, Invalid otherwise
+    ic4::PixelFormat convert_format_ = ic4::PixelFormat::Invalid;
+    // kept across renegotiation, the workers only restart when the thread settings change
+    std::unique_ptr<ic4::gst::striped_converter> converter_;
+    size_t convert_stride_ = 0;
+    // output buffers of the converted frames
+    GstBufferPool* convert_pool_ = nullptr;
+    // intermediate line of repack_frame, sized once in set_caps
+    std::vector<uint8_t> repack_scratch_;
+
+    bool converts_frames() const
+    {
+        return unpack_ != ic4::gst::packing::none || repack_format_ != ic4::PixelFormat::Invalid
+               || convert_format_ != ic4::PixelFormat::Invalid;
+    }
+
+    void set_convert_pool(GstBufferPool* pool)
+    {
+        if (convert_pool_)
+        {
+            // buffers still held downstream keep the pool alive
+            gst_buffer_pool_set_active(convert_pool_, FALSE);
+            gst_object_unref(convert_pool_);
+        }
+        convert_pool_ = pool;
+    }
+
     std::string set_property_cache_;
 
     std::string get_ident()
@@ -116,15 +399,127 @@ struct ic4_device_state
         return streaming_;
     }
 
-    GstCaps* get_caps()
+    // wake up a gst_ic4_src_create that is waiting for frames
+    void notify_stream()
+    {
+        {
+            // taking the lock ensures the waiter is either
+            // before its predicate check or already sleeping
+            std::lock_guard<std::mutex> lck(stream_mtx_);
+        }
+        stream_cv_.notify_all();
+    }
+
+    void set_flushing(bool flushing)
+    {
+        flushing_ = flushing;
+        notify_stream();
+    }
+
+    bool is_flushing()
+    {
+        return flushing_;
+    }
+
+    /**
+     * Blocks until a frame is available, the stream ended or flushing is requested.
+     * Returns an empty queued_frame in the latter two cases.
+     */
+    queued_frame wait_for_frame();
+
+    /**
+     * Hand a frame from framesQueued to gst_ic4_src_create,
+     * applying drop_policy_.
+     */
+    void hand_off_frame(queued_frame&& frame);
+
+    /**
+     * Stop the ic4 stream and discard the frames create has not taken yet.
+     * streamStop waits for framesQueued, which the block drop policy stalls
+     * while nobody drains the ring, e.g. when set_caps runs on the streaming thread.
+     */
+    void stop_stream();
+
+    // ROI offset change that has not been observed in a frame yet
+    struct roi_change
+    {
+        bool pending = false;
+        int64_t offset_x = 0;
+        int64_t offset_y = 0;
+        // device clock right after the write, 0 when the device cannot latch it
+        uint64_t device_ns = 0;
+        // gst_util_get_timestamp() right after the write
+        GstClockTime written = GST_CLOCK_TIME_NONE;
+    };
+    std::mutex roi_mtx_;
+    roi_change roi_change_;
+
+    /**
+     * Move the ROI by writing OffsetX/OffsetY, also while streaming.
+     * Offsets that cannot be written without restarting the stream
+     * are rejected, the device is left untouched in that case.
+     */
+    bool set_roi_offset(int64_t x, int64_t y);
+
+    /**
+     * Returns true once for the first frame captured with the offsets
+     * of the last set_roi_offset call and fills change.
+     * device_ns is the frame timestamp, arrival its gst_util_get_timestamp().
+     */
+    bool roi_change_applied(uint64_t device_ns, GstClockTime arrival, roi_change& change);
+
+    // load/store generated caps in the on-disk cache
+    bool caps_cache_enabled_ = true;
+
+    // framerate model of the configuration named fps_model_key_
+    ic4::gst::fps_model fps_model_;
+    std::string fps_model_key_;
+
+    /**
+     * Make sure a framerate model for the current configuration exists.
+     * Calibrates the model once if neither memory nor disk cache have one,
+     * which writes Width/Height. Must not be called while streaming.
+     */
+    void ensure_fps_model();
+
+    /**
+     * Caps of the opened device in its current configuration.
+     * Memoized until a property that affects the caps changes.
+     * Otherwise served from the on-disk cache when possible,
+     * or generated by probing the device.
+     * Returns a new reference.
+     */
+    GstCaps* get_caps();
+
+    // memoized result of get_caps, guarded by caps_mtx_
+    std::mutex caps_mtx_;
+    GstCaps* caps_ = nullptr;
+    std::atomic<bool> caps_dirty_ = true;
+    std::atomic<uint64_t> caps_hits_ = 0;
+    std::atomic<uint64_t> caps_rebuilds_ = 0;
+
+    // called by property notifications, the next get_caps call rebuilds
+    void invalidate_caps()
     {
-        if (!is_open())
+        if (!caps_dirty_.exchange(true))
         {
-            GST_WARNING("No device opened.");
-            return nullptr;
+            GST_DEBUG("Caps invalidated");
         }
-        auto props = grabber->devicePropertyMap();
-        return ic4::gst::create_caps(props);
+    }
+
+    /**
+     * Register notifications for all properties that influence the caps.
+     */
+    void watch_caps_properties();
+
+    ~ic4_device_state()
+    {
+        if (caps_)
+        {
+            gst_caps_unref(caps_);
+        }
+        set_stream_caps(nullptr);
+        set_convert_pool(nullptr);
     }
 
 #ifdef ENABLE_TCAM_PROP
@@ -142,6 +537,9 @@ private:
     tcamprop1_gobj::tcam_property_provider tcamprop_container_;
 #endif
     void populate_tcamprop_interface();
+
+    // get_caps without memoization
+    GstCaps* build_caps();
 };
 
 
@@ -150,11 +548,40 @@ struct sink_listener : public ic4::QueueSinkListener
 
     bool sinkConnected(ic4::QueueSink& sink, const ic4::ImageType& frameType)
     {
-        (void)sink;
-        (void)frameType;
+        size_t buffer_count = state->compute_buffer_count(frameType);
+        size_t frame_size = ic4_device_state::frame_size(frameType);
+
+        // a reused sink keeps its buffers, only add what is missing
+        size_t existing = 0;
+        if (frame_size <= state->sink_frame_size_)
+        {
+            existing = state->sink_buffer_count_;
+        }
+        else
+        {
+            state->sink_frame_size_ = frame_size;
+        }
+
+        size_t total = std::max(buffer_count, existing);
 
-        GST_INFO("sinkConnected");
-        state->sink->allocAndQueueBuffers(10);
+        GST_INFO("sinkConnected. Reusing %zu buffers, allocating %zu buffers",
+                 existing, total - existing);
+
+        // the ring has to be able to hold every buffer the sink owns,
+        // that way framesQueued never has to leave frames behind
+        state->ready_frames_.reset(total + 1);
+        state->active_buffer_count_ = total;
+
+        if (total > existing)
+        {
+            ic4::Error err;
+            if (!sink.allocAndQueueBuffers(total - existing, err))
+            {
+                GST_ERROR("Unable to allocate %zu buffers: %s", total - existing, err.message().c_str());
+                return false;
+            }
+        }
+        state->sink_buffer_count_ = total;
         return true;
     }
 
@@ -164,12 +591,27 @@ struct sink_listener : public ic4::QueueSinkListener
         GST_INFO("sinkDisconnected");
     }
 
-    void framesQueued(ic4::QueueSink& /*sink*/)
+    void framesQueued(ic4::QueueSink& sink)
     {
-        //GST_ERROR("framesQueued");
-        // _queued = true;
+        // move everything that is ready into the handoff ring
+        // this way no notification can be lost while
+        // gst_ic4_src_create is busy pushing
+        ic4::Error err;
+        GstClockTime now = gst_util_get_timestamp();
+        while (auto frame = sink.popOutputBuffer(err))
+        {
+            state->hand_off_frame({ std::move(frame), now });
+        }
+
+        // only this thread writes the high-water mark
+        size_t occupancy = state->ready_frames_.size();
+        if (occupancy > state->queue_high_water_.load(std::memory_order_relaxed))
+        {
+            state->queue_high_water_.store(occupancy, std::memory_order_relaxed);
+        }
+
         state->streaming_ = true;
-        state->stream_cv_.notify_all();
+        state->notify_stream();
     };
 
     ic4_device_state* state;
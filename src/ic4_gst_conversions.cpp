@@ -1,6 +1,9 @@
 
 #include "ic4_gst_conversions.h"
+#include "caps_merge.h"
 #include "format.h"
+#include "repack.h"
+#include "unpack.h"
 #include "ic4/Properties.h"
 #include "gst/gst.h"
 #include <algorithm>
@@ -73,250 +76,405 @@ std::vector<image_size> get_standard_resolutions(const image_size& min,
 }
 
 
-GstCaps* ic4::gst::create_caps(ic4::PropertyMap& props)
+std::optional<ic4::gst::fps_model> ic4::gst::calibrate_fps_model(ic4::PropertyMap& props)
 {
-    // auto p_bin_x = props.findInteger("BinningHorizontal");
-    // auto p_bin_y = props.findInteger("BinningVertical");
-    // bool has_binning = p_bin_x.is_valid();
-    // std::vector<std::string> gst_binning_entries;
-
-    // if (has_binning)
-    // {
-    //     // GST_INFO("HAS BINNING");
-
-    //     // there are cameras with
-    //     // BinningHorizontal == 1
-    //     // BinningVertical == 1
-    //     // for those we ignore binning
-    //     if (p_bin_x.minimum() == p_bin_x.maximum())
-    //     {
-    //         gst_binning_entries.push_back("1x1");
-    //         GST_DEBUG("only binning 1x1 exists");
-    //         has_binning = false;
-    //     }
-    //     else
-    //     {
-
-    //     }
-    // }
-    // else
-    // {
-    //     gst_binning_entries.push_back("1x1");
-    //     GST_INFO("No binning");
-    // }
-
-
-    // auto p_skip_x = props.findInteger("DecimationHorizontal");
-    // auto p_skip_y = props.findInteger("DecimationVertical");
-    // bool has_skipping = p_skip_x.is_valid();
-    // std::vector<std::string> gst_skipping_entries;
-
-    // if (has_skipping)
-    // {
-    //     GST_INFO("HAS SKIPPING");
-    // }
-    // else
-    // {
-    //     GST_INFO("NO SKIPPING");
-    // }
+    ic4::Error err;
 
+    auto p_width = props.findInteger("Width", err);
+    auto p_height = props.findInteger("Height", err);
+    auto p_fps = props.findFloat("AcquisitionFrameRate", err);
 
-    auto p_fmt = props.findEnumeration("PixelFormat");
+    if (err.isError() || p_fps.incrementMode(err) == ic4::PropIncrementMode::ValueSet)
+    {
+        // value set cameras report all framerates in their value set
+        return std::nullopt;
+    }
 
-    auto p_width = props.findInteger("Width");
-    int64_t width_min;
-    int64_t width_max;
-    int64_t width_step;
+    const int64_t width_current = p_width.getValue(err);
+    const int64_t height_current = p_height.getValue(err);
 
-    int64_t width_current_value = p_width.getValue();
+    auto measure = [&](bool use_max, int64_t& height, double& fps) -> bool
+    {
+        int64_t w = use_max ? p_width.maximum(err) : p_width.minimum(err);
+        int64_t h = use_max ? p_height.maximum(err) : p_height.minimum(err);
 
-    std::vector<int64_t> width_values;
+        if (p_height.incrementMode(err) == ic4::PropIncrementMode::Increment)
+        {
+            // same fix as in create_caps, some cameras report max values off the step
+            auto step = p_height.increment(err);
+            if (step > 0)
+            {
+                h -= h % step;
+            }
+        }
 
-    if (p_width.incrementMode() == ic4::PropIncrementMode::Increment)
-    {
-        width_min = p_width.minimum();
-        width_max = p_width.maximum();
-        width_step = p_width.increment();
-    }
-    else
-    {
-        width_values = p_width.validValueSet();
-    }
+        if (!p_width.setValue(w, err) || !p_height.setValue(h, err))
+        {
+            return false;
+        }
+        height = h;
+        fps = p_fps.maximum(err);
+        return err.isSuccess() && fps > 0.0;
+    };
 
-    auto p_height = props.findInteger("Height");
-    int64_t height_min;
-    int64_t height_max;
-    int64_t height_step;
+    int64_t height_large = 0;
+    int64_t height_small = 0;
+    double fps_large = 0.0;
+    double fps_small = 0.0;
 
-    int64_t height_current_value = p_height.getValue();
+    bool success = measure(true, height_large, fps_large)
+                   && measure(false, height_small, fps_small);
 
-    std::vector<int64_t> height_values;
+    p_width.setValue(width_current, err);
+    p_height.setValue(height_current, err);
 
-    if (p_height.incrementMode() == ic4::PropIncrementMode::Increment)
+    if (!success)
     {
-        height_min = p_height.minimum();
-        height_max = p_height.maximum();
-        height_step = p_height.increment();
+        GST_WARNING("Unable to calibrate framerate model: %s", err.message().c_str());
+        return std::nullopt;
+    }
 
-        // fix for 23G cameras, can give weird settings like step=4 max=602
-        auto mod = height_max % height_step;
-        if (mod != 0)
+    fps_model model;
+    model.calibrated = true;
+    model.width = p_width.maximum(err);
+
+    if (auto entry = get_entry_by_pixel_format_name(props.getValueString("PixelFormat", err)))
+    {
+        model.bits_per_pixel = entry->bits_per_pixel;
+    }
+
+    // the limit only applies while its mode is on, devices without the mode always apply it
+    std::string limit_mode = props.getValueString("DeviceLinkThroughputLimitMode", err);
+    if (err.isError() || limit_mode == "On")
+    {
+        auto p_limit = props.findInteger("DeviceLinkThroughputLimit", err);
+        if (err.isSuccess())
         {
-            height_max -= mod;
+            model.link_limit = (double)p_limit.getValue(err);
         }
+    }
+    if (err.isError())
+    {
+        model.link_limit = 0.0;
+    }
 
+    if (height_large > height_small)
+    {
+        model.line_time_s = (1.0 / fps_large - 1.0 / fps_small) / (double)(height_large - height_small);
     }
-    else
+    if (model.line_time_s < 0.0)
     {
-        height_values = p_height.validValueSet();
+        // framerate is not limited by the sensor readout
+        model.line_time_s = 0.0;
     }
+    model.frame_overhead_s = 1.0 / fps_small - model.line_time_s * (double)height_small;
+
+    GST_INFO("Framerate model: overhead %f us, line time %f us, %d bpp, link limit %.0f B/s",
+             model.frame_overhead_s * 1e6,
+             model.line_time_s * 1e6,
+             model.bits_per_pixel,
+             model.link_limit);
+
+    return model;
+}
 
-    auto set_min_resolution = [&] ()
+
+/**
+ * Split the heights [min, max] into bands for per-band framerate ranges.
+ * Returns the largest height of every band in ascending order.
+ * Standard resolutions end a band, that way their framerate is exact.
+ * Within a band the maximum framerate varies by at most 25%,
+ * finer bands would multiply the number of caps structures.
+ */
+static std::vector<int64_t> get_height_bands(const ic4::gst::fps_model& model,
+                                             int64_t min,
+                                             int64_t max,
+                                             int64_t step)
+{
+    step = std::max<int64_t>(step, 1);
+
+    std::vector<int64_t> edges;
+    for (const auto& r : get_standard_resolutions({ 1, (int)min }, { 1 << 16, (int)max }, { 1, 1 }))
     {
-        if (height_values.empty())
+        if (r.height > min && r.height < max && (r.height - min) % step == 0)
         {
-            p_width.setValue(width_min);
-            p_height.setValue(height_min);
+            edges.push_back(r.height);
         }
-        else
+    }
+    edges.push_back(max);
+
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+    // largest height whose frame time is at most 25% above that of start
+    auto band_end = [&](int64_t start) -> int64_t
+    {
+        if (model.line_time_s <= 0.0)
         {
-            p_width.setValue(*std::min_element(width_values.begin(), width_values.end()));
-            p_height.setValue(*std::min_element(height_values.begin(), height_values.end()));
+            return max;
         }
+        // a fit with negative overhead would split small heights endlessly
+        const double overhead = std::max(model.frame_overhead_s, 0.0);
+        double frame_time = overhead + model.line_time_s * (double)start;
+        double end = (1.25 * frame_time - overhead) / model.line_time_s;
+
+        // limit the number of bands for sensors without relevant overhead
+        int64_t h = std::max<int64_t>((int64_t)end, start + (max - min) / 64);
+        h = std::min<int64_t>(h, max);
+        h = min + ((h - min) / step) * step;
+        return std::max(h, start);
     };
 
-    auto set_max_resolution = [&] ()
+    std::vector<int64_t> ret;
+    int64_t start = min;
+    for (auto edge : edges)
     {
-        if (height_values.empty())
+        for (int64_t end = band_end(start); end < edge; end = band_end(start))
         {
-            p_width.setValue(width_max);
-            p_height.setValue(height_max);
+            ret.push_back(end);
+            start = end + step;
         }
-        else
-        {
-            p_width.setValue(*std::max_element(width_values.begin(), width_values.end()));
-            p_height.setValue(*std::max_element(height_values.begin(), height_values.end()));
-        }
-    };
+        ret.push_back(edge);
+        start = edge + step;
+    }
+    return ret;
+}
 
-    auto reset_resolution = [&] ()
-    {
-        p_width.setValue(width_current_value);
-        p_height.setValue(height_current_value);
-    };
 
+static void set_framerate_range(GstStructure* struc, double fps_min, double fps_max)
+{
+    int min_num = 0;
+    int min_den = 1;
+    int max_num = 0;
+    int max_den = 1;
 
-    auto p_fps = props.findFloat("AcquisitionFrameRate");
+    gst_util_double_to_fraction(fps_min, &min_num, &min_den);
+    gst_util_double_to_fraction(fps_max, &max_num, &max_den);
 
-    int fps_min_num;
-    int fps_min_den;
-    int fps_max_num;
-    int fps_max_den;
+    GValue val_fps = G_VALUE_INIT;
+    g_value_init(&val_fps, GST_TYPE_FRACTION_RANGE);
+    gst_value_set_fraction_range_full(&val_fps, min_num, min_den, max_num, max_den);
 
-    std::vector<double> fps_values;
-    GValue fps = G_VALUE_INIT;
+    gst_structure_take_value(struc, "framerate", &val_fps);
+}
 
-    // all fpd cameras have ranges
-    // v4l2 usb2 cameras all have value sets
-    if (p_fps.incrementMode() != ic4::PropIncrementMode::ValueSet)
-    {
 
-        set_max_resolution();
+/**
+ * Readout mode that reduces the image size by a fixed factor.
+ * Only symmetric modes are offered, e.g. 2x2 binning.
+ */
+struct readout_mode
+{
+    int binning;
+    int skipping;
+};
 
-        double fps_min;
-        fps_min = p_fps.minimum();
 
-        set_min_resolution();
+/**
+ * Factors supported by the horizontal and the vertical property.
+ * 1 is always part of the list.
+ */
+static std::vector<int> get_mode_factors(ic4::PropertyMap& props,
+                                         const char* horizontal,
+                                         const char* vertical)
+{
+    std::vector<int> ret = { 1 };
 
-        double fps_max;
-        fps_max = p_fps.maximum();
+    ic4::Error err;
+    auto p_x = props.findInteger(horizontal, err);
+    auto p_y = props.findInteger(vertical, err);
 
-        gst_util_double_to_fraction(fps_min, &fps_min_num, &fps_min_den);
-        gst_util_double_to_fraction(fps_max, &fps_max_num, &fps_max_den);
+    if (!p_x.is_valid() || !p_y.is_valid())
+    {
+        return ret;
     }
-    else
+
+    auto get_values = [&err](ic4::PropInteger& p) -> std::vector<int64_t>
     {
-        set_min_resolution();
-        auto fps_values_min = p_fps.validValueSet();
-        set_max_resolution();
-        auto fps_values_max = p_fps.validValueSet();
+        if (p.incrementMode(err) == ic4::PropIncrementMode::ValueSet)
+        {
+            return p.validValueSet(err);
+        }
 
-        auto add_if = [] (std::vector<double>& vector_to_add,
-                          const std::vector<double>& vector_from)
+        std::vector<int64_t> values;
+        const int64_t step = std::max<int64_t>(p.increment(err), 1);
+        // no sensor bins more than 16 pixels
+        const int64_t max = std::min<int64_t>(p.maximum(err), 16);
+        for (int64_t i = p.minimum(err); i <= max; i += step)
         {
-            for (const auto& v : vector_from)
-            {
-                if (std::find(vector_to_add.begin(), 
-                              vector_to_add.end(), v) == vector_to_add.end())
-                {
-                    vector_to_add.push_back(v);
-                }
-            };
-        };
+            values.push_back(i);
+        }
+        return values;
+    };
 
-        add_if(fps_values, fps_values_min);
-        add_if(fps_values, fps_values_max);
+    const auto values_x = get_values(p_x);
+    const auto values_y = get_values(p_y);
 
-        g_value_init(&fps, GST_TYPE_LIST);
-        for (const auto& val : fps_values)
+    for (auto v : values_x)
+    {
+        if (v > 1 && std::find(values_y.begin(), values_y.end(), v) != values_y.end())
         {
-            int fps_num;
-            int fps_den;
-            gst_util_double_to_fraction(val, &fps_num, &fps_den);
+            ret.push_back((int)v);
+        }
+    }
+    return ret;
+}
+
 
-            GValue v = G_VALUE_INIT;
-            g_value_init(&v, GST_TYPE_FRACTION);
+static int64_t get_current_factor(ic4::PropertyMap& props, const char* name)
+{
+    ic4::Error err;
+    auto p = props.findInteger(name, err);
 
-            gst_value_set_fraction(&v, fps_num, fps_den);
+    if (!p.is_valid())
+    {
+        return 1;
+    }
 
-            gst_value_list_append_value(&fps, &v);
+    auto val = p.getValue(err);
+    return (err.isSuccess() && val > 0) ? val : 1;
+}
+
+
+bool ic4::gst::can_convert(ic4::PixelFormat in, ic4::PixelFormat out)
+{
+    if (is_repacked_format(out))
+    {
+        // unknown to IC4
+        return can_repack(in, out);
+    }
+    return can_unpack(in, out) || ic4::canTransform(in, out);
+}
+
+
+GstCaps* ic4::gst::create_caps(ic4::PropertyMap& props, const fps_model& model)
+{
+    const auto binning = get_mode_factors(props, "BinningHorizontal", "BinningVertical");
+    const auto skipping = get_mode_factors(props, "DecimationHorizontal", "DecimationVertical");
 
+    // every readout mode gets its own caps structures,
+    // binning is listed last, that way negotiation prefers it over skipping
+    std::vector<readout_mode> modes = { { 1, 1 } };
+    for (auto s : skipping)
+    {
+        if (s > 1)
+        {
+            modes.push_back({ 1, s });
+        }
+    }
+    for (auto b : binning)
+    {
+        if (b > 1)
+        {
+            modes.push_back({ b, 1 });
         }
     }
 
-    reset_resolution();
+    auto p_fmt = props.findEnumeration("PixelFormat");
 
-    // if (has_binning)
-    // {
-    //     const auto& bin_x = p_bin_x.asInteger();
-    //     auto entries = bin_x.validValueSet();
+    auto p_width = props.findInteger("Width");
+    int64_t width_min = 0;
+    int64_t width_max = 0;
+    int64_t width_step = 0;
 
-    //     // not a valueSet; determine via range
-    //     if (entries.empty())
-    //     {
-    //         for (int i = bin_x.minimum(); i <= bin_x.maximum(); i++)
-    //         {
-    //             // TODO: does a camera exist with 8x binning
-    //             if (i == 3)
-    //             {
-    //                 continue;
-    //             }
+    std::vector<int64_t> width_values;
 
-    //             entries.push_back(i);
-    //         }
+    if (p_width.incrementMode() == ic4::PropIncrementMode::Increment)
+    {
+        width_min = p_width.minimum();
+        width_max = p_width.maximum();
+        width_step = p_width.increment();
+    }
+    else
+    {
+        width_values = p_width.validValueSet();
+    }
 
-    //     }
+    auto p_height = props.findInteger("Height");
+    int64_t height_min = 0;
+    int64_t height_max = 0;
+    int64_t height_step = 0;
 
-    //     for (const auto& e: entries)
-    //     {
-    //         gst_binning_entries.push_back(fmt::format("{}x{}", e, e));
-    //     }
+    std::vector<int64_t> height_values;
+
+    if (p_height.incrementMode() == ic4::PropIncrementMode::Increment)
+    {
+        height_min = p_height.minimum();
+        height_max = p_height.maximum();
+        height_step = p_height.increment();
 
-    //     // //gst_value_array_init(&binning, gst_binning_entries.size());
-    //     // gst_value_list_init(&binning, gst_binning_entries.size());
+        // fix for 23G cameras, can give weird settings like step=4 max=602
+        auto mod = height_max % height_step;
+        if (mod != 0)
+        {
+            height_max -= mod;
+        }
+
+    }
+    else
+    {
+        height_values = p_height.validValueSet();
+    }
+
+    auto p_fps = props.findFloat("AcquisitionFrameRate");
+
+    // only the limits for the current configuration can be read,
+    // the model gives the maximum for every other height.
+    // the device is never written to
+    double fps_min = 0.0;
+    double fps_max = 0.0;
+
+    // all fpd cameras have ranges
+    // v4l2 usb2 cameras all have value sets
+    if (p_fps.incrementMode() != ic4::PropIncrementMode::ValueSet)
+    {
+        fps_min = p_fps.minimum();
+        fps_max = p_fps.maximum();
+    }
+    else
+    {
+        auto fps_values = p_fps.validValueSet();
+        if (!fps_values.empty())
+        {
+            fps_min = *std::min_element(fps_values.begin(), fps_values.end());
+            fps_max = *std::max_element(fps_values.begin(), fps_values.end());
+        }
+    }
 
-    //     // // transform entries into something gstreamer can use
-    //     // for (const auto& e: gst_binning_entries)
-    //     // {
-    //     //     GValue entry = G_VALUE_INIT;
-    //     //     g_value_init(&entry, G_TYPE_STRING);
-    //     //     g_value_set_string(&entry, e.c_str());
+    // highest framerate images of the given size can be delivered with
+    // when the device transfers bits_per_pixel
+    auto get_fps_max = [&](int64_t width, int64_t height, int bits_per_pixel) -> double
+    {
+        if (!model.calibrated)
+        {
+            return fps_max;
+        }
+        return std::max(model.max_fps(height, bits_per_pixel, width), fps_min);
+    };
 
-    //     //     gst_value_list_append_value(&binning, &entry);
-    //     //     //gst_value_array_append_value(&binning, &entry);
-    //     // }
+    // only devices that offer a choice get the mode fields
+    auto set_mode_fields = [&binning, &skipping](GstStructure* s, const readout_mode& mode)
+    {
+        if (binning.size() > 1)
+        {
+            auto str = fmt::format("{}x{}", mode.binning, mode.binning);
+            gst_structure_set(s, "binning", G_TYPE_STRING, str.c_str(), nullptr);
+        }
+        if (skipping.size() > 1)
+        {
+            auto str = fmt::format("{}x{}", mode.skipping, mode.skipping);
+            gst_structure_set(s, "skipping", G_TYPE_STRING, str.c_str(), nullptr);
+        }
+    };
 
-    // }
+    // Width/Height limits are those of the active readout mode,
+    // scale them back to the full sensor
+    const int64_t current_factor_x = get_current_factor(props, "BinningHorizontal")
+                                     * get_current_factor(props, "DecimationHorizontal");
+    const int64_t current_factor_y = get_current_factor(props, "BinningVertical")
+                                     * get_current_factor(props, "DecimationVertical");
+    const int64_t sensor_width = width_max * current_factor_x;
+    const int64_t sensor_height = height_max * current_factor_y;
 
     GstCaps* caps = gst_caps_new_empty();
 
@@ -397,6 +555,10 @@ GstCaps* ic4::gst::create_caps(ic4::PropertyMap& props)
 
         auto fmt = fmt_ret.value();
 
+        // the link transfers the device format, converted formats
+        // are limited by the smallest device format they can be converted from
+        int link_bpp = fmt.bits_per_pixel;
+
         GstStructure* struc_base = gst_structure_new(fmt.gst_name,
                                             "format", G_TYPE_STRING, fmt.gst_format,
                                             nullptr);
@@ -414,10 +576,15 @@ GstCaps* ic4::gst::create_caps(ic4::PropertyMap& props)
             {
                 auto in = gst_format_to_pixel_format(dev_fmt.c_str());
 
-                if (!ic4::canTransform(in, fmt.ic4_format))
+                if (!can_convert(in, fmt.ic4_format))
                 {
                     continue;
                 }
+                int bpp = get_bits_per_pixel(in);
+                if (bpp > 0 && (gst_value_list_get_size(&format_list) == 0 || bpp < link_bpp))
+                {
+                    link_bpp = bpp;
+                }
                 GValue entry = G_VALUE_INIT;
                 g_value_init(&entry, G_TYPE_STRING);
 
@@ -431,55 +598,85 @@ GstCaps* ic4::gst::create_caps(ic4::PropertyMap& props)
 
         }
 
-        // 
-        // fps
-        //
-
-        GValue val_fps = G_VALUE_INIT;
-        g_value_init(&val_fps, GST_TYPE_FRACTION_RANGE);
-        gst_value_set_fraction_range_full(
-            &val_fps, fps_min_num, fps_min_den, fps_max_num, fps_max_den);
-
-        gst_structure_take_value(struc_base, "framerate", &val_fps);
-
         //
         // width / height
         //
 
         // helper function
-        // adding resolutions needs to be done multiple times for binning
-        auto add_res_range = [caps, struc_base] (int width_min, int width_max, int width_step,
-                                                int height_min, int height_max, int height_step, 
-                                                int binning)
+        // adding resolutions needs to be done once per readout mode
+        auto add_res_range = [&, caps, struc_base] (int width_min, int width_max, int width_step,
+                                                    int height_min, int height_max, int height_step,
+                                                    const readout_mode& mode)
         {
-            GstStructure* s = gst_structure_copy(struc_base);
-            GValue val_width = G_VALUE_INIT;
-            GValue val_height = G_VALUE_INIT;
+            int w_max = width_max / (mode.binning * mode.skipping);
+            int h_max = height_max / (mode.binning * mode.skipping);
 
-            int w_max = width_max / binning;
-            int h_max = height_max / binning;
+            // the reduced maximum has to be reachable from the minimum
+            w_max -= (w_max - width_min) % width_step;
+            h_max -= (h_max - height_min) % height_step;
 
-            g_value_init(&val_width, GST_TYPE_INT_RANGE);
-            gst_value_set_int_range_step(&val_width, width_min, w_max, width_step);
+            if (w_max < width_min || h_max < height_min)
+            {
+                return;
+            }
 
-            g_value_init(&val_height, GST_TYPE_INT_RANGE);
-            gst_value_set_int_range_step(&val_height, height_min, h_max, height_step);
+            // the framerate depends on the height,
+            // every band gets the maximum of its largest height
+            std::vector<int64_t> bands = { h_max };
+            if (model.calibrated)
+            {
+                bands = get_height_bands(model, height_min, h_max, height_step);
+            }
 
+            int64_t band_min = height_min;
 
-            gst_structure_take_value(s, "width", &val_width);
-            gst_structure_take_value(s, "height", &val_height);
+            for (auto band_max : bands)
+            {
+                GstStructure* s = gst_structure_copy(struc_base);
+                GValue val_width = G_VALUE_INIT;
+                GValue val_height = G_VALUE_INIT;
 
-            // caps now owns s
-            gst_caps_append_structure(caps, s);
+                g_value_init(&val_width, GST_TYPE_INT_RANGE);
+                gst_value_set_int_range_step(&val_width, width_min, w_max, width_step);
+
+                if (band_min == band_max)
+                {
+                    g_value_init(&val_height, G_TYPE_INT);
+                    g_value_set_int(&val_height, (int)band_max);
+                }
+                else
+                {
+                    g_value_init(&val_height, GST_TYPE_INT_RANGE);
+                    gst_value_set_int_range_step(&val_height, (int)band_min, (int)band_max, height_step);
+                }
+
+                gst_structure_take_value(s, "width", &val_width);
+                gst_structure_take_value(s, "height", &val_height);
+
+                // the widest frame of the mode determines the link load
+                set_framerate_range(s, fps_min, get_fps_max(w_max, band_max, link_bpp));
+
+                band_min = band_max + height_step;
+
+                set_mode_fields(s, mode);
+
+                // caps now owns s
+                gst_caps_append_structure(caps, s);
+            }
 
         };
 
 
         if (do_ranges)
         {
-            add_res_range(width_min, width_max, width_step,
-                          height_min, height_max, height_step,
-                          1);
+            for (const auto& mode : modes)
+            {
+                add_res_range(width_min, sensor_width, width_step,
+                              height_min, sensor_height, height_step,
+                              mode);
+            }
+            // only copies have been appended
+            gst_structure_free(struc_base);
         }
         else
         {
@@ -519,22 +716,43 @@ GstCaps* ic4::gst::create_caps(ic4::PropertyMap& props)
             g_value_init(&val_width, GST_TYPE_LIST);
             g_value_init(&val_height, GST_TYPE_LIST);
 
-            for (const auto& r : res)
+            for (const auto& mode : modes)
             {
-                GstStructure* s2 = gst_structure_copy(struc_base);
+                const int factor = mode.binning * mode.skipping;
+
+                for (const auto& r : res)
+                {
+                    // the values are those of the active mode, scale them to the sensor
+                    const int64_t mode_width = r.width * current_factor_x;
+                    const int64_t mode_height = r.height * current_factor_y;
+
+                    if (mode_width % factor != 0 || mode_height % factor != 0)
+                    {
+                        continue;
+                    }
 
-                GValue w = G_VALUE_INIT;
-                g_value_init(&w, G_TYPE_INT);
-                g_value_set_int(&w, r.width);
+                    GstStructure* s2 = gst_structure_copy(struc_base);
 
-                GValue h = G_VALUE_INIT;
-                g_value_init(&h, G_TYPE_INT);
-                g_value_set_int(&h, r.height);
+                    GValue w = G_VALUE_INIT;
+                    g_value_init(&w, G_TYPE_INT);
+                    g_value_set_int(&w, (int)(mode_width / factor));
 
-                gst_structure_take_value(s2, "width", &w);
-                gst_structure_take_value(s2, "height", &h);
+                    GValue h = G_VALUE_INIT;
+                    g_value_init(&h, G_TYPE_INT);
+                    g_value_set_int(&h, (int)(mode_height / factor));
 
-                gst_caps_append_structure(caps, s2);
+                    gst_structure_take_value(s2, "width", &w);
+                    gst_structure_take_value(s2, "height", &h);
+
+                    set_framerate_range(s2,
+                                        fps_min,
+                                        get_fps_max(mode_width / factor,
+                                                    mode_height / factor,
+                                                    link_bpp));
+                    set_mode_fields(s2, mode);
+
+                    gst_caps_append_structure(caps, s2);
+                }
             }
             // since not appended, must be freed
             gst_structure_free(struc_base);
@@ -560,6 +778,17 @@ GstCaps* ic4::gst::create_caps(ic4::PropertyMap& props)
         auto dev_pix = ic4::PixelFormat(dev_fmt.intValue());
         auto transform_fmts = ic4::enumTransforms(dev_pix);
 
+        // packed formats are unpacked by ic4src itself
+        if (auto unpacked = get_unpacked_format(dev_pix); unpacked != ic4::PixelFormat::Invalid)
+        {
+            transform_fmts.push_back(unpacked);
+        }
+        // so are the GStreamer formats without an ic4::PixelFormat
+        for (auto repacked : get_repacked_formats(dev_pix))
+        {
+            transform_fmts.push_back(repacked);
+        }
+
         // debug print input-> available conversion
         // {
         //     std::string s;
@@ -580,11 +809,11 @@ GstCaps* ic4::gst::create_caps(ic4::PropertyMap& props)
             }
             if (std::find_if(artificial_fmt.begin(), artificial_fmt.end(),
                              [t](const auto &name) {
-                                 return name == ic4::to_string(t);}) != artificial_fmt.end())
+                                 return name == get_pixel_format_name(t);}) != artificial_fmt.end())
             {
                 continue;
             }
-            artificial_fmt.push_back(ic4::to_string(t));
+            artificial_fmt.push_back(get_pixel_format_name(t));
         }
     }
 
@@ -593,5 +822,10 @@ GstCaps* ic4::gst::create_caps(ic4::PropertyMap& props)
 
     add_to_caps(caps, artificial_fmt, true);
 
-    return caps;
+    // one structure per format and resolution band adds up to hundreds of structures,
+    // negotiation only has to intersect the merged form
+    GstCaps* merged = merge_caps(caps);
+    gst_caps_unref(caps);
+
+    return merged;
 }
@@ -2,13 +2,38 @@
 
 #pragma once
 
+#include "fps_model.h"
 #include "ic4/Properties.h"
 #include <gst/gst.h>
 #include <ic4/ic4.h>
 
+#include <cstdint>
+#include <optional>
+
 namespace ic4::gst
 {
 
-GstCaps* create_caps(ic4::PropertyMap&);
+/**
+ * Determine the model by writing the smallest and largest resolution
+ * and reading the framerate limits. The resolution is restored afterwards.
+ * The active pixel format and link throughput limit are recorded with the model.
+ * Must only be called while the device is not streaming.
+ * Returns nullopt for devices that cannot be described by the model.
+ */
+std::optional<fps_model> calibrate_fps_model(ic4::PropertyMap&);
+
+/**
+ * Whether frames of in can be delivered as out,
+ * either through an ic4 transform or by unpacking or repacking them in ic4src.
+ */
+bool can_convert(ic4::PixelFormat in, ic4::PixelFormat out);
+
+/**
+ * Generate caps for the current device configuration.
+ * Only reads from the device, framerate limits for other resolutions
+ * are taken from model if it is calibrated, scaled to the bits per pixel of every format.
+ * Formats sharing all other fields are merged into format lists, see merge_caps.
+ */
+GstCaps* create_caps(ic4::PropertyMap&, const fps_model& model);
 
 } //namespace ic4::gst
@@ -0,0 +1,85 @@
+
+#include "memfd_allocator.h"
+
+#include "gst_tcam_ic4_src.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define GST_CAT_DEFAULT ic4_src_debug
+
+
+void* ic4::gst::memfd_allocator::allocate_buffer(size_t buffer_size,
+                                                 size_t alignment,
+                                                 void** buffer_context)
+{
+    // mmap only guarantees page alignment
+    if (alignment > (size_t)sysconf(_SC_PAGESIZE))
+    {
+        GST_ERROR("memfd buffers cannot be aligned to %zu bytes", alignment);
+        return nullptr;
+    }
+
+    int fd = memfd_create("ic4src", MFD_CLOEXEC);
+    if (fd < 0)
+    {
+        GST_ERROR("memfd_create failed: %s", strerror(errno));
+        return nullptr;
+    }
+
+    if (ftruncate(fd, (off_t)buffer_size) != 0)
+    {
+        GST_ERROR("Unable to resize memfd to %zu bytes: %s", buffer_size, strerror(errno));
+        close(fd);
+        return nullptr;
+    }
+
+    void* ptr = mmap(nullptr, buffer_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED)
+    {
+        GST_ERROR("Unable to map memfd: %s", strerror(errno));
+        close(fd);
+        return nullptr;
+    }
+
+    {
+        std::lock_guard<std::mutex> lck(mtx_);
+        fds_[ptr] = fd;
+    }
+
+    *buffer_context = reinterpret_cast<void*>((intptr_t)fd);
+
+    GST_DEBUG("Allocated memfd %d with %zu bytes", fd, buffer_size);
+
+    return ptr;
+}
+
+
+void ic4::gst::memfd_allocator::free_buffer(void* buffer_ptr,
+                                            size_t buffer_size,
+                                            void* buffer_context)
+{
+    {
+        std::lock_guard<std::mutex> lck(mtx_);
+        fds_.erase(buffer_ptr);
+    }
+
+    munmap(buffer_ptr, buffer_size);
+    close((int)(intptr_t)buffer_context);
+}
+
+
+int ic4::gst::memfd_allocator::find_fd(const void* ptr) const
+{
+    std::lock_guard<std::mutex> lck(mtx_);
+
+    auto iter = fds_.find(ptr);
+    if (iter == fds_.end())
+    {
+        return -1;
+    }
+    return iter->second;
+}
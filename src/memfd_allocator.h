@@ -0,0 +1,33 @@
+
+#pragma once
+
+#include <ic4/ic4.h>
+
+#include <mutex>
+#include <unordered_map>
+
+namespace ic4::gst
+{
+
+/**
+ * ic4::BufferAllocator that backs every stream buffer with its own memfd.
+ *
+ * The fd of a buffer can be retrieved with find_fd, that way the
+ * GstBuffers pushed downstream can carry GstFdMemory which IPC elements
+ * pass on without copying the image.
+ */
+class memfd_allocator : public ic4::BufferAllocator
+{
+public:
+    void* allocate_buffer(size_t buffer_size, size_t alignment, void** buffer_context) final;
+    void free_buffer(void* buffer_ptr, size_t buffer_size, void* buffer_context) final;
+
+    // returns the fd backing ptr, -1 when ptr was not allocated by this allocator
+    int find_fd(const void* ptr) const;
+
+private:
+    mutable std::mutex mtx_;
+    std::unordered_map<const void*, int> fds_;
+};
+
+} // namespace ic4::gst
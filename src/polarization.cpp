@@ -0,0 +1,720 @@
+#include "polarization.h"
+
+#include "format.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define IC4_POLARIZATION_X86
+#endif
+
+namespace
+{
+
+using ic4::gst::polarization_kernel;
+using ic4::gst::polarization_mode;
+
+struct polarized_entry
+{
+    ic4::PixelFormat polarized;
+    ic4::PixelFormat angle;
+    bool mono;
+};
+
+constexpr polarized_entry polarized_table[] = {
+    { ic4::PixelFormat::PolarizedMono8, ic4::PixelFormat::Mono8, true },
+    { ic4::PixelFormat::PolarizedMono16, ic4::PixelFormat::Mono16, true },
+    { ic4::PixelFormat::PolarizedBayerBG8, ic4::PixelFormat::BayerBG8, false },
+    { ic4::PixelFormat::PolarizedBayerBG16, ic4::PixelFormat::BayerBG16, false },
+};
+
+
+const polarized_entry* find_entry(ic4::PixelFormat fmt)
+{
+    for (const auto& e : polarized_table)
+    {
+        if (e.polarized == fmt)
+        {
+            return &e;
+        }
+    }
+    return nullptr;
+}
+
+
+// angle planes in output order, index of 0, 45, 90 and 135 degree
+enum
+{
+    I0,
+    I45,
+    I90,
+    I135,
+};
+
+
+template<typename T>
+void split_reference(const T* upper, const T* lower, T* const angles[4], int width)
+{
+    for (int x = 0; x < width / 2; ++x)
+    {
+        angles[I90][x] = upper[2 * x];
+        angles[I45][x] = upper[2 * x + 1];
+        angles[I135][x] = lower[2 * x];
+        angles[I0][x] = lower[2 * x + 1];
+    }
+}
+
+
+/*
+ * AoLP and DoLP have to be identical for every kernel.
+ * The SIMD kernels perform the same single precision operations in the same order,
+ * which are exact IEEE operations without FMA, so the results match the scalar code.
+ *
+ * atan(t) for 0 <= t <= 1 is approximated by t * p(t^2),
+ * the full circle is rebuilt from the octant like atan2 does.
+ */
+constexpr float atan_coeffs[] = {
+    -0.01172120f, 0.05265332f, -0.11643287f, 0.19354346f, -0.33262347f, 0.99997726f,
+};
+
+constexpr float half_pi = 1.57079632679f;
+constexpr float pi = 3.14159265359f;
+constexpr float two_pi = 6.28318530718f;
+
+
+template<typename T>
+constexpr float max_value()
+{
+    return (float)std::numeric_limits<T>::max();
+}
+
+
+template<typename T>
+void aolp_dolp_reference(const T* const angles[4], T* aolp, T* dolp, int width)
+{
+    // atan2 covers 2 pi, AoLP half of it
+    const float aolp_scale = max_value<T>() / two_pi;
+
+    for (int x = 0; x < width; ++x)
+    {
+        const float i0 = angles[I0][x];
+        const float i45 = angles[I45][x];
+        const float i90 = angles[I90][x];
+        const float i135 = angles[I135][x];
+
+        const float s0 = ((i0 + i45) + (i90 + i135)) * 0.5f;
+        const float s1 = i0 - i90;
+        const float s2 = i45 - i135;
+
+        const float a1 = std::fabs(s1);
+        const float a2 = std::fabs(s2);
+        const float lo = a1 < a2 ? a1 : a2;
+        const float hi = a1 > a2 ? a1 : a2;
+
+        const float t = lo / (hi > FLT_MIN ? hi : FLT_MIN);
+        const float t2 = t * t;
+
+        float p = atan_coeffs[0];
+        for (int i = 1; i < 6; ++i)
+        {
+            p = p * t2 + atan_coeffs[i];
+        }
+        float r = p * t;
+
+        if (a2 > a1)
+        {
+            r = half_pi - r;
+        }
+        if (s1 < 0.0f)
+        {
+            r = pi - r;
+        }
+        if (s2 < 0.0f)
+        {
+            r = two_pi - r;
+        }
+
+        aolp[x] = (T)(r * aolp_scale + 0.5f);
+
+        float d = std::sqrt(s1 * s1 + s2 * s2) / (s0 > FLT_MIN ? s0 : FLT_MIN);
+        d = d < 1.0f ? d : 1.0f;
+
+        dolp[x] = (T)(d * max_value<T>() + 0.5f);
+    }
+}
+
+
+#ifdef IC4_POLARIZATION_X86
+
+/*
+ * The split kernels shuffle even pixels into the lower and odd pixels into the upper
+ * 8 bytes of each 16 byte lane and recombine the halves of two loads.
+ */
+
+template<typename T>
+__attribute__((target("sse4.1"))) inline __m128i split_shuffle_sse()
+{
+    if constexpr (sizeof(T) == 1)
+    {
+        return _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+    }
+    else
+    {
+        return _mm_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13, 2, 3, 6, 7, 10, 11, 14, 15);
+    }
+}
+
+
+template<typename T>
+__attribute__((target("sse4.1"))) inline void split_line_sse(const T* in, T* even, T* odd, int x)
+{
+    // x counts output pixels, 32 input bytes become 16 bytes of each output
+    constexpr int step = 16 / sizeof(T);
+    const __m128i shuffle = split_shuffle_sse<T>();
+
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * x));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * x + step));
+    a = _mm_shuffle_epi8(a, shuffle);
+    b = _mm_shuffle_epi8(b, shuffle);
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(even + x), _mm_unpacklo_epi64(a, b));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(odd + x), _mm_unpackhi_epi64(a, b));
+}
+
+
+template<typename T>
+__attribute__((target("sse4.1"))) void split_sse41(const T* upper,
+                                                    const T* lower,
+                                                    T* const angles[4],
+                                                    int width)
+{
+    constexpr int step = 16 / sizeof(T);
+    const int half = width / 2;
+    int x = 0;
+
+    for (; x + step <= half; x += step)
+    {
+        split_line_sse(upper, angles[I90], angles[I45], x);
+        split_line_sse(lower, angles[I135], angles[I0], x);
+    }
+
+    T* const rest[4] = { angles[0] + x, angles[1] + x, angles[2] + x, angles[3] + x };
+    split_reference(upper + 2 * x, lower + 2 * x, rest, width - 2 * x);
+}
+
+
+template<typename T>
+__attribute__((target("avx2"))) inline void split_line_avx2(const T* in, T* even, T* odd, int x)
+{
+    constexpr int step = 32 / sizeof(T);
+    const __m256i shuffle = _mm256_broadcastsi128_si256(split_shuffle_sse<T>());
+
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + 2 * x));
+    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + 2 * x + step));
+    a = _mm256_shuffle_epi8(a, shuffle);
+    b = _mm256_shuffle_epi8(b, shuffle);
+
+    // the unpacks work within 128 bit lanes, the permute restores the order of a and b
+    __m256i e = _mm256_permute4x64_epi64(_mm256_unpacklo_epi64(a, b), 0xD8);
+    __m256i o = _mm256_permute4x64_epi64(_mm256_unpackhi_epi64(a, b), 0xD8);
+
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(even + x), e);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(odd + x), o);
+}
+
+
+template<typename T>
+__attribute__((target("avx2"))) void split_avx2(const T* upper,
+                                                const T* lower,
+                                                T* const angles[4],
+                                                int width)
+{
+    constexpr int step = 32 / sizeof(T);
+    const int half = width / 2;
+    int x = 0;
+
+    for (; x + step <= half; x += step)
+    {
+        split_line_avx2(upper, angles[I90], angles[I45], x);
+        split_line_avx2(lower, angles[I135], angles[I0], x);
+    }
+
+    T* const rest[4] = { angles[0] + x, angles[1] + x, angles[2] + x, angles[3] + x };
+    split_sse41(upper + 2 * x, lower + 2 * x, rest, width - 2 * x);
+}
+
+
+// the operations of aolp_dolp_reference, 4 pixels at once
+__attribute__((target("sse4.1"))) inline void stokes_sse(__m128 i0,
+                                                         __m128 i45,
+                                                         __m128 i90,
+                                                         __m128 i135,
+                                                         float max,
+                                                         __m128i& aolp,
+                                                         __m128i& dolp)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+
+    __m128 s0 = _mm_mul_ps(_mm_add_ps(_mm_add_ps(i0, i45), _mm_add_ps(i90, i135)),
+                           _mm_set1_ps(0.5f));
+    __m128 s1 = _mm_sub_ps(i0, i90);
+    __m128 s2 = _mm_sub_ps(i45, i135);
+
+    __m128 a1 = _mm_and_ps(s1, abs_mask);
+    __m128 a2 = _mm_and_ps(s2, abs_mask);
+    __m128 lo = _mm_min_ps(a1, a2);
+    __m128 hi = _mm_max_ps(a1, a2);
+
+    __m128 t = _mm_div_ps(lo, _mm_max_ps(hi, _mm_set1_ps(FLT_MIN)));
+    __m128 t2 = _mm_mul_ps(t, t);
+
+    __m128 p = _mm_set1_ps(atan_coeffs[0]);
+    for (int i = 1; i < 6; ++i)
+    {
+        p = _mm_add_ps(_mm_mul_ps(p, t2), _mm_set1_ps(atan_coeffs[i]));
+    }
+    __m128 r = _mm_mul_ps(p, t);
+
+    r = _mm_blendv_ps(r, _mm_sub_ps(_mm_set1_ps(half_pi), r), _mm_cmpgt_ps(a2, a1));
+    r = _mm_blendv_ps(r, _mm_sub_ps(_mm_set1_ps(pi), r), _mm_cmplt_ps(s1, zero));
+    r = _mm_blendv_ps(r, _mm_sub_ps(_mm_set1_ps(two_pi), r), _mm_cmplt_ps(s2, zero));
+
+    __m128 a = _mm_add_ps(_mm_mul_ps(r, _mm_set1_ps(max / two_pi)), _mm_set1_ps(0.5f));
+    aolp = _mm_cvttps_epi32(a);
+
+    __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(s1, s1), _mm_mul_ps(s2, s2)));
+    __m128 d = _mm_div_ps(len, _mm_max_ps(s0, _mm_set1_ps(FLT_MIN)));
+    d = _mm_min_ps(d, _mm_set1_ps(1.0f));
+    dolp = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(d, _mm_set1_ps(max)), _mm_set1_ps(0.5f)));
+}
+
+
+template<typename T>
+__attribute__((target("sse4.1"))) inline __m128 load4_sse(const T* src)
+{
+    if constexpr (sizeof(T) == 1)
+    {
+        int32_t v;
+        memcpy(&v, src, sizeof(v));
+        return _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(v)));
+    }
+    else
+    {
+        __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src));
+        return _mm_cvtepi32_ps(_mm_cvtepu16_epi32(v));
+    }
+}
+
+
+template<typename T>
+__attribute__((target("sse4.1"))) inline void store4_sse(T* dst, __m128i v)
+{
+    // the values are in range, the saturation never clamps
+    __m128i v16 = _mm_packus_epi32(v, v);
+    if constexpr (sizeof(T) == 1)
+    {
+        int32_t out = _mm_cvtsi128_si32(_mm_packus_epi16(v16, v16));
+        memcpy(dst, &out, sizeof(out));
+    }
+    else
+    {
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst), v16);
+    }
+}
+
+
+template<typename T>
+__attribute__((target("sse4.1"))) void aolp_dolp_sse41(const T* const angles[4],
+                                                        T* aolp,
+                                                        T* dolp,
+                                                        int width)
+{
+    int x = 0;
+
+    for (; x + 4 <= width; x += 4)
+    {
+        __m128i a;
+        __m128i d;
+        stokes_sse(load4_sse(angles[I0] + x),
+                   load4_sse(angles[I45] + x),
+                   load4_sse(angles[I90] + x),
+                   load4_sse(angles[I135] + x),
+                   max_value<T>(),
+                   a,
+                   d);
+        store4_sse(aolp + x, a);
+        store4_sse(dolp + x, d);
+    }
+
+    const T* const rest[4] = { angles[0] + x, angles[1] + x, angles[2] + x, angles[3] + x };
+    aolp_dolp_reference(rest, aolp + x, dolp + x, width - x);
+}
+
+
+// the operations of aolp_dolp_reference, 8 pixels at once
+__attribute__((target("avx2"))) inline void stokes_avx2(__m256 i0,
+                                                        __m256 i45,
+                                                        __m256 i90,
+                                                        __m256 i135,
+                                                        float max,
+                                                        __m256i& aolp,
+                                                        __m256i& dolp)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+
+    __m256 s0 = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(i0, i45), _mm256_add_ps(i90, i135)),
+                              _mm256_set1_ps(0.5f));
+    __m256 s1 = _mm256_sub_ps(i0, i90);
+    __m256 s2 = _mm256_sub_ps(i45, i135);
+
+    __m256 a1 = _mm256_and_ps(s1, abs_mask);
+    __m256 a2 = _mm256_and_ps(s2, abs_mask);
+    __m256 lo = _mm256_min_ps(a1, a2);
+    __m256 hi = _mm256_max_ps(a1, a2);
+
+    __m256 t = _mm256_div_ps(lo, _mm256_max_ps(hi, _mm256_set1_ps(FLT_MIN)));
+    __m256 t2 = _mm256_mul_ps(t, t);
+
+    __m256 p = _mm256_set1_ps(atan_coeffs[0]);
+    for (int i = 1; i < 6; ++i)
+    {
+        p = _mm256_add_ps(_mm256_mul_ps(p, t2), _mm256_set1_ps(atan_coeffs[i]));
+    }
+    __m256 r = _mm256_mul_ps(p, t);
+
+    r = _mm256_blendv_ps(r,
+                         _mm256_sub_ps(_mm256_set1_ps(half_pi), r),
+                         _mm256_cmp_ps(a2, a1, _CMP_GT_OQ));
+    r = _mm256_blendv_ps(r,
+                         _mm256_sub_ps(_mm256_set1_ps(pi), r),
+                         _mm256_cmp_ps(s1, zero, _CMP_LT_OQ));
+    r = _mm256_blendv_ps(r,
+                         _mm256_sub_ps(_mm256_set1_ps(two_pi), r),
+                         _mm256_cmp_ps(s2, zero, _CMP_LT_OQ));
+
+    __m256 a = _mm256_add_ps(_mm256_mul_ps(r, _mm256_set1_ps(max / two_pi)), _mm256_set1_ps(0.5f));
+    aolp = _mm256_cvttps_epi32(a);
+
+    __m256 len = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(s1, s1), _mm256_mul_ps(s2, s2)));
+    __m256 d = _mm256_div_ps(len, _mm256_max_ps(s0, _mm256_set1_ps(FLT_MIN)));
+    d = _mm256_min_ps(d, _mm256_set1_ps(1.0f));
+    dolp = _mm256_cvttps_epi32(
+        _mm256_add_ps(_mm256_mul_ps(d, _mm256_set1_ps(max)), _mm256_set1_ps(0.5f)));
+}
+
+
+template<typename T>
+__attribute__((target("avx2"))) inline __m256 load8_avx2(const T* src)
+{
+    if constexpr (sizeof(T) == 1)
+    {
+        __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src));
+        return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(v));
+    }
+    else
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+        return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(v));
+    }
+}
+
+
+template<typename T>
+__attribute__((target("avx2"))) inline void store8_avx2(T* dst, __m256i v)
+{
+    // the values are in range, the saturation never clamps
+    __m128i v16 = _mm_packus_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    if constexpr (sizeof(T) == 1)
+    {
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst), _mm_packus_epi16(v16, v16));
+    }
+    else
+    {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), v16);
+    }
+}
+
+
+template<typename T>
+__attribute__((target("avx2"))) void aolp_dolp_avx2(const T* const angles[4],
+                                                    T* aolp,
+                                                    T* dolp,
+                                                    int width)
+{
+    int x = 0;
+
+    for (; x + 8 <= width; x += 8)
+    {
+        __m256i a;
+        __m256i d;
+        stokes_avx2(load8_avx2(angles[I0] + x),
+                    load8_avx2(angles[I45] + x),
+                    load8_avx2(angles[I90] + x),
+                    load8_avx2(angles[I135] + x),
+                    max_value<T>(),
+                    a,
+                    d);
+        store8_avx2(aolp + x, a);
+        store8_avx2(dolp + x, d);
+    }
+
+    const T* const rest[4] = { angles[0] + x, angles[1] + x, angles[2] + x, angles[3] + x };
+    aolp_dolp_sse41(rest, aolp + x, dolp + x, width - x);
+}
+
+#endif /* IC4_POLARIZATION_X86 */
+
+
+template<typename T>
+void split(polarization_kernel kernel,
+           const T* upper,
+           const T* lower,
+           T* const angles[4],
+           int width)
+{
+    switch (kernel)
+    {
+#ifdef IC4_POLARIZATION_X86
+        case polarization_kernel::sse41:
+            split_sse41(upper, lower, angles, width);
+            return;
+        case polarization_kernel::avx2:
+            split_avx2(upper, lower, angles, width);
+            return;
+#endif
+        default:
+            split_reference(upper, lower, angles, width);
+            return;
+    }
+}
+
+
+template<typename T>
+void aolp_dolp(polarization_kernel kernel, const T* const angles[4], T* aolp, T* dolp, int width)
+{
+    switch (kernel)
+    {
+#ifdef IC4_POLARIZATION_X86
+        case polarization_kernel::sse41:
+            aolp_dolp_sse41(angles, aolp, dolp, width);
+            return;
+        case polarization_kernel::avx2:
+            aolp_dolp_avx2(angles, aolp, dolp, width);
+            return;
+#endif
+        default:
+            aolp_dolp_reference(angles, aolp, dolp, width);
+            return;
+    }
+}
+
+
+template<typename T>
+void split_frame(const ic4::gst::image_view& src,
+                 polarization_mode mode,
+                 const ic4::gst::image_view& dst,
+                 std::span<uint8_t> scratch)
+{
+    static const polarization_kernel kernel = ic4::gst::available_polarization_kernels().back();
+
+    const int width = dst.width;
+    const int plane_height = src.height / 2;
+
+    auto line = [&](int plane, int y)
+    { return reinterpret_cast<T*>(dst.data + (size_t)(plane * plane_height + y) * dst.pitch); };
+
+    // without angle planes in the output the angles only pass through scratch
+    T* angle_lines = mode == polarization_mode::aolp_dolp ? reinterpret_cast<T*>(scratch.data())
+                                                          : nullptr;
+
+    for (int y = 0; y < plane_height; ++y)
+    {
+        const T* upper = reinterpret_cast<const T*>(src.data + (size_t)(2 * y) * src.pitch);
+        const T* lower = reinterpret_cast<const T*>(src.data + (size_t)(2 * y + 1) * src.pitch);
+
+        T* angles[4];
+        for (int i = 0; i < 4; ++i)
+        {
+            angles[i] = angle_lines ? angle_lines + i * width : line(i, y);
+        }
+
+        split(kernel, upper, lower, angles, src.width);
+
+        if (mode != polarization_mode::angles)
+        {
+            const int first = mode == polarization_mode::all ? 4 : 0;
+            aolp_dolp<T>(kernel, angles, line(first, y), line(first + 1, y), width);
+        }
+    }
+}
+
+} // namespace
+
+
+int ic4::gst::polarization_planes(polarization_mode mode)
+{
+    switch (mode)
+    {
+        case polarization_mode::angles:
+            return 4;
+        case polarization_mode::aolp_dolp:
+            return 2;
+        case polarization_mode::all:
+            return 6;
+    }
+    return 0;
+}
+
+
+ic4::PixelFormat ic4::gst::get_angle_format(ic4::PixelFormat fmt)
+{
+    auto entry = find_entry(fmt);
+    return entry ? entry->angle : ic4::PixelFormat::Invalid;
+}
+
+
+ic4::PixelFormat ic4::gst::get_polarized_format(ic4::PixelFormat angle_format)
+{
+    for (const auto& e : polarized_table)
+    {
+        if (e.angle == angle_format)
+        {
+            return e.polarized;
+        }
+    }
+    return ic4::PixelFormat::Invalid;
+}
+
+
+bool ic4::gst::can_compute_aolp_dolp(ic4::PixelFormat fmt)
+{
+    auto entry = find_entry(fmt);
+    return entry && entry->mono;
+}
+
+
+const char* ic4::gst::to_string(polarization_kernel kernel)
+{
+    switch (kernel)
+    {
+        case polarization_kernel::reference:
+            return "reference";
+        case polarization_kernel::sse41:
+            return "sse4.1";
+        case polarization_kernel::avx2:
+            return "avx2";
+    }
+    return "unknown";
+}
+
+
+std::vector<ic4::gst::polarization_kernel> ic4::gst::available_polarization_kernels()
+{
+    std::vector<polarization_kernel> kernels = { polarization_kernel::reference };
+
+#ifdef IC4_POLARIZATION_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.1"))
+    {
+        kernels.push_back(polarization_kernel::sse41);
+
+        if (__builtin_cpu_supports("avx2"))
+        {
+            kernels.push_back(polarization_kernel::avx2);
+        }
+    }
+#endif
+
+    return kernels;
+}
+
+
+void ic4::gst::split_lines(polarization_kernel kernel,
+                           const uint8_t* upper,
+                           const uint8_t* lower,
+                           uint8_t* const angles[4],
+                           int width)
+{
+    split(kernel, upper, lower, angles, width);
+}
+
+
+void ic4::gst::split_lines(polarization_kernel kernel,
+                           const uint16_t* upper,
+                           const uint16_t* lower,
+                           uint16_t* const angles[4],
+                           int width)
+{
+    split(kernel, upper, lower, angles, width);
+}
+
+
+void ic4::gst::compute_aolp_dolp(polarization_kernel kernel,
+                                 const uint8_t* const angles[4],
+                                 uint8_t* aolp,
+                                 uint8_t* dolp,
+                                 int width)
+{
+    aolp_dolp(kernel, angles, aolp, dolp, width);
+}
+
+
+void ic4::gst::compute_aolp_dolp(polarization_kernel kernel,
+                                 const uint16_t* const angles[4],
+                                 uint16_t* aolp,
+                                 uint16_t* dolp,
+                                 int width)
+{
+    aolp_dolp(kernel, angles, aolp, dolp, width);
+}
+
+
+size_t ic4::gst::polarization_scratch_size(polarization_mode mode,
+                                           ic4::PixelFormat angle_format,
+                                           int width)
+{
+    if (mode != polarization_mode::aolp_dolp)
+    {
+        return 0;
+    }
+    return 4 * (size_t)width * (get_bits_per_pixel(angle_format) == 8 ? 1 : 2);
+}
+
+
+bool ic4::gst::split_polarization(const image_view& src,
+                                  polarization_mode mode,
+                                  const image_view& dst,
+                                  std::span<uint8_t> scratch)
+{
+    const auto angle_format = get_angle_format(src.format);
+
+    if (angle_format == ic4::PixelFormat::Invalid || dst.format != angle_format
+        || (mode != polarization_mode::angles && !can_compute_aolp_dolp(src.format)))
+    {
+        return false;
+    }
+
+    if (src.width % 2 != 0 || src.height % 2 != 0 || dst.width != src.width / 2
+        || dst.height != polarization_planes(mode) * src.height / 2
+        || scratch.size() < polarization_scratch_size(mode, angle_format, dst.width))
+    {
+        return false;
+    }
+
+    if (get_bits_per_pixel(angle_format) == 8)
+    {
+        split_frame<uint8_t>(src, mode, dst, scratch);
+    }
+    else
+    {
+        split_frame<uint16_t>(src, mode, dst, scratch);
+    }
+    return true;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "striped_convert.h"
+
+#include <ic4/ImageType.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace ic4::gst
+{
+
+/**
+ * Planes ic4polarsplit stacks into one output frame.
+ * Every plane has half the width and height of the polarized frame.
+ */
+enum class polarization_mode
+{
+    // 0, 45, 90 and 135 degree
+    angles,
+    // angle and degree of linear polarization
+    aolp_dolp,
+    // the four angles followed by AoLP and DoLP
+    all,
+};
+
+int polarization_planes(polarization_mode mode);
+
+/**
+ * Format of a single angle plane, PolarizedMono8 becomes Mono8, PolarizedBayerBG16 BayerBG16.
+ * Returns PixelFormat::Invalid for formats that cannot be split.
+ * The packed polarized formats have to be unpacked to 16 bit first.
+ */
+ic4::PixelFormat get_angle_format(ic4::PixelFormat fmt);
+
+// inverse of get_angle_format, Mono8 becomes PolarizedMono8
+ic4::PixelFormat get_polarized_format(ic4::PixelFormat angle_format);
+
+/**
+ * Whether AoLP and DoLP can be computed for fmt.
+ * Only mono formats qualify, the planes of bayer formats would be misread as bayer patterns.
+ */
+bool can_compute_aolp_dolp(ic4::PixelFormat fmt);
+
+enum class polarization_kernel
+{
+    // scalar code, every other kernel has to match its output bit by bit
+    reference,
+    sse41,
+    avx2,
+};
+
+const char* to_string(polarization_kernel kernel);
+
+// kernels the CPU is able to run, fastest last
+std::vector<polarization_kernel> available_polarization_kernels();
+
+/**
+ * De-interleave two lines of the 2x2 polarizer mosaic.
+ * The upper line holds 90 and 45 degree, the lower one 135 and 0 degree.
+ * width is the number of mosaic pixels and has to be even,
+ * angles receives width / 2 pixels for 0, 45, 90 and 135 degree, in this order.
+ */
+void split_lines(polarization_kernel kernel,
+                 const uint8_t* upper,
+                 const uint8_t* lower,
+                 uint8_t* const angles[4],
+                 int width);
+void split_lines(polarization_kernel kernel,
+                 const uint16_t* upper,
+                 const uint16_t* lower,
+                 uint16_t* const angles[4],
+                 int width);
+
+/**
+ * Angle and degree of linear polarization of width pixels, computed from the Stokes parameters
+ * S0 = (I0 + I45 + I90 + I135) / 2, S1 = I0 - I90 and S2 = I45 - I135.
+ *
+ * AoLP = atan2(S2, S1) / 2 covers 0 to 180 degree and is scaled to the full value range.
+ * DoLP = sqrt(S1^2 + S2^2) / S0 is clamped to 1 and scaled the same way.
+ * The arc tangent is approximated, its error stays below 0.001 degree.
+ */
+void compute_aolp_dolp(polarization_kernel kernel,
+                       const uint8_t* const angles[4],
+                       uint8_t* aolp,
+                       uint8_t* dolp,
+                       int width);
+void compute_aolp_dolp(polarization_kernel kernel,
+                       const uint16_t* const angles[4],
+                       uint16_t* aolp,
+                       uint16_t* dolp,
+                       int width);
+
+/**
+ * Bytes of scratch memory split_polarization needs for output lines of width pixels.
+ * Only aolp_dolp needs any, its angles have no place in dst.
+ */
+size_t polarization_scratch_size(polarization_mode mode, ic4::PixelFormat angle_format, int width);
+
+/**
+ * Split a polarized frame into the planes of mode, stacked from top to bottom.
+ * dst has to be src.width / 2 wide and polarization_planes(mode) * src.height / 2 high,
+ * its format that of get_angle_format. Width and height of src have to be even.
+ * scratch has to hold polarization_scratch_size bytes, it is not allocated per frame.
+ *
+ * Each pair of lines is split and evaluated while it is in cache, the frame is read once.
+ * Returns false when the views do not match.
+ */
+bool split_polarization(const image_view& src,
+                        polarization_mode mode,
+                        const image_view& dst,
+                        std::span<uint8_t> scratch);
+
+} // namespace ic4::gst
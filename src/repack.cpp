@@ -0,0 +1,200 @@
+#include "repack.h"
+
+#include "unpack.h"
+
+#include <algorithm>
+
+namespace
+{
+
+/**
+ * Byte layout of a packed YUV device format.
+ * The order follows the GStreamer format the format table maps it to.
+ */
+struct yuv_layout
+{
+    ic4::PixelFormat format;
+    // pixels sharing one chroma sample, 2 for 4:2:2 and 4 for 4:1:1
+    int group;
+    int group_bytes;
+    // offsets inside a group
+    int u;
+    int v;
+    int y[4];
+};
+
+constexpr yuv_layout yuv_layouts[] = {
+    // YUY2
+    { ic4::PixelFormat::YUV422_8, 2, 4, 1, 3, { 0, 2 } },
+    // UYVY
+    { ic4::PixelFormat::YCbCr422_8, 2, 4, 0, 2, { 1, 3 } },
+    // IYU1
+    { ic4::PixelFormat::YCbCr411_8_CbYYCrYY, 4, 6, 0, 3, { 1, 2, 4, 5 } },
+};
+
+
+const yuv_layout* find_yuv_layout(ic4::PixelFormat fmt)
+{
+    for (const auto& l : yuv_layouts)
+    {
+        if (l.format == fmt)
+        {
+            return &l;
+        }
+    }
+    return nullptr;
+}
+
+
+void repack_gray10(const ic4::gst::image_view& src,
+                   const GstVideoInfo& info,
+                   uint8_t* dst,
+                   uint16_t* line)
+{
+    const int width = src.width;
+
+    // two extra zeros complete the last word
+    line[width] = 0;
+    line[width + 1] = 0;
+
+    for (int y = 0; y < src.height; ++y)
+    {
+        ic4::gst::unpack_line(ic4::gst::packing::lsb_10, src.data + y * src.pitch, line, width);
+
+        uint8_t* out = dst + GST_VIDEO_INFO_PLANE_OFFSET(&info, 0)
+                       + y * GST_VIDEO_INFO_PLANE_STRIDE(&info, 0);
+
+        // unpack_line aligns to the MSB, GRAY10_LE32 wants the plain 10 bit values
+        for (int x = 0; x < width; x += 3)
+        {
+            uint32_t word = (uint32_t)(line[x] >> 6) | (uint32_t)(line[x + 1] >> 6) << 10
+                            | (uint32_t)(line[x + 2] >> 6) << 20;
+            GST_WRITE_UINT32_LE(out + x / 3 * 4, word);
+        }
+    }
+}
+
+
+void repack_yuv(const yuv_layout& l,
+                const ic4::gst::image_view& src,
+                const GstVideoInfo& info,
+                uint8_t* dst)
+{
+    const int width = src.width;
+    const int height = src.height;
+    const bool nv12 = GST_VIDEO_INFO_FORMAT(&info) == GST_VIDEO_FORMAT_NV12;
+
+    uint8_t* y_plane = dst + GST_VIDEO_INFO_PLANE_OFFSET(&info, 0);
+    const size_t y_stride = GST_VIDEO_INFO_PLANE_STRIDE(&info, 0);
+
+    for (int y = 0; y < height; ++y)
+    {
+        const uint8_t* in = src.data + y * src.pitch;
+        uint8_t* out = y_plane + y * y_stride;
+
+        for (int x = 0; x < width; ++x)
+        {
+            out[x] = in[x / l.group * l.group_bytes + l.y[x % l.group]];
+        }
+    }
+
+    // 4:2:0 chroma covers 2x2 pixels
+    const int chroma_width = (width + 1) / 2;
+    const int chroma_height = (height + 1) / 2;
+
+    for (int cy = 0; cy < chroma_height; ++cy)
+    {
+        const uint8_t* in0 = src.data + 2 * cy * src.pitch;
+        // the last line of odd heights has no partner
+        const uint8_t* in1 = src.data + std::min(2 * cy + 1, height - 1) * src.pitch;
+
+        uint8_t* u_out = dst + GST_VIDEO_INFO_PLANE_OFFSET(&info, 1)
+                         + cy * GST_VIDEO_INFO_PLANE_STRIDE(&info, 1);
+        uint8_t* v_out = nv12 ? u_out + 1
+                              : dst + GST_VIDEO_INFO_PLANE_OFFSET(&info, 2)
+                                    + cy * GST_VIDEO_INFO_PLANE_STRIDE(&info, 2);
+        const int step = nv12 ? 2 : 1;
+
+        for (int cx = 0; cx < chroma_width; ++cx)
+        {
+            const int group = 2 * cx / l.group * l.group_bytes;
+
+            u_out[cx * step] = (uint8_t)((in0[group + l.u] + in1[group + l.u] + 1) >> 1);
+            v_out[cx * step] = (uint8_t)((in0[group + l.v] + in1[group + l.v] + 1) >> 1);
+        }
+    }
+}
+
+} // namespace
+
+
+std::vector<ic4::PixelFormat> ic4::gst::get_repacked_formats(ic4::PixelFormat in)
+{
+    if (in == ic4::PixelFormat::Mono10p)
+    {
+        return { repacked_format::GRAY10_LE32 };
+    }
+    if (find_yuv_layout(in))
+    {
+        return { repacked_format::I420, repacked_format::NV12 };
+    }
+    return {};
+}
+
+
+bool ic4::gst::can_repack(ic4::PixelFormat in, ic4::PixelFormat out)
+{
+    auto formats = get_repacked_formats(in);
+    return std::find(formats.begin(), formats.end(), out) != formats.end();
+}
+
+
+size_t ic4::gst::repack_scratch_size(const GstVideoInfo& info)
+{
+    if (GST_VIDEO_INFO_FORMAT(&info) != GST_VIDEO_FORMAT_GRAY10_LE32)
+    {
+        return 0;
+    }
+    return (GST_VIDEO_INFO_WIDTH(&info) + 2) * sizeof(uint16_t);
+}
+
+
+bool ic4::gst::repack_frame(const image_view& src,
+                            const GstVideoInfo& info,
+                            uint8_t* dst,
+                            std::span<uint8_t> scratch)
+{
+    if (src.width != GST_VIDEO_INFO_WIDTH(&info) || src.height != GST_VIDEO_INFO_HEIGHT(&info))
+    {
+        return false;
+    }
+
+    switch (GST_VIDEO_INFO_FORMAT(&info))
+    {
+        case GST_VIDEO_FORMAT_GRAY10_LE32:
+        {
+            if (src.format != ic4::PixelFormat::Mono10p
+                || scratch.size() < repack_scratch_size(info))
+            {
+                return false;
+            }
+            repack_gray10(src, info, dst, reinterpret_cast<uint16_t*>(scratch.data()));
+            return true;
+        }
+        case GST_VIDEO_FORMAT_I420:
+        case GST_VIDEO_FORMAT_NV12:
+        {
+            auto layout = find_yuv_layout(src.format);
+            if (!layout)
+            {
+                return false;
+            }
+            repack_yuv(*layout, src, info, dst);
+            return true;
+        }
+        default:
+        {
+            return false;
+        }
+    }
+}
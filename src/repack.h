@@ -0,0 +1,48 @@
+#pragma once
+
+#include "format.h"
+#include "striped_convert.h"
+
+#include <gst/video/video.h>
+#include <ic4/ImageType.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace ic4::gst
+{
+
+/**
+ * Repacked formats, see repacked_format, ic4src produces from in.
+ * Empty when in cannot be repacked.
+ */
+std::vector<ic4::PixelFormat> get_repacked_formats(ic4::PixelFormat in);
+
+bool can_repack(ic4::PixelFormat in, ic4::PixelFormat out);
+
+/**
+ * Bytes of scratch memory repack_frame needs to produce the format of info.
+ * Only GRAY10_LE32 needs any, the line unpacked from Mono10p.
+ */
+size_t repack_scratch_size(const GstVideoInfo& info);
+
+/**
+ * Repack a device frame into the format of info.
+ * Planes are written at the offsets and strides of info, dst has to hold GST_VIDEO_INFO_SIZE bytes.
+ *
+ * Mono10p becomes GRAY10_LE32, 3 pixels per 32 bit word with 2 bits padding.
+ * The packed YUV formats become I420 or NV12,
+ * their chroma is averaged over line pairs and repeated for 4:1:1.
+ *
+ * scratch has to hold repack_scratch_size(info) bytes, create keeps it across frames.
+ *
+ * Returns false when src.format cannot be repacked into the format of info.
+ */
+bool repack_frame(const image_view& src,
+                  const GstVideoInfo& info,
+                  uint8_t* dst,
+                  std::span<uint8_t> scratch);
+
+} // namespace ic4::gst
@@ -0,0 +1,265 @@
+#include "striped_convert.h"
+
+#include <ic4/ic4.h>
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace
+{
+
+/**
+ * Convert lines [first, last) of src into the same lines of dst with a single IC4 transform.
+ */
+bool convert_lines(const ic4::gst::image_view& src,
+                   const ic4::gst::image_view& dst,
+                   int first,
+                   int last,
+                   std::string& message)
+{
+    ic4::Error err;
+
+    const int lines = last - first;
+
+    auto in = ic4::ImageBuffer::wrapMemory(src.data + first * src.pitch,
+                                           lines * src.pitch,
+                                           (ptrdiff_t)src.pitch,
+                                           ic4::ImageType(src.format, src.width, lines),
+                                           {},
+                                           err);
+    auto out = in ? ic4::ImageBuffer::wrapMemory(dst.data + first * dst.pitch,
+                                                 lines * dst.pitch,
+                                                 (ptrdiff_t)dst.pitch,
+                                                 ic4::ImageType(dst.format, dst.width, lines),
+                                                 {},
+                                                 err)
+                  : nullptr;
+
+    if (!in || !out || !out->copyFrom(*in, ic4::ImageBuffer::CopyOptions::Default, err))
+    {
+        message = err.message();
+        return false;
+    }
+    return true;
+}
+
+
+void pin_thread(int cpu)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    (void)cpu;
+#endif
+}
+
+} // namespace
+
+
+std::optional<std::vector<int>> ic4::gst::parse_cpu_list(std::string_view list)
+{
+    std::vector<int> cpus;
+
+    while (!list.empty())
+    {
+        auto comma = list.find(',');
+        auto item = list.substr(0, comma);
+        list = comma == std::string_view::npos ? std::string_view() : list.substr(comma + 1);
+
+        auto parse = [](std::string_view s, int& value)
+        {
+            auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), value);
+            return ec == std::errc() && ptr == s.data() + s.size() && value >= 0;
+        };
+
+        int first = 0;
+        int last = 0;
+        auto dash = item.find('-');
+
+        if (dash == std::string_view::npos)
+        {
+            if (!parse(item, first))
+            {
+                return std::nullopt;
+            }
+            last = first;
+        }
+        else if (!parse(item.substr(0, dash), first) || !parse(item.substr(dash + 1), last)
+                 || last < first)
+        {
+            return std::nullopt;
+        }
+
+        for (int cpu = first; cpu <= last; ++cpu)
+        {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+
+ic4::gst::striped_converter::striped_converter(unsigned int threads, std::vector<int> cpus)
+    : threads_(std::max(threads, 1u)), cpus_(std::move(cpus)), scratch_(threads_), errors_(threads_)
+{
+    for (unsigned int i = 1; i < threads_; ++i)
+    {
+        int cpu = cpus_.empty() ? -1 : cpus_[(i - 1) % cpus_.size()];
+
+        workers_.emplace_back(
+            [this, i, cpu]
+            {
+                if (cpu >= 0)
+                {
+                    pin_thread(cpu);
+                }
+                worker_main(i);
+            });
+    }
+}
+
+
+ic4::gst::striped_converter::~striped_converter()
+{
+    {
+        std::lock_guard<std::mutex> lck(mtx_);
+        quit_ = true;
+    }
+    cv_work_.notify_all();
+
+    for (auto& w : workers_)
+    {
+        w.join();
+    }
+}
+
+
+void ic4::gst::striped_converter::worker_main(unsigned int index)
+{
+    uint64_t seen = 0;
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lck(mtx_);
+            cv_work_.wait(lck, [&] { return quit_ || generation_ != seen; });
+
+            if (quit_)
+            {
+                return;
+            }
+            seen = generation_;
+        }
+
+        std::string message;
+        if (!convert_stripe(index, message))
+        {
+            errors_[index] = message;
+        }
+
+        std::lock_guard<std::mutex> lck(mtx_);
+        if (--pending_ == 0)
+        {
+            cv_done_.notify_one();
+        }
+    }
+}
+
+
+bool ic4::gst::striped_converter::convert_stripe(unsigned int index, std::string& message)
+{
+    const int first = std::min<int>(index * stripe_height_, src_.height);
+    const int last = index + 1 == threads_ ? src_.height
+                                           : std::min<int>(first + stripe_height_, src_.height);
+
+    if (first >= last)
+    {
+        return true;
+    }
+
+    // the neighbor lines the filters need, clamped to the frame like for a single transform
+    const int top = std::max(first - stripe_margin, 0);
+    const int bottom = std::min(last + stripe_margin, src_.height);
+
+    auto& scratch = scratch_[index];
+    scratch.resize((bottom - top) * dst_.pitch);
+
+    image_view src = src_;
+    src.data += top * src.pitch;
+    src.height = bottom - top;
+
+    image_view tmp = dst_;
+    tmp.data = scratch.data();
+    tmp.height = bottom - top;
+
+    if (!convert_lines(src, tmp, 0, bottom - top, message))
+    {
+        return false;
+    }
+
+    memcpy(dst_.data + first * dst_.pitch,
+           scratch.data() + (first - top) * dst_.pitch,
+           (last - first) * dst_.pitch);
+    return true;
+}
+
+
+bool ic4::gst::striped_converter::convert(const image_view& src,
+                                          const image_view& dst,
+                                          std::string& message)
+{
+    if (src.width != dst.width || src.height != dst.height)
+    {
+        message = "Source and destination sizes differ.";
+        return false;
+    }
+
+    // stripes smaller than their margins only add work
+    const int stripes = std::min<int>(threads_, src.height / (2 * stripe_margin));
+
+    if (stripes <= 1)
+    {
+        return convert_lines(src, dst, 0, src.height, message);
+    }
+
+    {
+        std::lock_guard<std::mutex> lck(mtx_);
+
+        src_ = src;
+        dst_ = dst;
+        stripe_height_ = (src.height / stripes + stripe_alignment - 1) / stripe_alignment
+                         * stripe_alignment;
+        pending_ = threads_ - 1;
+        for (auto& e : errors_)
+        {
+            e.clear();
+        }
+        ++generation_;
+    }
+    cv_work_.notify_all();
+
+    // the calling thread takes the first stripe
+    bool ret = convert_stripe(0, message);
+
+    std::unique_lock<std::mutex> lck(mtx_);
+    cv_done_.wait(lck, [this] { return pending_ == 0; });
+
+    for (const auto& e : errors_)
+    {
+        if (ret && !e.empty())
+        {
+            message = e;
+            ret = false;
+        }
+    }
+    return ret;
+}
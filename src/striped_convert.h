@@ -0,0 +1,109 @@
+#pragma once
+
+#include <ic4/ImageType.h>
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace ic4::gst
+{
+
+/**
+ * Single plane image in memory, lines are pitch bytes apart.
+ */
+struct image_view
+{
+    uint8_t* data = nullptr;
+    size_t pitch = 0;
+    ic4::PixelFormat format = ic4::PixelFormat::Invalid;
+    int width = 0;
+    int height = 0;
+};
+
+
+/**
+ * Parse a cpu list like "0,2,4-7".
+ * Returns nullopt for malformed lists, an empty string gives an empty list.
+ */
+std::optional<std::vector<int>> parse_cpu_list(std::string_view list);
+
+
+/**
+ * Runs IC4 transforms on horizontal stripes of a frame in parallel.
+ *
+ * Every stripe is converted together with stripe_margin lines of its neighbors,
+ * only its own lines are copied into the destination.
+ * That way filters like the debayer see the same neighborhood as for the whole frame
+ * and the result is bit exact with a single IC4 transform.
+ *
+ * The workers are started once and wait for frames,
+ * the calling thread converts the first stripe itself.
+ */
+class striped_converter
+{
+public:
+    // lines of context converted above and below every stripe
+    static constexpr int stripe_margin = 8;
+    // stripes start at multiples of this, keeps bayer and polarization patterns intact
+    static constexpr int stripe_alignment = 4;
+
+    /**
+     * threads is the number of stripes, including the calling thread.
+     * Workers are pinned round-robin to cpus, an empty list leaves them unpinned.
+     */
+    explicit striped_converter(unsigned int threads, std::vector<int> cpus = {});
+    ~striped_converter();
+
+    striped_converter(const striped_converter&) = delete;
+    striped_converter& operator=(const striped_converter&) = delete;
+
+    unsigned int threads() const
+    {
+        return threads_;
+    }
+
+    const std::vector<int>& cpus() const
+    {
+        return cpus_;
+    }
+
+    /**
+     * Convert src into dst, both have to be of the same size.
+     * Returns false and fills message when IC4 is unable to convert.
+     */
+    bool convert(const image_view& src, const image_view& dst, std::string& message);
+
+private:
+    void worker_main(unsigned int index);
+    bool convert_stripe(unsigned int index, std::string& message);
+
+    unsigned int threads_;
+    std::vector<int> cpus_;
+
+    std::vector<std::thread> workers_;
+
+    std::mutex mtx_;
+    std::condition_variable cv_work_;
+    std::condition_variable cv_done_;
+    uint64_t generation_ = 0;
+    unsigned int pending_ = 0;
+    bool quit_ = false;
+
+    // the frame currently converted, only valid during convert
+    image_view src_;
+    image_view dst_;
+    int stripe_height_ = 0;
+
+    // per stripe
+    std::vector<std::vector<uint8_t>> scratch_;
+    std::vector<std::string> errors_;
+};
+
+} // namespace ic4::gst
@@ -0,0 +1,208 @@
+
+#include "timestamp_estimator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+
+// a device clock that jumps by more than this is considered reset
+constexpr double max_device_jump_ns = 1e9;
+
+// a device clock deviating more than this from the host clock is considered bogus
+constexpr double max_drift = 0.01;
+
+// fit changes are applied with at most 5 ms per second of device time
+constexpr double max_slew = 0.005;
+
+} // namespace
+
+
+void ic4::gst::timestamp_estimator::reset() noexcept
+{
+    restart();
+    has_output_ = false;
+    last_output_ = 0;
+    last_output_device_ = 0;
+}
+
+
+void ic4::gst::timestamp_estimator::restart() noexcept
+{
+    count_ = 0;
+    pos_ = 0;
+    device_base_ = 0;
+    host_base_ = 0;
+    last_device_ = 0;
+    slope_ = 1.0;
+    offset_ = 0.0;
+}
+
+
+uint64_t ic4::gst::timestamp_estimator::update(uint64_t device_ns, uint64_t host_ns) noexcept
+{
+    if (count_ > 0)
+    {
+        bool went_backwards = device_ns <= last_device_;
+        bool jumped = std::abs((double)predict(device_ns) - (double)host_ns) > max_device_jump_ns;
+
+        if (went_backwards || jumped)
+        {
+            restart();
+        }
+    }
+
+    if (count_ == 0)
+    {
+        device_base_ = device_ns;
+        host_base_ = host_ns;
+    }
+
+    last_device_ = device_ns;
+
+    samples_[pos_] = { (double)(device_ns - device_base_), (double)host_ns - (double)host_base_ };
+    pos_ = (pos_ + 1) % window_size;
+    count_ = std::min(count_ + 1, window_size);
+
+    fit();
+
+    double target = (double)predict(device_ns);
+    double host = target;
+
+    // follow the fit gradually, a new minimum or slope would otherwise
+    // move the output by the full correction from one frame to the next.
+    // after a restart the old mapping is meaningless, the fit is used directly
+    if (has_output_ && count_ > 1)
+    {
+        double elapsed = (double)(device_ns - last_output_device_);
+        double expected = (double)last_output_ + slope_ * elapsed;
+        double max_step = max_slew * elapsed;
+
+        host = expected + std::clamp(target - expected, -max_step, max_step);
+    }
+
+    uint64_t ret = host < 0.0 ? 0 : (uint64_t)std::llround(host);
+    if (has_output_ && ret <= last_output_)
+    {
+        ret = last_output_ + 1;
+    }
+
+    has_output_ = true;
+    last_output_ = ret;
+    last_output_device_ = device_ns;
+
+    return ret;
+}
+
+
+void ic4::gst::timestamp_estimator::fit_line(double max_residual,
+                                             double& slope,
+                                             double& intercept) const noexcept
+{
+    auto selected = [&](const sample& s)
+    {
+        return s.host - (intercept + slope * s.device) <= max_residual;
+    };
+
+    size_t n = 0;
+    double mean_device = 0.0;
+    double mean_host = 0.0;
+
+    for (size_t i = 0; i < count_; ++i)
+    {
+        if (selected(samples_[i]))
+        {
+            mean_device += samples_[i].device;
+            mean_host += samples_[i].host;
+            n++;
+        }
+    }
+    if (n == 0)
+    {
+        return;
+    }
+    mean_device /= n;
+    mean_host /= n;
+
+    double cov = 0.0;
+    double var = 0.0;
+
+    for (size_t i = 0; i < count_; ++i)
+    {
+        if (selected(samples_[i]))
+        {
+            double dx = samples_[i].device - mean_device;
+            double dy = samples_[i].host - mean_host;
+            cov += dx * dy;
+            var += dx * dx;
+        }
+    }
+
+    double new_slope = 1.0;
+    if (n > 1 && var > 0.0)
+    {
+        new_slope = cov / var;
+    }
+    // do not follow obviously wrong fits, e.g. right after a reset
+    slope = std::clamp(new_slope, 1.0 - max_drift, 1.0 + max_drift);
+    intercept = mean_host - slope * mean_device;
+}
+
+
+void ic4::gst::timestamp_estimator::fit() noexcept
+{
+    double slope = 1.0;
+    double intercept = 0.0;
+
+    fit_line(std::numeric_limits<double>::infinity(), slope, intercept);
+
+    auto residual = [&](const sample& s)
+    {
+        return s.host - (intercept + slope * s.device);
+    };
+
+    // transfer delays only ever add, samples above the median residual are
+    // mostly stalls and jitter. fitting without them keeps the slope from tilting
+    if (count_ >= 8)
+    {
+        std::array<double, window_size> residuals;
+        for (size_t i = 0; i < count_; ++i)
+        {
+            residuals[i] = residual(samples_[i]);
+        }
+        auto median = residuals.begin() + count_ / 2;
+        std::nth_element(residuals.begin(), median, residuals.begin() + count_);
+
+        fit_line(*median, slope, intercept);
+    }
+
+    // shift onto the lower envelope
+    // host arrival can only be delayed, never early
+    double min_residual = 0.0;
+    for (size_t i = 0; i < count_; ++i)
+    {
+        double r = residual(samples_[i]);
+        if (i == 0 || r < min_residual)
+        {
+            min_residual = r;
+        }
+    }
+
+    slope_ = slope;
+    offset_ = intercept + min_residual;
+}
+
+
+uint64_t ic4::gst::timestamp_estimator::predict(uint64_t device_ns) const noexcept
+{
+    double device = (double)device_ns - (double)device_base_;
+    double host = (double)host_base_ + offset_ + slope_ * device;
+
+    if (host < 0.0)
+    {
+        return 0;
+    }
+    return (uint64_t)std::llround(host);
+}
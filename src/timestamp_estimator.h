@@ -0,0 +1,89 @@
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace ic4::gst
+{
+
+/**
+ * Maps device timestamps onto the host time base.
+ *
+ * Keeps a sliding window of (device, host) pairs and fits
+ * host = offset + slope * device via least squares,
+ * a second pass only uses the samples below the median residual.
+ * The fit is then shifted onto the lower envelope of the samples,
+ * as transfer jitter only ever delays the host arrival time.
+ *
+ * Changes of the fit are slewed into the output instead of being applied at once
+ * and the output is strictly increasing, it never jumps backwards.
+ *
+ * Restarts the fit when the device clock jumps, e.g. after a device reset.
+ */
+class timestamp_estimator
+{
+public:
+    void reset() noexcept;
+
+    /**
+     * Add a sample and return the smoothed host time for device_ns.
+     * Every returned value is larger than the previous one.
+     * All values are in nanoseconds.
+     */
+    uint64_t update(uint64_t device_ns, uint64_t host_ns) noexcept;
+
+    // estimated device clock rate relative to the host clock
+    double drift() const noexcept
+    {
+        return slope_;
+    }
+
+    size_t sample_count() const noexcept
+    {
+        return count_;
+    }
+
+private:
+    // drop the samples, unlike reset the last output is kept
+    void restart() noexcept;
+
+    /**
+     * Least squares fit of host = intercept + slope * device over the samples
+     * whose residual against the line passed in is at most max_residual.
+     */
+    void fit_line(double max_residual, double& slope, double& intercept) const noexcept;
+
+    void fit() noexcept;
+
+    uint64_t predict(uint64_t device_ns) const noexcept;
+
+    static constexpr size_t window_size = 64;
+
+    struct sample
+    {
+        // relative to device_base_/host_base_
+        double device;
+        double host;
+    };
+
+    std::array<sample, window_size> samples_ = {};
+    size_t count_ = 0;
+    size_t pos_ = 0;
+
+    uint64_t device_base_ = 0;
+    uint64_t host_base_ = 0;
+    uint64_t last_device_ = 0;
+
+    // fit of the current window
+    double slope_ = 1.0;
+    double offset_ = 0.0;
+
+    // last returned host time and the device time it was returned for
+    bool has_output_ = false;
+    uint64_t last_output_ = 0;
+    uint64_t last_output_device_ = 0;
+};
+
+} // namespace ic4::gst
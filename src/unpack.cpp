@@ -0,0 +1,398 @@
+#include "unpack.h"
+
+#include <bit>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define IC4_UNPACK_X86
+#endif
+
+namespace
+{
+
+using ic4::gst::packing;
+using ic4::gst::unpack_kernel;
+
+struct unpack_entry
+{
+    ic4::PixelFormat packed;
+    ic4::PixelFormat unpacked;
+    packing layout;
+};
+
+#define UNPACK(packed, unpacked, layout) \
+    { ic4::PixelFormat::packed, ic4::PixelFormat::unpacked, packing::layout }
+
+constexpr unpack_entry unpack_table[] = {
+    UNPACK(Mono10p, Mono16, lsb_10),
+    UNPACK(Mono12p, Mono16, lsb_12),
+    UNPACK(Mono12Packed, Mono16, msb_12),
+    UNPACK(BayerBG10p, BayerBG16, lsb_10),
+    UNPACK(BayerBG12p, BayerBG16, lsb_12),
+    UNPACK(BayerBG12Packed, BayerBG16, msb_12),
+    UNPACK(BayerGB10p, BayerGB16, lsb_10),
+    UNPACK(BayerGB12p, BayerGB16, lsb_12),
+    UNPACK(BayerGB12Packed, BayerGB16, msb_12),
+    UNPACK(BayerGR10p, BayerGR16, lsb_10),
+    UNPACK(BayerGR12p, BayerGR16, lsb_12),
+    UNPACK(BayerGR12Packed, BayerGR16, msb_12),
+    UNPACK(BayerRG10p, BayerRG16, lsb_10),
+    UNPACK(BayerRG12p, BayerRG16, lsb_12),
+    UNPACK(BayerRG12Packed, BayerRG16, msb_12),
+    UNPACK(PolarizedMono12p, PolarizedMono16, lsb_12),
+    UNPACK(PolarizedMono12Packed, PolarizedMono16, msb_12),
+    UNPACK(PolarizedBayerBG12p, PolarizedBayerBG16, lsb_12),
+    UNPACK(PolarizedBayerBG12Packed, PolarizedBayerBG16, msb_12),
+};
+
+#undef UNPACK
+
+
+const unpack_entry* find_entry(ic4::PixelFormat fmt)
+{
+    for (const auto& e : unpack_table)
+    {
+        if (e.packed == fmt)
+        {
+            return &e;
+        }
+    }
+    return nullptr;
+}
+
+
+constexpr size_t packing_bits(packing p)
+{
+    return p == packing::lsb_10 ? 10 : 12;
+}
+
+
+// source offset of pixel, which has to be the first of its group
+constexpr size_t byte_offset(packing p, size_t pixel)
+{
+    return pixel * packing_bits(p) / 8;
+}
+
+
+void unpack_reference(packing p, const uint8_t* src, uint16_t* dst, size_t width)
+{
+    if (p == packing::msb_12)
+    {
+        for (size_t i = 0; i < width; ++i)
+        {
+            const uint8_t* pair = src + (i / 2) * 3;
+            unsigned value = (i % 2 == 0) ? (pair[0] << 4) | (pair[1] & 0x0F)
+                                          : (pair[2] << 4) | (pair[1] >> 4);
+            dst[i] = uint16_t(value << 4);
+        }
+        return;
+    }
+
+    const size_t bits = packing_bits(p);
+    const unsigned mask = (1u << bits) - 1;
+
+    // every value spans exactly two bytes of the little endian bit stream
+    for (size_t i = 0; i < width; ++i)
+    {
+        const size_t bit = i * bits;
+        const uint8_t* b = src + bit / 8;
+        unsigned value = ((b[0] | (b[1] << 8)) >> (bit % 8)) & mask;
+        dst[i] = uint16_t(value << (16 - bits));
+    }
+}
+
+
+uint64_t load_le64(const uint8_t* src)
+{
+    uint64_t v;
+    memcpy(&v, src, sizeof(v));
+    return v;
+}
+
+
+void unpack_generic(packing p, const uint8_t* src, uint16_t* dst, size_t width)
+{
+    const size_t line_size = ic4::gst::packed_line_size(p, width);
+    size_t i = 0;
+
+    if (p == packing::msb_12)
+    {
+        for (; i + 2 <= width; i += 2)
+        {
+            const uint8_t* pair = src + byte_offset(p, i);
+            dst[i] = uint16_t((pair[0] << 8) | ((pair[1] & 0x0F) << 4));
+            dst[i + 1] = uint16_t((pair[2] << 8) | (pair[1] & 0xF0));
+        }
+    }
+    else if constexpr (std::endian::native == std::endian::little)
+    {
+        // 4 pixels per 64 bit load, shifted straight to their MSB aligned position
+        if (p == packing::lsb_10)
+        {
+            for (; i + 4 <= width && byte_offset(p, i) + 8 <= line_size; i += 4)
+            {
+                const uint64_t v = load_le64(src + byte_offset(p, i));
+                dst[i] = uint16_t((v << 6) & 0xFFC0);
+                dst[i + 1] = uint16_t((v >> 4) & 0xFFC0);
+                dst[i + 2] = uint16_t((v >> 14) & 0xFFC0);
+                dst[i + 3] = uint16_t((v >> 24) & 0xFFC0);
+            }
+        }
+        else
+        {
+            for (; i + 4 <= width && byte_offset(p, i) + 8 <= line_size; i += 4)
+            {
+                const uint64_t v = load_le64(src + byte_offset(p, i));
+                dst[i] = uint16_t((v << 4) & 0xFFF0);
+                dst[i + 1] = uint16_t((v >> 8) & 0xFFF0);
+                dst[i + 2] = uint16_t((v >> 20) & 0xFFF0);
+                dst[i + 3] = uint16_t((v >> 32) & 0xFFF0);
+            }
+        }
+    }
+
+    unpack_reference(p, src + byte_offset(p, i), dst + i, width - i);
+}
+
+
+#ifdef IC4_UNPACK_X86
+
+/*
+ * The SIMD kernels shuffle the two bytes holding a value into a 16 bit lane
+ * and then shift every lane so that the value ends up MSB aligned.
+ * 8 pixels occupy 10 (10p) or 12 (12p, 12Packed) bytes of a 16 byte load.
+ */
+
+__attribute__((target("sse4.1"))) inline __m128i unpack_lanes_sse(packing p, __m128i in)
+{
+    if (p == packing::lsb_10)
+    {
+        const __m128i shuffle = _mm_setr_epi8(0, 1, 1, 2, 2, 3, 3, 4, 5, 6, 6, 7, 7, 8, 8, 9);
+        // values start at bit 0, 2, 4 and 6 of their lane
+        const __m128i shift = _mm_setr_epi16(64, 16, 4, 1, 64, 16, 4, 1);
+
+        __m128i v = _mm_shuffle_epi8(in, shuffle);
+        return _mm_and_si128(_mm_mullo_epi16(v, shift), _mm_set1_epi16((short)0xFFC0));
+    }
+    if (p == packing::lsb_12)
+    {
+        const __m128i shuffle = _mm_setr_epi8(0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11);
+
+        __m128i v = _mm_shuffle_epi8(in, shuffle);
+        __m128i even = _mm_slli_epi16(v, 4);
+        __m128i odd = _mm_and_si128(v, _mm_set1_epi16((short)0xFFF0));
+        return _mm_blend_epi16(even, odd, 0xAA);
+    }
+
+    // even lanes get the low nibble byte below the high byte
+    const __m128i shuffle = _mm_setr_epi8(1, 0, 1, 2, 4, 3, 4, 5, 7, 6, 7, 8, 10, 9, 10, 11);
+
+    __m128i v = _mm_shuffle_epi8(in, shuffle);
+    __m128i even = _mm_or_si128(_mm_and_si128(v, _mm_set1_epi16((short)0xFF00)),
+                                _mm_and_si128(_mm_slli_epi16(v, 4), _mm_set1_epi16(0x00F0)));
+    __m128i odd = _mm_and_si128(v, _mm_set1_epi16((short)0xFFF0));
+    return _mm_blend_epi16(even, odd, 0xAA);
+}
+
+
+__attribute__((target("sse4.1"))) void unpack_sse41(packing p,
+                                                     const uint8_t* src,
+                                                     uint16_t* dst,
+                                                     size_t width)
+{
+    const size_t line_size = ic4::gst::packed_line_size(p, width);
+    size_t i = 0;
+
+    for (; i + 8 <= width && byte_offset(p, i) + 16 <= line_size; i += 8)
+    {
+        __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + byte_offset(p, i)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), unpack_lanes_sse(p, in));
+    }
+
+    unpack_generic(p, src + byte_offset(p, i), dst + i, width - i);
+}
+
+
+__attribute__((target("avx2"))) void unpack_avx2(packing p,
+                                                 const uint8_t* src,
+                                                 uint16_t* dst,
+                                                 size_t width)
+{
+    const size_t line_size = ic4::gst::packed_line_size(p, width);
+    // source bytes of the 8 pixels in the lower lane
+    const size_t half = byte_offset(p, 8);
+
+    __m256i shuffle;
+    __m256i mask;
+    __m256i shift = _mm256_setzero_si256();
+
+    if (p == packing::lsb_10)
+    {
+        shuffle = _mm256_setr_epi8(0, 1, 1, 2, 2, 3, 3, 4, 5, 6, 6, 7, 7, 8, 8, 9,
+                                   0, 1, 1, 2, 2, 3, 3, 4, 5, 6, 6, 7, 7, 8, 8, 9);
+        shift = _mm256_setr_epi16(64, 16, 4, 1, 64, 16, 4, 1, 64, 16, 4, 1, 64, 16, 4, 1);
+        mask = _mm256_set1_epi16((short)0xFFC0);
+    }
+    else if (p == packing::lsb_12)
+    {
+        shuffle = _mm256_setr_epi8(0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11,
+                                   0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11);
+        mask = _mm256_set1_epi16((short)0xFFF0);
+    }
+    else
+    {
+        shuffle = _mm256_setr_epi8(1, 0, 1, 2, 4, 3, 4, 5, 7, 6, 7, 8, 10, 9, 10, 11,
+                                   1, 0, 1, 2, 4, 3, 4, 5, 7, 6, 7, 8, 10, 9, 10, 11);
+        mask = _mm256_set1_epi16((short)0xFFF0);
+    }
+
+    size_t i = 0;
+
+    for (; i + 16 <= width && byte_offset(p, i) + half + 16 <= line_size; i += 16)
+    {
+        const uint8_t* s = src + byte_offset(p, i);
+        __m256i in = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(s))),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + half)),
+            1);
+
+        // the shuffle works within 128 bit lanes, each lane gets 8 pixels
+        __m256i v = _mm256_shuffle_epi8(in, shuffle);
+        __m256i out;
+
+        if (p == packing::lsb_10)
+        {
+            out = _mm256_and_si256(_mm256_mullo_epi16(v, shift), mask);
+        }
+        else if (p == packing::lsb_12)
+        {
+            out = _mm256_blend_epi16(_mm256_slli_epi16(v, 4), _mm256_and_si256(v, mask), 0xAA);
+        }
+        else
+        {
+            __m256i even = _mm256_or_si256(
+                _mm256_and_si256(v, _mm256_set1_epi16((short)0xFF00)),
+                _mm256_and_si256(_mm256_slli_epi16(v, 4), _mm256_set1_epi16(0x00F0)));
+            out = _mm256_blend_epi16(even, _mm256_and_si256(v, mask), 0xAA);
+        }
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), out);
+    }
+
+    unpack_sse41(p, src + byte_offset(p, i), dst + i, width - i);
+}
+
+#endif /* IC4_UNPACK_X86 */
+
+
+unpack_kernel select_kernel()
+{
+    return ic4::gst::available_unpack_kernels().back();
+}
+
+} // namespace
+
+
+ic4::gst::packing ic4::gst::get_packing(ic4::PixelFormat fmt)
+{
+    auto entry = find_entry(fmt);
+    return entry ? entry->layout : packing::none;
+}
+
+
+ic4::PixelFormat ic4::gst::get_unpacked_format(ic4::PixelFormat fmt)
+{
+    auto entry = find_entry(fmt);
+    return entry ? entry->unpacked : ic4::PixelFormat::Invalid;
+}
+
+
+size_t ic4::gst::packed_line_size(packing p, size_t width)
+{
+    if (p == packing::none)
+    {
+        return 0;
+    }
+    return (width * packing_bits(p) + 7) / 8;
+}
+
+
+const char* ic4::gst::to_string(unpack_kernel kernel)
+{
+    switch (kernel)
+    {
+        case unpack_kernel::reference:
+            return "reference";
+        case unpack_kernel::generic:
+            return "generic";
+        case unpack_kernel::sse41:
+            return "sse4.1";
+        case unpack_kernel::avx2:
+            return "avx2";
+    }
+    return "unknown";
+}
+
+
+std::vector<ic4::gst::unpack_kernel> ic4::gst::available_unpack_kernels()
+{
+    std::vector<unpack_kernel> kernels = { unpack_kernel::reference, unpack_kernel::generic };
+
+#ifdef IC4_UNPACK_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.1"))
+    {
+        kernels.push_back(unpack_kernel::sse41);
+
+        if (__builtin_cpu_supports("avx2"))
+        {
+            kernels.push_back(unpack_kernel::avx2);
+        }
+    }
+#endif
+
+    return kernels;
+}
+
+
+void ic4::gst::unpack_line(unpack_kernel kernel,
+                           packing p,
+                           const uint8_t* src,
+                           uint16_t* dst,
+                           size_t width)
+{
+    if (p == packing::none)
+    {
+        return;
+    }
+
+    switch (kernel)
+    {
+        case unpack_kernel::reference:
+            unpack_reference(p, src, dst, width);
+            return;
+        case unpack_kernel::generic:
+            unpack_generic(p, src, dst, width);
+            return;
+#ifdef IC4_UNPACK_X86
+        case unpack_kernel::sse41:
+            unpack_sse41(p, src, dst, width);
+            return;
+        case unpack_kernel::avx2:
+            unpack_avx2(p, src, dst, width);
+            return;
+#else
+        default:
+            unpack_generic(p, src, dst, width);
+            return;
+#endif
+    }
+}
+
+
+void ic4::gst::unpack_line(packing p, const uint8_t* src, uint16_t* dst, size_t width)
+{
+    static const unpack_kernel kernel = select_kernel();
+    unpack_line(kernel, p, src, dst, width);
+}
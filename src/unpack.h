@@ -0,0 +1,67 @@
+#pragma once
+
+#include <ic4/ImageType.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ic4::gst
+{
+
+/**
+ * Bit layouts of the packed formats ic4src unpacks itself.
+ */
+enum class packing
+{
+    none,
+    // GenICam 10p, 4 pixels in 5 bytes, LSB first
+    lsb_10,
+    // GenICam 12p, 2 pixels in 3 bytes, LSB first
+    lsb_12,
+    // GigE Vision 12Packed, 2 pixels in 3 bytes, the middle byte holds both low nibbles
+    msb_12,
+};
+
+packing get_packing(ic4::PixelFormat fmt);
+
+/**
+ * 16 bit format fmt is unpacked to, Mono16 or the Bayer16 of the same pattern.
+ * Returns PixelFormat::Invalid when fmt cannot be unpacked.
+ */
+ic4::PixelFormat get_unpacked_format(ic4::PixelFormat fmt);
+
+inline bool can_unpack(ic4::PixelFormat in, ic4::PixelFormat out)
+{
+    return out != ic4::PixelFormat::Invalid && get_unpacked_format(in) == out;
+}
+
+// bytes a line of width packed pixels occupies
+size_t packed_line_size(packing p, size_t width);
+
+enum class unpack_kernel
+{
+    // scalar code, every other kernel has to match its output bit by bit
+    reference,
+    // 64 bit loads, portable and auto-vectorized on ARM
+    generic,
+    sse41,
+    avx2,
+};
+
+const char* to_string(unpack_kernel kernel);
+
+// kernels the CPU is able to run, fastest last
+std::vector<unpack_kernel> available_unpack_kernels();
+
+/**
+ * Unpack width pixels of a single line into 16 bit values.
+ * Values are MSB aligned, the 12 bit value 0xABC becomes 0xABC0,
+ * the way GRAY16_LE and bayer16 consumers expect them.
+ */
+void unpack_line(unpack_kernel kernel, packing p, const uint8_t* src, uint16_t* dst, size_t width);
+
+// unpack_line with the fastest available kernel
+void unpack_line(packing p, const uint8_t* src, uint16_t* dst, size_t width);
+
+} // namespace ic4::gst
@@ -0,0 +1,319 @@
+#include <doctest/doctest.h>
+#include <fmt/format.h>
+
+#include <gst/gst.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "../src/caps_merge.h"
+
+namespace
+{
+
+struct height_band
+{
+    int min;
+    int max;
+    int fps_max;
+};
+
+
+void set_string_list(GstStructure* struc, const char* field, const std::vector<std::string>& values)
+{
+    GValue list = G_VALUE_INIT;
+    g_value_init(&list, GST_TYPE_LIST);
+    for (const auto& v : values)
+    {
+        GValue val = G_VALUE_INIT;
+        g_value_init(&val, G_TYPE_STRING);
+        g_value_set_string(&val, v.c_str());
+        gst_value_list_append_and_take_value(&list, &val);
+    }
+    gst_structure_take_value(struc, field, &list);
+}
+
+
+// caps in the layout create_caps produced before merging:
+// one structure per format, readout mode and height band
+// and the full device-format list for every converted format
+GstCaps* make_expanded_caps()
+{
+    const std::vector<std::string> bayer = { "rggb", "rggb10p", "rggb12p", "rggb16" };
+    const std::vector<std::string> raw = { "GRAY8", "GRAY16_LE", "BGR", "BGRx" };
+    const std::vector<std::string> converted = { "BGRx", "BGRA", "BGRA16_LE", "GRAY8", "GRAY16_LE", "BGR" };
+
+    std::vector<std::string> device_formats = raw;
+    device_formats.insert(device_formats.end(), bayer.begin(), bayer.end());
+
+    const std::vector<std::string> modes = { "1x1", "2x2", "4x4" };
+
+    const std::vector<height_band> bands = {
+        { 4, 480, 480 },     { 484, 720, 320 },   { 724, 1080, 215 },
+        { 1084, 1200, 193 }, { 1204, 1536, 152 }, { 1540, 2048, 114 },
+    };
+
+    GstCaps* caps = gst_caps_new_empty();
+
+    auto add = [&](const char* name, const std::string& format, bool with_device_format)
+    {
+        for (size_t m = 0; m < modes.size(); ++m)
+        {
+            const int factor = 1 << m;
+            for (const auto& b : bands)
+            {
+                GstStructure* struc = gst_structure_new(name,
+                                                        "format", G_TYPE_STRING, format.c_str(),
+                                                        nullptr);
+                if (with_device_format)
+                {
+                    set_string_list(struc, "device-format", device_formats);
+                }
+                if (m > 0)
+                {
+                    gst_structure_set(struc, "binning", G_TYPE_STRING, modes.at(m).c_str(), nullptr);
+                }
+
+                GValue width = G_VALUE_INIT;
+                g_value_init(&width, GST_TYPE_INT_RANGE);
+                gst_value_set_int_range_step(&width, 256 / factor, 3072 / factor, 16);
+                gst_structure_take_value(struc, "width", &width);
+
+                GValue height = G_VALUE_INIT;
+                g_value_init(&height, GST_TYPE_INT_RANGE);
+                gst_value_set_int_range_step(&height, b.min / factor, b.max / factor, 4);
+                gst_structure_take_value(struc, "height", &height);
+
+                gst_structure_set(struc,
+                                  "framerate", GST_TYPE_FRACTION_RANGE, 1, 1, b.fps_max * factor, 1,
+                                  nullptr);
+
+                gst_caps_append_structure(caps, struc);
+            }
+        }
+    };
+
+    for (const auto& f : bayer)
+    {
+        add("video/x-bayer", f, false);
+    }
+    for (const auto& f : raw)
+    {
+        add("video/x-raw", f, false);
+    }
+    for (const auto& f : converted)
+    {
+        add("video/x-raw", f, true);
+    }
+
+    return caps;
+}
+
+
+// one structure per format, the form create_caps produced before merging
+GstCaps* split_formats(const GstCaps* caps)
+{
+    GstCaps* split = gst_caps_new_empty();
+    for (guint i = 0; i < gst_caps_get_size(caps); ++i)
+    {
+        const GstStructure* struc = gst_caps_get_structure(caps, i);
+        const GValue* format = gst_structure_get_value(struc, "format");
+
+        if (!format || !GST_VALUE_HOLDS_LIST(format))
+        {
+            gst_caps_append_structure(split, gst_structure_copy(struc));
+            continue;
+        }
+
+        for (guint j = 0; j < gst_value_list_get_size(format); ++j)
+        {
+            GstStructure* s = gst_structure_copy(struc);
+            gst_structure_set_value(s, "format", gst_value_list_get_value(format, j));
+            gst_caps_append_structure(split, s);
+        }
+    }
+    return split;
+}
+
+
+// gst_caps_is_equal compares structure by structure and cannot tell
+// that a format list equals several structures, compare the split forms instead
+bool caps_are_equivalent(const GstCaps* a, const GstCaps* b)
+{
+    GstCaps* split_a = split_formats(a);
+    GstCaps* split_b = split_formats(b);
+
+    bool ret = gst_caps_is_subset(split_a, b) && gst_caps_is_subset(split_b, a);
+
+    gst_caps_unref(split_a);
+    gst_caps_unref(split_b);
+
+    return ret;
+}
+
+
+// what typical downstream elements ask for
+std::vector<GstCaps*> make_peer_caps()
+{
+    return {
+        gst_caps_new_any(),
+        gst_caps_from_string("video/x-raw"),
+        gst_caps_from_string("video/x-raw,format=BGRx"),
+        gst_caps_from_string("video/x-raw,format={BGRA,BGRx,GRAY8},width=1920,height=1080"),
+        gst_caps_from_string("video/x-bayer,format=rggb12p,width=[640,2048],height=[480,1536],framerate=60/1"),
+        gst_caps_from_string("video/x-raw,format=BGRx,device-format=rggb,width=640,height=480,framerate=30/1"),
+    };
+}
+
+} // namespace
+
+
+TEST_CASE("merged caps are equivalent")
+{
+    GstCaps* expanded = make_expanded_caps();
+    GstCaps* merged = ic4::gst::merge_caps(expanded);
+
+    MESSAGE(fmt::format("{} structures merged into {}",
+                        gst_caps_get_size(expanded),
+                        gst_caps_get_size(merged)));
+
+    CHECK(gst_caps_get_size(merged) < gst_caps_get_size(expanded));
+    CHECK(caps_are_equivalent(merged, expanded));
+
+    // merging the canonical form again does not change it
+    GstCaps* twice = ic4::gst::merge_caps(merged);
+    CHECK(gst_caps_is_strictly_equal(twice, merged));
+    gst_caps_unref(twice);
+
+    for (auto peer : make_peer_caps())
+    {
+        gchar* peer_str = gst_caps_to_string(peer);
+        CAPTURE(peer_str);
+
+        // same order gst_ic4_src_negotiate uses, our caps decide the preference
+        GstCaps* a = gst_caps_intersect_full(expanded, peer, GST_CAPS_INTERSECT_FIRST);
+        GstCaps* b = gst_caps_intersect_full(merged, peer, GST_CAPS_INTERSECT_FIRST);
+
+        CHECK(caps_are_equivalent(a, b));
+
+        // none of these peers is satisfied by a later format in an earlier structure only,
+        // fixation ends up with the same result
+        if (!gst_caps_is_empty(a))
+        {
+            a = gst_caps_fixate(a);
+            b = gst_caps_fixate(b);
+            CHECK(gst_caps_is_equal(a, b));
+        }
+
+        gst_caps_unref(a);
+        gst_caps_unref(b);
+        gst_caps_unref(peer);
+        g_free(peer_str);
+    }
+
+    gst_caps_unref(merged);
+    gst_caps_unref(expanded);
+}
+
+
+TEST_CASE("merged caps leave unrelated structures alone")
+{
+    GstCaps* caps = gst_caps_from_string("video/x-raw,format=GRAY8,width=640;"
+                                         "video/x-raw,width=640;"
+                                         "video/x-raw,format=BGRx,width=640;"
+                                         "video/x-bayer,format=rggb,width=640;"
+                                         "video/x-raw,format={GRAY8,BGR},width=320");
+    GstCaps* merged = ic4::gst::merge_caps(caps);
+
+    GstCaps* expected = gst_caps_from_string("video/x-raw,format={GRAY8,BGRx},width=640;"
+                                             "video/x-raw,width=640;"
+                                             "video/x-bayer,format=rggb,width=640;"
+                                             "video/x-raw,format={GRAY8,BGR},width=320");
+
+    CHECK(gst_caps_is_strictly_equal(merged, expected));
+    CHECK(caps_are_equivalent(merged, caps));
+
+    gst_caps_unref(expected);
+    gst_caps_unref(merged);
+    gst_caps_unref(caps);
+}
+
+
+TEST_CASE("merged caps prefer earlier structures over earlier formats")
+{
+    GstCaps* caps = gst_caps_from_string("video/x-raw,format=GRAY8,width=640,binning=1x1;"
+                                         "video/x-raw,format=GRAY8,width=320,binning=2x2;"
+                                         "video/x-raw,format=BGRx,width=640,binning=1x1;"
+                                         "video/x-raw,format=BGRx,width=320,binning=2x2");
+    GstCaps* merged = ic4::gst::merge_caps(caps);
+
+    CHECK(gst_caps_get_size(merged) == 2);
+    CHECK(caps_are_equivalent(merged, caps));
+
+    // satisfied by the later format in the earlier mode and the earlier format in the later mode
+    GstCaps* peer = gst_caps_from_string("video/x-raw,format=BGRx,width=640;"
+                                         "video/x-raw,format=GRAY8,binning=2x2");
+
+    GstCaps* a = gst_caps_fixate(gst_caps_intersect_full(caps, peer, GST_CAPS_INTERSECT_FIRST));
+    GstCaps* b = gst_caps_fixate(gst_caps_intersect_full(merged, peer, GST_CAPS_INTERSECT_FIRST));
+
+    GstCaps* expected_a = gst_caps_from_string("video/x-raw,format=GRAY8,width=320,binning=2x2");
+    GstCaps* expected_b = gst_caps_from_string("video/x-raw,format=BGRx,width=640,binning=1x1");
+
+    // the merged form puts the mode before the format, see caps_merge.h
+    CHECK(gst_caps_is_equal(a, expected_a));
+    CHECK(gst_caps_is_equal(b, expected_b));
+
+    gst_caps_unref(expected_b);
+    gst_caps_unref(expected_a);
+    gst_caps_unref(b);
+    gst_caps_unref(a);
+    gst_caps_unref(peer);
+    gst_caps_unref(merged);
+    gst_caps_unref(caps);
+}
+
+
+TEST_CASE("caps negotiation benchmark")
+{
+    GstCaps* expanded = make_expanded_caps();
+    GstCaps* merged = ic4::gst::merge_caps(expanded);
+
+    auto peers = make_peer_caps();
+
+    constexpr size_t iterations = 20;
+
+    // same intersection gst_ic4_src_negotiate performs with the peer caps
+    auto measure = [&](GstCaps* src_caps)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; ++i)
+        {
+            for (auto peer : peers)
+            {
+                GstCaps* tmp = gst_caps_intersect_full(src_caps, peer, GST_CAPS_INTERSECT_FIRST);
+                gst_caps_unref(tmp);
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+    };
+
+    auto expanded_time = measure(expanded);
+    auto merged_time = measure(merged);
+
+    MESSAGE(fmt::format("{} negotiations: {} structures {} us, {} structures {} us",
+                        iterations * peers.size(),
+                        gst_caps_get_size(expanded),
+                        expanded_time.count(),
+                        gst_caps_get_size(merged),
+                        merged_time.count()));
+
+    for (auto peer : peers)
+    {
+        gst_caps_unref(peer);
+    }
+    gst_caps_unref(merged);
+    gst_caps_unref(expanded);
+}
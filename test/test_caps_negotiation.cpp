@@ -285,3 +285,63 @@ TEST_CASE("binning 2x2")
     gst_caps_unref(data.caps);
 
 }
+
+
+TEST_CASE("renegotiation with drop-policy block")
+{
+    auto serial = test_helper::get_test_serial();
+    auto bayer_fmt = get_highest_bayer_format(serial);
+
+    std::string caps_str =
+        fmt::format("video/x-raw,format=BGRx,device-format={},width=640,height=480", bayer_fmt);
+
+    // identity keeps create busy, the ring is full while the caps change
+    std::string pipe_str = fmt::format("ic4src serial={} drop-policy=block "
+                                       " ! capsfilter name=filter caps={} "
+                                       " ! identity sleep-time=50000"
+                                       " ! appsink name=sink emit-signals=true sync=false",
+                                       serial,
+                                       caps_str);
+
+    GstElement* pipeline = gst_parse_launch(pipe_str.c_str(), nullptr);
+
+    cb_data data;
+
+    GstElement* sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+    g_signal_connect(sink, "new-sample", G_CALLBACK(callback), &data);
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+    sleep(3);
+
+    // set_caps restarts the stream on the streaming thread
+    GstElement* filter = gst_bin_get_by_name(GST_BIN(pipeline), "filter");
+    GstCaps* new_caps = gst_caps_from_string(
+        fmt::format("video/x-raw,format=BGRx,device-format={},width=320,height=240", bayer_fmt)
+            .c_str());
+    g_object_set(G_OBJECT(filter), "caps", new_caps, NULL);
+    gst_caps_unref(new_caps);
+    gst_object_unref(filter);
+
+    sleep(1);
+    unsigned int frames_before = data.frame_counter;
+    sleep(3);
+
+    GstPad* pad = gst_element_get_static_pad(sink, "sink");
+    GstCaps* current = gst_pad_get_current_caps(pad);
+    REQUIRE(current);
+    int width = 0;
+    gst_structure_get_int(gst_caps_get_structure(current, 0), "width", &width);
+    gst_caps_unref(current);
+    gst_object_unref(pad);
+
+    // frames keep arriving, the stream was not left stuck in streamStop
+    CHECK(width == 320);
+    CHECK(data.frame_counter > frames_before + 10);
+
+    g_object_set(G_OBJECT(sink), "emit-signals", FALSE, NULL);
+    gst_object_unref(sink);
+
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+}
@@ -0,0 +1,155 @@
+
+#include <doctest/doctest.h>
+#include <fmt/format.h>
+
+#include <gst/gst.h>
+#include <ic4/ic4.h>
+
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../src/format.h"
+
+namespace
+{
+
+// previous implementation, linear search with a string conversion per entry
+const char* linear_pixel_format_name_to_gst_format(const std::string& name)
+{
+    for (const auto& entry : ic4::gst::get_ic4_gst_table())
+    {
+        // repacked formats are unknown to ic4 and carry their GStreamer name
+        if ((ic4::gst::is_repacked_format(entry.ic4_format) ? std::string(entry.genicam_name)
+                                                            : ic4::to_string(entry.ic4_format))
+            == name)
+        {
+            return entry.gst_format;
+        }
+    }
+    return nullptr;
+}
+
+
+ic4::PixelFormat linear_gst_format_to_pixel_format(const char* format_str)
+{
+    for (const auto& entry : ic4::gst::get_ic4_gst_table())
+    {
+        if (strcmp(entry.gst_format, format_str) == 0)
+        {
+            return entry.ic4_format;
+        }
+    }
+    return ic4::PixelFormat::Invalid;
+}
+
+} // namespace
+
+
+TEST_CASE("format table round trip")
+{
+    const auto table = ic4::gst::get_ic4_gst_table();
+
+    REQUIRE(!table.empty());
+
+    for (const auto& entry : table)
+    {
+        CAPTURE(entry.genicam_name);
+
+        // genicam name has to match what ic4 reports for the device,
+        // repacked formats are unknown to ic4 and carry their GStreamer name
+        if (!ic4::gst::is_repacked_format(entry.ic4_format))
+        {
+            CHECK(ic4::to_string(entry.ic4_format) == entry.genicam_name);
+        }
+        CHECK(ic4::gst::get_pixel_format_name(entry.ic4_format) == entry.genicam_name);
+
+        auto by_name = ic4::gst::get_entry_by_pixel_format_name(entry.genicam_name);
+        REQUIRE(by_name.has_value());
+        CHECK(by_name->ic4_format == entry.ic4_format);
+
+        CHECK(ic4::gst::get_bits_per_pixel(entry.ic4_format) == by_name->bits_per_pixel);
+
+        auto by_format = ic4::gst::get_entry(entry.ic4_format);
+        REQUIRE(by_format.has_value());
+        CHECK(strcmp(by_format->genicam_name, entry.genicam_name) == 0);
+
+        CHECK(strcmp(ic4::gst::pixel_format_name_to_gst_format(entry.genicam_name),
+                     linear_pixel_format_name_to_gst_format(entry.genicam_name))
+              == 0);
+        CHECK(ic4::gst::gst_format_to_pixel_format(entry.gst_format)
+              == linear_gst_format_to_pixel_format(entry.gst_format));
+
+        GstCaps* caps = gst_caps_new_simple(entry.gst_name, "format", G_TYPE_STRING, entry.gst_format, nullptr);
+        CHECK(ic4::gst::gst_caps_to_pixel_format(*caps) == entry.ic4_format);
+        gst_caps_unref(caps);
+    }
+
+    CHECK(!ic4::gst::get_entry_by_pixel_format_name("NotAFormat").has_value());
+    CHECK(!ic4::gst::get_entry(ic4::PixelFormat::Invalid).has_value());
+    CHECK(ic4::gst::get_ic4_gst_table_view().size() == table.size());
+    CHECK(ic4::gst::pixel_format_name_to_gst_format("NotAFormat") == nullptr);
+    CHECK(ic4::gst::gst_format_to_pixel_format("NotAFormat") == ic4::PixelFormat::Invalid);
+    CHECK(ic4::gst::gst_format_to_pixel_format(nullptr) == ic4::PixelFormat::Invalid);
+    CHECK(ic4::gst::get_bits_per_pixel(ic4::PixelFormat::Invalid) == 0);
+
+    CHECK(ic4::gst::get_bits_per_channel(ic4::PixelFormat::BayerRG8) == 8);
+    CHECK(ic4::gst::get_bits_per_channel(ic4::PixelFormat::BayerRG12p) == 12);
+    CHECK(ic4::gst::get_bits_per_channel(ic4::PixelFormat::BGRa16) == 16);
+    CHECK(ic4::gst::get_bits_per_channel(ic4::PixelFormat::Invalid) == 0);
+    CHECK(ic4::gst::get_bits_per_channel(ic4::gst::repacked_format::GRAY10_LE32) == 10);
+    CHECK(ic4::gst::get_bits_per_channel(ic4::gst::repacked_format::NV12) == 8);
+
+    // the GStreamer formats with a different memory layout belong to the repacked formats
+    CHECK(ic4::gst::gst_format_to_pixel_format("IYU1") == ic4::PixelFormat::YCbCr411_8_CbYYCrYY);
+    CHECK(ic4::gst::gst_format_to_pixel_format("NV12") == ic4::gst::repacked_format::NV12);
+    CHECK(ic4::gst::gst_format_to_pixel_format("I420") == ic4::gst::repacked_format::I420);
+    CHECK(ic4::gst::gst_format_to_pixel_format("Y41B") == ic4::PixelFormat::Invalid);
+
+    // media type has to match as well
+    GstCaps* caps = gst_caps_new_simple("video/x-raw", "format", G_TYPE_STRING, "rggb", nullptr);
+    CHECK(ic4::gst::gst_caps_to_pixel_format(*caps) == ic4::PixelFormat::Invalid);
+    gst_caps_unref(caps);
+}
+
+
+TEST_CASE("format lookup benchmark")
+{
+    // the lookups caps generation performs for every device format
+    std::vector<std::string> names;
+    for (const auto& entry : ic4::gst::get_ic4_gst_table())
+    {
+        names.push_back(entry.genicam_name);
+    }
+
+    constexpr size_t iterations = 1000;
+
+    auto measure = [&](auto&& to_gst, auto&& to_ic4)
+    {
+        size_t hits = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; ++i)
+        {
+            for (const auto& n : names)
+            {
+                if (auto gst_format = to_gst(n))
+                {
+                    hits += to_ic4(gst_format) != ic4::PixelFormat::Invalid;
+                }
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+        CHECK(hits == iterations * names.size());
+        return std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+    };
+
+    auto linear = measure(linear_pixel_format_name_to_gst_format, linear_gst_format_to_pixel_format);
+    auto indexed = measure([](const std::string& n) { return ic4::gst::pixel_format_name_to_gst_format(n); },
+                           ic4::gst::gst_format_to_pixel_format);
+
+    MESSAGE(fmt::format("{} lookups: linear {} us, indexed {} us",
+                        iterations * names.size() * 2,
+                        linear.count(),
+                        indexed.count()));
+}
@@ -0,0 +1,85 @@
+#include <doctest/doctest.h>
+
+#include <cstdint>
+
+#include "../src/fps_model.h"
+
+using ic4::gst::fps_model;
+
+namespace
+{
+
+// 2448 pixel wide sensor with 100 us overhead and 10 us per line,
+// measured with an 8 bit format
+fps_model make_model(double link_limit)
+{
+    fps_model model;
+    model.calibrated = true;
+    model.frame_overhead_s = 100e-6;
+    model.line_time_s = 10e-6;
+    model.bits_per_pixel = 8;
+    model.width = 2448;
+    model.link_limit = link_limit;
+    return model;
+}
+
+} // namespace
+
+
+TEST_CASE("fps model without link limit")
+{
+    auto model = make_model(0.0);
+
+    CHECK(model.max_fps(2048) == doctest::Approx(1.0 / (100e-6 + 2048 * 10e-6)));
+    CHECK(model.max_fps(2048, 8, 2448) == model.max_fps(2048));
+    CHECK(model.max_fps(2048, 16, 2448) == model.max_fps(2048));
+}
+
+
+TEST_CASE("fps model scales formats against the link limit")
+{
+    SUBCASE("sensor limited")
+    {
+        // 8 bit fits the link at every height, 16 bit does not
+        auto model = make_model(400e6);
+        const int64_t height = 2048;
+
+        double fps_8 = model.max_fps(height, 8, 2448);
+        double fps_16 = model.max_fps(height, 16, 2448);
+
+        CHECK(fps_8 == doctest::Approx(model.max_fps(height)));
+        CHECK(fps_16 < fps_8);
+        CHECK(fps_16 == doctest::Approx(400e6 / (2448.0 * height * 2)));
+
+        // small frames are sensor limited for both formats
+        CHECK(model.max_fps(16, 16, 2448) == doctest::Approx(model.max_fps(16, 8, 2448)));
+    }
+
+    SUBCASE("link limited")
+    {
+        // the measured line time is exactly the link time of 8 bit
+        auto model = make_model(2448.0 / 10e-6);
+        model.frame_overhead_s = 0.0;
+        const int64_t height = 1024;
+
+        double fps_8 = model.max_fps(height, 8, 2448);
+        double fps_12 = model.max_fps(height, 12, 2448);
+        double fps_16 = model.max_fps(height, 16, 2448);
+
+        CHECK(fps_8 == doctest::Approx(model.max_fps(height)));
+        CHECK(fps_12 == doctest::Approx(fps_8 * 8.0 / 12.0));
+        CHECK(fps_16 == doctest::Approx(fps_8 / 2.0));
+
+        // 2x2 binning halves width and height, the link carries a quarter
+        CHECK(model.max_fps(height / 2, 8, 2448 / 2) == doctest::Approx(fps_8 * 4.0));
+    }
+
+    SUBCASE("binned frames fit the link")
+    {
+        auto model = make_model(400e6);
+
+        // half the width of 16 bit frames fits where full frames do not
+        CHECK(model.max_fps(1024, 16, 1224) == doctest::Approx(model.max_fps(1024)));
+        CHECK(model.max_fps(1024, 16, 2448) < model.max_fps(1024));
+    }
+}
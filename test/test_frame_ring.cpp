@@ -0,0 +1,158 @@
+#include <doctest/doctest.h>
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "../src/frame_queue.h"
+
+using ic4::gst::frame_ring;
+
+namespace
+{
+
+// value 0 marks an empty pop
+struct entry
+{
+    uint64_t value = 0;
+};
+
+} // namespace
+
+
+TEST_CASE("frame ring fill and overflow")
+{
+    frame_ring<entry> ring;
+
+    // not reset yet
+    CHECK(!ring.push({ 1 }));
+    CHECK(ring.pop().value == 0);
+
+    ring.reset(5);
+    REQUIRE(ring.capacity() == 8);
+    CHECK(ring.empty());
+
+    for (uint64_t i = 1; i <= 8; ++i)
+    {
+        CHECK(ring.push({ i }));
+    }
+    CHECK(ring.size() == 8);
+
+    // full, the entry is rejected
+    CHECK(!ring.push({ 9 }));
+    CHECK(ring.size() == 8);
+
+    for (uint64_t i = 1; i <= 8; ++i)
+    {
+        CHECK(ring.pop().value == i);
+    }
+    CHECK(ring.empty());
+    CHECK(ring.pop().value == 0);
+}
+
+
+TEST_CASE("frame ring wraps around")
+{
+    frame_ring<entry> ring;
+    ring.reset(4);
+
+    uint64_t pushed = 0;
+    uint64_t popped = 0;
+
+    REQUIRE(ring.push({ ++pushed }));
+
+    // keep the ring partially filled while the indices go around many times
+    for (int round = 0; round < 100; ++round)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            REQUIRE(ring.push({ ++pushed }));
+        }
+        REQUIRE(ring.size() == ring.capacity());
+        REQUIRE(!ring.push({ pushed + 1 }));
+
+        for (int i = 0; i < 3; ++i)
+        {
+            REQUIRE(ring.pop().value == ++popped);
+        }
+    }
+    CHECK(ring.pop().value == ++popped);
+    CHECK(ring.empty());
+    CHECK(popped == pushed);
+
+    ring.clear();
+    CHECK(ring.empty());
+    CHECK(ring.push({ 1 }));
+    CHECK(ring.pop().value == 1);
+}
+
+
+TEST_CASE("frame ring with multiple consumers")
+{
+    // one producer like framesQueued, several threads popping,
+    // like gst_ic4_src_create and the drop policy of the producer
+    constexpr uint64_t count = 200000;
+    constexpr int consumers = 4;
+
+    frame_ring<entry> ring;
+    ring.reset(16);
+
+    std::vector<std::atomic<int>> received(count + 1);
+    std::atomic<uint64_t> total = 0;
+    std::atomic<bool> out_of_order = false;
+
+    std::vector<std::thread> threads;
+    for (int c = 0; c < consumers; ++c)
+    {
+        threads.emplace_back(
+            [&]
+            {
+                uint64_t last = 0;
+                while (total.load() < count)
+                {
+                    auto e = ring.pop();
+                    if (e.value == 0)
+                    {
+                        std::this_thread::yield();
+                        continue;
+                    }
+                    // slots are claimed in order, a single consumer never goes back
+                    if (e.value <= last)
+                    {
+                        out_of_order = true;
+                    }
+                    last = e.value;
+                    received[e.value]++;
+                    total++;
+                }
+            });
+    }
+
+    for (uint64_t i = 1; i <= count; ++i)
+    {
+        while (!ring.push({ i }))
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+
+    CHECK(total == count);
+    CHECK(!out_of_order);
+    CHECK(ring.empty());
+
+    uint64_t missing = 0;
+    uint64_t duplicated = 0;
+    for (uint64_t i = 1; i <= count; ++i)
+    {
+        missing += received[i] == 0;
+        duplicated += received[i] > 1;
+    }
+    CHECK(missing == 0);
+    CHECK(duplicated == 0);
+}
@@ -0,0 +1,123 @@
+#include <doctest/doctest.h>
+
+#include <gst/base/gstbasetransform.h>
+#include <gst/gst.h>
+
+#include <cstring>
+
+namespace
+{
+
+GstCaps* transform_caps(GstElement* convert, GstPadDirection direction, const char* caps_str)
+{
+    GstCaps* caps = gst_caps_from_string(caps_str);
+    GstCaps* ret = GST_BASE_TRANSFORM_GET_CLASS(convert)->transform_caps(GST_BASE_TRANSFORM(convert),
+                                                                          direction,
+                                                                          caps,
+                                                                          nullptr);
+    gst_caps_unref(caps);
+    return ret;
+}
+
+
+bool can_intersect(GstCaps* caps, const char* caps_str)
+{
+    GstCaps* other = gst_caps_from_string(caps_str);
+    bool ret = gst_caps_can_intersect(caps, other);
+    gst_caps_unref(other);
+    return ret;
+}
+
+} // namespace
+
+
+TEST_CASE("ic4convert caps")
+{
+    GstElement* convert = gst_element_factory_make("ic4convert", nullptr);
+    REQUIRE(convert != nullptr);
+
+    SUBCASE("output")
+    {
+        GstCaps* out = transform_caps(convert,
+                                      GST_PAD_SINK,
+                                      "video/x-bayer,format=rggb,width=640,height=480,framerate=30/1");
+
+        // passthrough and conversions that name their input as device-format
+        CHECK(can_intersect(out, "video/x-bayer,format=rggb,width=640,height=480"));
+        CHECK(can_intersect(out, "video/x-raw,format=BGRx,device-format=rggb,width=640,height=480"));
+        CHECK(!can_intersect(out, "video/x-raw,format=BGRx,device-format=GRAY8"));
+        CHECK(!can_intersect(out, "video/x-raw,format=BGRx,width=320"));
+
+        gst_caps_unref(out);
+    }
+
+    SUBCASE("input")
+    {
+        GstCaps* in = transform_caps(convert,
+                                     GST_PAD_SRC,
+                                     "video/x-raw,format=BGRx,device-format=rggb,width=640,height=480");
+
+        CHECK(can_intersect(in, "video/x-bayer,format=rggb,width=640,height=480"));
+        // device-format requires a conversion, BGRx itself is no valid input
+        CHECK(!can_intersect(in, "video/x-raw,format=BGRx"));
+        CHECK(!can_intersect(in, "video/x-bayer,format=bggr"));
+
+        gst_caps_unref(in);
+
+        in = transform_caps(convert, GST_PAD_SRC, "video/x-raw,format=BGRx,width=640,height=480");
+
+        CHECK(can_intersect(in, "video/x-raw,format=BGRx,width=640,height=480"));
+        CHECK(can_intersect(in, "video/x-bayer,format=rggb,width=640,height=480"));
+
+        gst_caps_unref(in);
+    }
+
+    gst_object_unref(convert);
+}
+
+
+TEST_CASE("ic4convert converts bayer")
+{
+    constexpr int width = 64;
+    constexpr int height = 48;
+
+    GError* err = nullptr;
+    GstElement* pipeline = gst_parse_launch(
+        "appsrc name=src format=time caps=video/x-bayer,format=rggb,width=64,height=48,framerate=30/1 "
+        "! ic4convert ! video/x-raw,format=BGRx ! appsink name=sink",
+        &err);
+
+    REQUIRE(err == nullptr);
+    REQUIRE(pipeline != nullptr);
+
+    GstElement* src = gst_bin_get_by_name(GST_BIN(pipeline), "src");
+    GstElement* sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+    GstBuffer* buffer = gst_buffer_new_allocate(nullptr, width * height, nullptr);
+    gst_buffer_memset(buffer, 0, 0x80, width * height);
+    GST_BUFFER_PTS(buffer) = 0;
+
+    GstFlowReturn flow = GST_FLOW_OK;
+    g_signal_emit_by_name(src, "push-buffer", buffer, &flow);
+    gst_buffer_unref(buffer);
+    CHECK(flow == GST_FLOW_OK);
+
+    GstSample* sample = nullptr;
+    g_signal_emit_by_name(sink, "pull-sample", &sample);
+    REQUIRE(sample != nullptr);
+
+    GstStructure* struc = gst_caps_get_structure(gst_sample_get_caps(sample), 0);
+    CHECK(strcmp(gst_structure_get_string(struc, "format"), "BGRx") == 0);
+    CHECK(strcmp(gst_structure_get_string(struc, "device-format"), "rggb") == 0);
+    CHECK(gst_buffer_get_size(gst_sample_get_buffer(sample)) == width * height * 4);
+
+    gst_sample_unref(sample);
+
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+
+    gst_object_unref(src);
+    gst_object_unref(sink);
+    gst_object_unref(pipeline);
+}
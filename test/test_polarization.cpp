@@ -0,0 +1,548 @@
+#include <doctest/doctest.h>
+#include <fmt/format.h>
+
+#include <gst/base/gstbasetransform.h>
+#include <gst/gst.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "../src/polarization.h"
+
+using ic4::gst::image_view;
+using ic4::gst::polarization_kernel;
+using ic4::gst::polarization_mode;
+
+namespace
+{
+
+template<typename T>
+void check_split_kernels(std::mt19937& rng)
+{
+    // widths around every block size of the kernels and their tails
+    std::vector<int> widths;
+    for (int w = 2; w <= 140; w += 2)
+    {
+        widths.push_back(w);
+    }
+    widths.insert(widths.end(), { 640, 2448, 5472 });
+
+    for (int width : widths)
+    {
+        std::vector<T> upper(width);
+        std::vector<T> lower(width);
+        for (int x = 0; x < width; ++x)
+        {
+            upper[x] = (T)rng();
+            lower[x] = (T)rng();
+        }
+
+        std::vector<T> expected[4];
+        T* expected_ptrs[4];
+        for (int i = 0; i < 4; ++i)
+        {
+            expected[i].assign(width / 2, 0);
+            expected_ptrs[i] = expected[i].data();
+        }
+        ic4::gst::split_lines(polarization_kernel::reference,
+                              upper.data(),
+                              lower.data(),
+                              expected_ptrs,
+                              width);
+
+        for (auto kernel : ic4::gst::available_polarization_kernels())
+        {
+            CAPTURE(sizeof(T));
+            CAPTURE(width);
+            CAPTURE(ic4::gst::to_string(kernel));
+
+            // one guard value behind every plane catches writes past the end
+            std::vector<T> dst[4];
+            T* dst_ptrs[4];
+            for (int i = 0; i < 4; ++i)
+            {
+                dst[i].assign(width / 2 + 1, (T)0x5A);
+                dst_ptrs[i] = dst[i].data();
+            }
+            ic4::gst::split_lines(kernel, upper.data(), lower.data(), dst_ptrs, width);
+
+            for (int i = 0; i < 4; ++i)
+            {
+                CHECK(std::equal(expected[i].begin(), expected[i].end(), dst[i].begin()));
+                CHECK(dst[i].back() == (T)0x5A);
+            }
+        }
+    }
+}
+
+
+template<typename T>
+void check_aolp_dolp_kernels(std::mt19937& rng)
+{
+    for (int width : { 1, 3, 4, 7, 8, 9, 15, 16, 17, 33, 640, 1225 })
+    {
+        std::vector<T> planes[4];
+        for (auto& p : planes)
+        {
+            p.resize(width);
+            for (auto& v : p)
+            {
+                v = (T)rng();
+            }
+        }
+        // black pixels and equal values hit every branch of the atan2 reconstruction
+        planes[0][0] = planes[1][0] = planes[2][0] = planes[3][0] = 0;
+        if (width > 1)
+        {
+            planes[0][1] = planes[2][1];
+        }
+        const T* const angles[4] = {
+            planes[0].data(), planes[1].data(), planes[2].data(), planes[3].data(),
+        };
+
+        std::vector<T> expected_aolp(width);
+        std::vector<T> expected_dolp(width);
+        ic4::gst::compute_aolp_dolp(polarization_kernel::reference,
+                                    angles,
+                                    expected_aolp.data(),
+                                    expected_dolp.data(),
+                                    width);
+
+        for (auto kernel : ic4::gst::available_polarization_kernels())
+        {
+            CAPTURE(sizeof(T));
+            CAPTURE(width);
+            CAPTURE(ic4::gst::to_string(kernel));
+
+            std::vector<T> aolp(width + 1, (T)0x5A);
+            std::vector<T> dolp(width + 1, (T)0x5A);
+            ic4::gst::compute_aolp_dolp(kernel, angles, aolp.data(), dolp.data(), width);
+
+            CHECK(std::equal(expected_aolp.begin(), expected_aolp.end(), aolp.begin()));
+            CHECK(std::equal(expected_dolp.begin(), expected_dolp.end(), dolp.begin()));
+            CHECK(aolp.back() == (T)0x5A);
+            CHECK(dolp.back() == (T)0x5A);
+        }
+    }
+}
+
+
+GstCaps* transform_caps(GstElement* split, GstPadDirection direction, const char* caps_str)
+{
+    GstCaps* caps = gst_caps_from_string(caps_str);
+    GstCaps* ret = GST_BASE_TRANSFORM_GET_CLASS(split)->transform_caps(GST_BASE_TRANSFORM(split),
+                                                                        direction,
+                                                                        caps,
+                                                                        nullptr);
+    gst_caps_unref(caps);
+    return ret;
+}
+
+
+bool can_intersect(GstCaps* caps, const char* caps_str)
+{
+    GstCaps* other = gst_caps_from_string(caps_str);
+    bool ret = gst_caps_can_intersect(caps, other);
+    gst_caps_unref(other);
+    return ret;
+}
+
+} // namespace
+
+
+TEST_CASE("polarization formats")
+{
+    CHECK(ic4::gst::get_angle_format(ic4::PixelFormat::PolarizedMono8) == ic4::PixelFormat::Mono8);
+    CHECK(ic4::gst::get_angle_format(ic4::PixelFormat::PolarizedBayerBG16)
+          == ic4::PixelFormat::BayerBG16);
+    // packed formats are unpacked by ic4src first
+    CHECK(ic4::gst::get_angle_format(ic4::PixelFormat::PolarizedMono12p)
+          == ic4::PixelFormat::Invalid);
+    CHECK(ic4::gst::get_angle_format(ic4::PixelFormat::Mono8) == ic4::PixelFormat::Invalid);
+
+    CHECK(ic4::gst::get_polarized_format(ic4::PixelFormat::BayerBG8)
+          == ic4::PixelFormat::PolarizedBayerBG8);
+    CHECK(ic4::gst::get_polarized_format(ic4::PixelFormat::PolarizedMono8)
+          == ic4::PixelFormat::Invalid);
+
+    CHECK(ic4::gst::can_compute_aolp_dolp(ic4::PixelFormat::PolarizedMono16));
+    CHECK(!ic4::gst::can_compute_aolp_dolp(ic4::PixelFormat::PolarizedBayerBG8));
+
+    CHECK(ic4::gst::polarization_planes(polarization_mode::angles) == 4);
+    CHECK(ic4::gst::polarization_planes(polarization_mode::aolp_dolp) == 2);
+    CHECK(ic4::gst::polarization_planes(polarization_mode::all) == 6);
+}
+
+
+TEST_CASE("polarization known values")
+{
+    SUBCASE("mosaic")
+    {
+        // 90 45
+        // 135 0
+        const uint8_t upper[] = { 90, 45, 91, 46 };
+        const uint8_t lower[] = { 135, 0, 136, 1 };
+
+        uint8_t planes[4][2] = {};
+        uint8_t* const angles[4] = { planes[0], planes[1], planes[2], planes[3] };
+        ic4::gst::split_lines(polarization_kernel::reference, upper, lower, angles, 4);
+
+        CHECK(planes[0][0] == 0);
+        CHECK(planes[1][0] == 45);
+        CHECK(planes[2][0] == 90);
+        CHECK(planes[3][0] == 135);
+        CHECK(planes[0][1] == 1);
+        CHECK(planes[3][1] == 136);
+    }
+
+    SUBCASE("aolp and dolp")
+    {
+        // fully polarized at 0, 45, 90 and 135 degree, unpolarized, black
+        const uint16_t i0[] = { 40000, 20000, 0, 20000, 30000, 0 };
+        const uint16_t i45[] = { 20000, 40000, 20000, 0, 30000, 0 };
+        const uint16_t i90[] = { 0, 20000, 40000, 20000, 30000, 0 };
+        const uint16_t i135[] = { 20000, 0, 20000, 40000, 30000, 0 };
+        const uint16_t* const angles[4] = { i0, i45, i90, i135 };
+
+        uint16_t aolp[6] = {};
+        uint16_t dolp[6] = {};
+        ic4::gst::compute_aolp_dolp(polarization_kernel::reference, angles, aolp, dolp, 6);
+
+        // 0 to 180 degree cover the full range
+        CHECK(aolp[0] == 0);
+        CHECK(std::abs(aolp[1] - 65535 / 4) <= 1);
+        CHECK(std::abs(aolp[2] - 65535 / 2) <= 1);
+        CHECK(std::abs(aolp[3] - 65535 * 3 / 4) <= 1);
+
+        CHECK(dolp[0] == 65535);
+        CHECK(dolp[1] == 65535);
+        CHECK(dolp[4] == 0);
+        CHECK(dolp[5] == 0);
+    }
+}
+
+
+TEST_CASE("aolp approximation")
+{
+    // AoLP of 16 bit values against the exact arc tangent
+    constexpr int steps = 3600;
+
+    std::vector<uint16_t> planes[4];
+    for (auto& p : planes)
+    {
+        p.resize(steps);
+    }
+
+    for (int i = 0; i < steps; ++i)
+    {
+        const double theta = M_PI * i / steps;
+        const double s1 = 20000.0 * std::cos(2 * theta);
+        const double s2 = 20000.0 * std::sin(2 * theta);
+
+        planes[0][i] = (uint16_t)std::lround(30000.0 + s1);
+        planes[2][i] = (uint16_t)std::lround(30000.0 - s1);
+        planes[1][i] = (uint16_t)std::lround(30000.0 + s2);
+        planes[3][i] = (uint16_t)std::lround(30000.0 - s2);
+    }
+
+    const uint16_t* const angles[4] = {
+        planes[0].data(), planes[1].data(), planes[2].data(), planes[3].data(),
+    };
+    std::vector<uint16_t> aolp(steps);
+    std::vector<uint16_t> dolp(steps);
+    ic4::gst::compute_aolp_dolp(polarization_kernel::reference,
+                                angles,
+                                aolp.data(),
+                                dolp.data(),
+                                steps);
+
+    for (int i = 0; i < steps; ++i)
+    {
+        const double s1 = (double)planes[0][i] - planes[2][i];
+        const double s2 = (double)planes[1][i] - planes[3][i];
+        double exact = std::atan2(s2, s1);
+        if (exact < 0)
+        {
+            exact += 2 * M_PI;
+        }
+        exact *= 65535.0 / (2 * M_PI);
+
+        CAPTURE(i);
+        // rounding of the output and the approximation together
+        CHECK(std::abs(aolp[i] - exact) < 0.6);
+        // S0 is 60000 for every angle
+        CHECK(std::abs(dolp[i] - std::sqrt(s1 * s1 + s2 * s2) / 60000.0 * 65535.0) < 0.6);
+    }
+}
+
+
+TEST_CASE("polarization kernels are bit exact")
+{
+    std::mt19937 rng(45);
+
+    check_split_kernels<uint8_t>(rng);
+    check_split_kernels<uint16_t>(rng);
+    check_aolp_dolp_kernels<uint8_t>(rng);
+    check_aolp_dolp_kernels<uint16_t>(rng);
+}
+
+
+TEST_CASE("split polarized frame")
+{
+    constexpr int width = 6;
+    constexpr int height = 4;
+    constexpr size_t pitch = width + 10;
+
+    std::vector<uint8_t> src(pitch * height, 0xEE);
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            src[y * pitch + x] = (uint8_t)(y * 16 + x);
+        }
+    }
+    image_view src_view = { src.data(), pitch, ic4::PixelFormat::PolarizedMono8, width, height };
+
+    SUBCASE("angles")
+    {
+        // planes of 3x2 pixels stacked in the order 0, 45, 90, 135
+        std::vector<uint8_t> dst(4 * 4 * 2, 0xCD);
+        image_view dst_view = { dst.data(), 4, ic4::PixelFormat::Mono8, 3, 8 };
+        REQUIRE(ic4::gst::split_polarization(src_view, polarization_mode::angles, dst_view, {}));
+
+        CHECK(dst[0 * 4 + 0] == 0x11);
+        CHECK(dst[1 * 4 + 2] == 0x35);
+        CHECK(dst[2 * 4 + 0] == 0x01);
+        CHECK(dst[4 * 4 + 1] == 0x02);
+        CHECK(dst[7 * 4 + 2] == 0x34);
+        // the line padding is left alone
+        CHECK(dst[3] == 0xCD);
+    }
+
+    SUBCASE("all")
+    {
+        std::vector<uint8_t> dst(3 * 12, 0);
+        image_view dst_view = { dst.data(), 3, ic4::PixelFormat::Mono8, 3, 12 };
+        REQUIRE(ic4::gst::split_polarization(src_view, polarization_mode::all, dst_view, {}));
+
+        // AoLP and DoLP follow the angles
+        uint8_t aolp[3];
+        uint8_t dolp[3];
+        const uint8_t* const angles[4] = { &dst[0], &dst[6], &dst[12], &dst[18] };
+        ic4::gst::compute_aolp_dolp(polarization_kernel::reference, angles, aolp, dolp, 3);
+
+        CHECK(std::equal(aolp, aolp + 3, &dst[24]));
+        CHECK(std::equal(dolp, dolp + 3, &dst[30]));
+    }
+
+    SUBCASE("aolp-dolp")
+    {
+        std::vector<uint8_t> all(3 * 12, 0);
+        image_view all_view = { all.data(), 3, ic4::PixelFormat::Mono8, 3, 12 };
+        REQUIRE(ic4::gst::split_polarization(src_view, polarization_mode::all, all_view, {}));
+
+        std::vector<uint8_t> dst(3 * 4, 0);
+        image_view dst_view = { dst.data(), 3, ic4::PixelFormat::Mono8, 3, 4 };
+        // the angles pass through scratch
+        CHECK(!ic4::gst::split_polarization(src_view, polarization_mode::aolp_dolp, dst_view, {}));
+
+        std::vector<uint8_t> scratch(
+            ic4::gst::polarization_scratch_size(polarization_mode::aolp_dolp, dst_view.format, 3));
+        CHECK(scratch.size() == 12);
+        REQUIRE(
+            ic4::gst::split_polarization(src_view, polarization_mode::aolp_dolp, dst_view, scratch));
+        CHECK(std::equal(dst.begin(), dst.end(), &all[24]));
+    }
+
+    SUBCASE("sizes and formats have to match")
+    {
+        std::vector<uint8_t> dst(4 * 12);
+        image_view dst_view = { dst.data(), 4, ic4::PixelFormat::Mono8, 3, 8 };
+        CHECK(!ic4::gst::split_polarization(src_view, polarization_mode::all, dst_view, {}));
+
+        dst_view.format = ic4::PixelFormat::Mono16;
+        CHECK(!ic4::gst::split_polarization(src_view, polarization_mode::angles, dst_view, {}));
+
+        // bayer planes would be misread as bayer patterns
+        src_view.format = ic4::PixelFormat::PolarizedBayerBG8;
+        dst_view = { dst.data(), 4, ic4::PixelFormat::BayerBG8, 3, 4 };
+        CHECK(!ic4::gst::split_polarization(src_view, polarization_mode::aolp_dolp, dst_view, {}));
+
+        src_view.height = 3;
+        dst_view.height = 4;
+        CHECK(!ic4::gst::split_polarization(src_view, polarization_mode::angles, dst_view, {}));
+    }
+}
+
+
+TEST_CASE("ic4polarsplit caps")
+{
+    GstElement* split = gst_element_factory_make("ic4polarsplit", nullptr);
+    REQUIRE(split != nullptr);
+
+    SUBCASE("angles")
+    {
+        GstCaps* out = transform_caps(
+            split, GST_PAD_SINK, "video/x-raw,format=polarized-GRAY8-v0,width=2448,height=2048");
+
+        // four planes of half the size, stacked
+        CHECK(can_intersect(out, "video/x-raw,format=GRAY8,width=1224,height=4096"));
+        CHECK(!can_intersect(out, "video/x-raw,format=GRAY8,width=2448"));
+        gst_caps_unref(out);
+
+        GstCaps* in = transform_caps(split,
+                                     GST_PAD_SRC,
+                                     "video/x-bayer,format=bggr16,width=1224,height=4096");
+
+        CHECK(can_intersect(
+            in, "video/x-bayer,format=polarized-bayer-bggr16-v0,width=2448,height=2048"));
+        CHECK(!can_intersect(in, "video/x-raw,format=polarized-GRAY16-v0"));
+        gst_caps_unref(in);
+    }
+
+    SUBCASE("aolp-dolp")
+    {
+        gst_util_set_object_arg(G_OBJECT(split), "mode", "aolp-dolp");
+
+        GstCaps* out = transform_caps(
+            split, GST_PAD_SINK, "video/x-raw,format=polarized-GRAY16-v0,width=[ 2, 4096 ]");
+
+        CHECK(can_intersect(out, "video/x-raw,format=GRAY16_LE,width=2048"));
+        CHECK(!can_intersect(out, "video/x-raw,format=GRAY16_LE,width=4096"));
+        gst_caps_unref(out);
+
+        // bayer planes would be misread as bayer patterns
+        out = transform_caps(split, GST_PAD_SINK, "video/x-bayer,format=polarized-bggr8-v0");
+        CHECK(gst_caps_is_empty(out));
+        gst_caps_unref(out);
+    }
+
+    gst_object_unref(split);
+}
+
+
+TEST_CASE("ic4polarsplit splits frames")
+{
+    constexpr int width = 4;
+    constexpr int height = 4;
+
+    GError* err = nullptr;
+    GstElement* pipeline = gst_parse_launch(
+        "appsrc name=src format=time "
+        "caps=video/x-raw,format=polarized-GRAY8-v0,width=4,height=4,framerate=30/1 "
+        "! ic4polarsplit mode=all ! appsink name=sink",
+        &err);
+
+    REQUIRE(err == nullptr);
+    REQUIRE(pipeline != nullptr);
+
+    GstElement* src = gst_bin_get_by_name(GST_BIN(pipeline), "src");
+    GstElement* sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+    // 90 and 45 above 135 and 0, fully polarized at 0 degree
+    const uint8_t mosaic[] = { 0, 100, 0, 100, 100, 200, 100, 200 };
+
+    GstBuffer* buffer = gst_buffer_new_allocate(nullptr, width * height, nullptr);
+    gst_buffer_fill(buffer, 0, mosaic, sizeof(mosaic));
+    gst_buffer_fill(buffer, sizeof(mosaic), mosaic, sizeof(mosaic));
+    GST_BUFFER_PTS(buffer) = 0;
+
+    GstFlowReturn flow = GST_FLOW_OK;
+    g_signal_emit_by_name(src, "push-buffer", buffer, &flow);
+    gst_buffer_unref(buffer);
+    CHECK(flow == GST_FLOW_OK);
+
+    GstSample* sample = nullptr;
+    g_signal_emit_by_name(sink, "pull-sample", &sample);
+    REQUIRE(sample != nullptr);
+
+    GstStructure* struc = gst_caps_get_structure(gst_sample_get_caps(sample), 0);
+    CHECK(strcmp(gst_structure_get_string(struc, "format"), "GRAY8") == 0);
+
+    int out_width = 0;
+    int out_height = 0;
+    gst_structure_get_int(struc, "width", &out_width);
+    gst_structure_get_int(struc, "height", &out_height);
+    CHECK(out_width == 2);
+    CHECK(out_height == 12);
+
+    GstMapInfo map;
+    REQUIRE(gst_buffer_map(gst_sample_get_buffer(sample), &map, GST_MAP_READ));
+
+    // GRAY8 lines are padded to 4 bytes
+    constexpr size_t stride = 4;
+    CHECK(map.data[0 * stride] == 200);
+    CHECK(map.data[2 * stride] == 100);
+    CHECK(map.data[4 * stride] == 0);
+    CHECK(map.data[6 * stride] == 100);
+    // AoLP of 0 degree, DoLP of 1
+    CHECK(map.data[8 * stride] == 0);
+    CHECK(map.data[10 * stride] == 255);
+
+    gst_buffer_unmap(gst_sample_get_buffer(sample), &map);
+    gst_sample_unref(sample);
+
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+
+    gst_object_unref(src);
+    gst_object_unref(sink);
+    gst_object_unref(pipeline);
+}
+
+
+TEST_CASE("polarization benchmark")
+{
+    // one 5 MP frame of the IMX250MZR
+    constexpr int width = 2448;
+    constexpr int height = 2048;
+
+    std::mt19937 rng(9);
+
+    std::vector<uint8_t> src(width * height);
+    for (auto& b : src)
+    {
+        b = (uint8_t)rng();
+    }
+
+    std::vector<uint8_t> planes(width / 2 * height / 2 * 6);
+    const int plane_size = width / 2 * height / 2;
+
+    for (auto kernel : ic4::gst::available_polarization_kernels())
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (int y = 0; y < height / 2; ++y)
+        {
+            uint8_t* const angles[4] = {
+                planes.data() + y * width / 2,
+                planes.data() + plane_size + y * width / 2,
+                planes.data() + 2 * plane_size + y * width / 2,
+                planes.data() + 3 * plane_size + y * width / 2,
+            };
+            ic4::gst::split_lines(kernel,
+                                  src.data() + 2 * y * width,
+                                  src.data() + (2 * y + 1) * width,
+                                  angles,
+                                  width);
+            ic4::gst::compute_aolp_dolp(kernel,
+                                        angles,
+                                        planes.data() + 4 * plane_size + y * width / 2,
+                                        planes.data() + 5 * plane_size + y * width / 2,
+                                        width / 2);
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+        MESSAGE(fmt::format("PolarizedMono8 split with AoLP and DoLP {}: {} us per frame, "
+                            "{:.0f} MPixel/s",
+                            ic4::gst::to_string(kernel),
+                            us,
+                            us > 0 ? double(width * height) / us : 0.0));
+    }
+}
@@ -0,0 +1,152 @@
+#include <doctest/doctest.h>
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "../src/repack.h"
+
+using ic4::gst::image_view;
+namespace repacked_format = ic4::gst::repacked_format;
+
+namespace
+{
+
+struct repacked
+{
+    GstVideoInfo info;
+    std::vector<uint8_t> data;
+
+    repacked(GstVideoFormat fmt, int width, int height)
+    {
+        gst_video_info_set_format(&info, fmt, width, height);
+        data.assign(GST_VIDEO_INFO_SIZE(&info), 0xCD);
+    }
+
+    uint8_t at(int plane, int x, int y) const
+    {
+        return data[GST_VIDEO_INFO_PLANE_OFFSET(&info, plane)
+                    + y * GST_VIDEO_INFO_PLANE_STRIDE(&info, plane) + x];
+    }
+};
+
+
+bool repack(std::vector<uint8_t>& src,
+            size_t pitch,
+            ic4::PixelFormat fmt,
+            int width,
+            int height,
+            repacked& dst)
+{
+    image_view view = { src.data(), pitch, fmt, width, height };
+    std::vector<uint8_t> scratch(ic4::gst::repack_scratch_size(dst.info));
+    return ic4::gst::repack_frame(view, dst.info, dst.data.data(), scratch);
+}
+
+} // namespace
+
+
+TEST_CASE("repacked formats")
+{
+    CHECK(ic4::gst::can_repack(ic4::PixelFormat::Mono10p, repacked_format::GRAY10_LE32));
+    CHECK(ic4::gst::can_repack(ic4::PixelFormat::YCbCr422_8, repacked_format::NV12));
+    CHECK(ic4::gst::can_repack(ic4::PixelFormat::YCbCr411_8_CbYYCrYY, repacked_format::I420));
+    CHECK(!ic4::gst::can_repack(ic4::PixelFormat::Mono12p, repacked_format::GRAY10_LE32));
+    CHECK(!ic4::gst::can_repack(ic4::PixelFormat::Mono8, repacked_format::I420));
+    CHECK(ic4::gst::get_repacked_formats(ic4::PixelFormat::BayerRG8).empty());
+}
+
+
+TEST_CASE("repack Mono10p to GRAY10_LE32")
+{
+    // 0x3FF, 0x000, 0x155, 0x2AA
+    std::vector<uint8_t> src = { 0xFF, 0x03, 0x50, 0x95, 0xAA };
+
+    repacked dst(GST_VIDEO_FORMAT_GRAY10_LE32, 4, 1);
+    REQUIRE(repack(src, src.size(), ic4::PixelFormat::Mono10p, 4, 1, dst));
+
+    // 3 pixels per word, the last word is completed with zeros
+    CHECK(GST_READ_UINT32_LE(dst.data.data()) == (0x3FFu | 0x000u << 10 | 0x155u << 20));
+    CHECK(GST_READ_UINT32_LE(dst.data.data() + 4) == 0x2AAu);
+
+    // the device format has to match
+    CHECK(!repack(src, src.size(), ic4::PixelFormat::Mono12p, 4, 1, dst));
+
+    // the unpacked line needs scratch memory
+    CHECK(ic4::gst::repack_scratch_size(dst.info) == 12);
+    image_view view = { src.data(), src.size(), ic4::PixelFormat::Mono10p, 4, 1 };
+    CHECK(!ic4::gst::repack_frame(view, dst.info, dst.data.data(), {}));
+}
+
+
+TEST_CASE("repack YUV to 4:2:0")
+{
+    SUBCASE("YUY2 to I420")
+    {
+        std::vector<uint8_t> src = {
+            10, 100, 20, 200,
+            30, 110, 40, 211,
+        };
+        repacked dst(GST_VIDEO_FORMAT_I420, 2, 2);
+        REQUIRE(repack(src, 4, ic4::PixelFormat::YUV422_8, 2, 2, dst));
+
+        CHECK(dst.at(0, 0, 0) == 10);
+        CHECK(dst.at(0, 1, 0) == 20);
+        CHECK(dst.at(0, 0, 1) == 30);
+        CHECK(dst.at(0, 1, 1) == 40);
+        // chroma of both lines is averaged, rounding up
+        CHECK(dst.at(1, 0, 0) == 105);
+        CHECK(dst.at(2, 0, 0) == 206);
+    }
+
+    SUBCASE("UYVY to NV12 with odd height")
+    {
+        std::vector<uint8_t> src = {
+            100, 10, 200, 20,
+            110, 30, 210, 40,
+            120, 50, 220, 60,
+        };
+        repacked dst(GST_VIDEO_FORMAT_NV12, 2, 3);
+        REQUIRE(repack(src, 4, ic4::PixelFormat::YCbCr422_8, 2, 3, dst));
+
+        CHECK(dst.at(0, 0, 2) == 50);
+        CHECK(dst.at(0, 1, 2) == 60);
+        // interleaved UV, the last line has no partner
+        CHECK(dst.at(1, 0, 0) == 105);
+        CHECK(dst.at(1, 1, 0) == 205);
+        CHECK(dst.at(1, 0, 1) == 120);
+        CHECK(dst.at(1, 1, 1) == 220);
+    }
+
+    SUBCASE("IYU1 to I420")
+    {
+        std::vector<uint8_t> src = {
+            50, 1, 2, 60, 3, 4,
+            70, 5, 6, 80, 7, 8,
+        };
+        repacked dst(GST_VIDEO_FORMAT_I420, 4, 2);
+        REQUIRE(repack(src, 6, ic4::PixelFormat::YCbCr411_8_CbYYCrYY, 4, 2, dst));
+
+        for (int x = 0; x < 4; ++x)
+        {
+            CHECK(dst.at(0, x, 0) == 1 + x);
+            CHECK(dst.at(0, x, 1) == 5 + x);
+        }
+        // one 4:1:1 sample covers two 4:2:0 samples
+        for (int x = 0; x < 2; ++x)
+        {
+            CHECK(dst.at(1, x, 0) == 60);
+            CHECK(dst.at(2, x, 0) == 70);
+        }
+    }
+
+    SUBCASE("sizes have to match")
+    {
+        std::vector<uint8_t> src(16);
+        repacked dst(GST_VIDEO_FORMAT_I420, 4, 4);
+        CHECK(!repack(src, 8, ic4::PixelFormat::YUV422_8, 4, 2, dst));
+        CHECK(!repack(src, 8, ic4::PixelFormat::Mono8, 4, 4, dst));
+    }
+}
@@ -0,0 +1,170 @@
+#include <doctest/doctest.h>
+#include <fmt/format.h>
+
+#include <ic4/ic4.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../src/format.h"
+#include "../src/striped_convert.h"
+
+using ic4::gst::image_view;
+using ic4::gst::striped_converter;
+
+namespace
+{
+
+void init_ic4()
+{
+    static bool initialized = ic4::initLibrary();
+    (void)initialized;
+}
+
+
+struct image
+{
+    std::vector<uint8_t> data;
+    image_view view;
+
+    image(ic4::PixelFormat fmt, int width, int height, uint8_t fill)
+    {
+        // padded lines, like the buffers of ic4src
+        size_t pitch = ((size_t)width * ic4::gst::get_bits_per_pixel(fmt) + 7) / 8 + 64;
+        data.assign(pitch * height, fill);
+        view = { data.data(), pitch, fmt, width, height };
+    }
+
+    // pixels only, the padding is not part of the image
+    bool same_pixels(const image& other) const
+    {
+        const size_t line = ((size_t)view.width * ic4::gst::get_bits_per_pixel(view.format) + 7) / 8;
+        for (int y = 0; y < view.height; ++y)
+        {
+            if (memcmp(view.data + y * view.pitch, other.view.data + y * other.view.pitch, line) != 0)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+} // namespace
+
+
+TEST_CASE("cpu list")
+{
+    auto cpus = ic4::gst::parse_cpu_list("0,2,4-7");
+    REQUIRE(cpus);
+    CHECK((*cpus == std::vector<int> { 0, 2, 4, 5, 6, 7 }));
+
+    cpus = ic4::gst::parse_cpu_list("");
+    REQUIRE(cpus);
+    CHECK(cpus->empty());
+
+    CHECK(!ic4::gst::parse_cpu_list("7-4"));
+    CHECK(!ic4::gst::parse_cpu_list("1,,2"));
+    CHECK(!ic4::gst::parse_cpu_list("-1"));
+    CHECK(!ic4::gst::parse_cpu_list("cpu0"));
+}
+
+
+TEST_CASE("striped conversion is bit exact")
+{
+    init_ic4();
+
+    const std::pair<ic4::PixelFormat, ic4::PixelFormat> conversions[] = {
+        { ic4::PixelFormat::BayerRG8, ic4::PixelFormat::BGRa8 },
+        { ic4::PixelFormat::BayerGB8, ic4::PixelFormat::BGR8 },
+        { ic4::PixelFormat::BayerBG16, ic4::PixelFormat::BGRa16 },
+        { ic4::PixelFormat::Mono8, ic4::PixelFormat::BGRa8 },
+        { ic4::PixelFormat::PolarizedBayerBG8, ic4::PixelFormat::BGRa8 },
+    };
+
+    std::mt19937 rng(23);
+
+    for (auto [in_fmt, out_fmt] : conversions)
+    {
+        if (!ic4::canTransform(in_fmt, out_fmt))
+        {
+            continue;
+        }
+
+        // heights around the stripe alignment and margins
+        for (int height : { 1, 17, 33, 120, 487, 1080 })
+        {
+            const int width = 328;
+
+            image src(in_fmt, width, height, 0);
+            for (auto& b : src.data)
+            {
+                b = (uint8_t)rng();
+            }
+
+            image expected(out_fmt, width, height, 0);
+            std::string message;
+            striped_converter single(1);
+            REQUIRE(single.convert(src.view, expected.view, message));
+
+            for (unsigned int threads : { 2u, 3u, 4u, 8u })
+            {
+                CAPTURE(ic4::to_string(in_fmt));
+                CAPTURE(ic4::to_string(out_fmt));
+                CAPTURE(height);
+                CAPTURE(threads);
+
+                image dst(out_fmt, width, height, 0xCD);
+                striped_converter striped(threads);
+
+                // twice, the workers are reused for the next frame
+                CHECK(striped.convert(src.view, dst.view, message));
+                CHECK(striped.convert(src.view, dst.view, message));
+                CHECK(dst.same_pixels(expected));
+            }
+        }
+    }
+}
+
+
+TEST_CASE("striped conversion benchmark")
+{
+    init_ic4();
+
+    // one 12 MP frame
+    constexpr int width = 4096;
+    constexpr int height = 3000;
+
+    image src(ic4::PixelFormat::BayerRG8, width, height, 0);
+    std::mt19937 rng(3);
+    for (auto& b : src.data)
+    {
+        b = (uint8_t)rng();
+    }
+    image dst(ic4::PixelFormat::BGRa8, width, height, 0);
+
+    for (unsigned int threads : { 1u, 2u, 4u, 8u })
+    {
+        striped_converter converter(threads);
+        std::string message;
+
+        // the first frame starts the workers and allocates their buffers
+        REQUIRE(converter.convert(src.view, dst.view, message));
+
+        constexpr int frames = 5;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < frames; ++i)
+        {
+            converter.convert(src.view, dst.view, message);
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / frames;
+
+        MESSAGE(fmt::format("BayerRG8 -> BGRa8 with {} threads: {} us per frame", threads, us));
+    }
+}
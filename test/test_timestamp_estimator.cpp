@@ -0,0 +1,192 @@
+#include <doctest/doctest.h>
+
+#include <cmath>
+#include <algorithm>
+#include <cstdint>
+#include <random>
+
+#include "../src/timestamp_estimator.h"
+
+using ic4::gst::timestamp_estimator;
+
+namespace
+{
+
+// 30 fps
+constexpr uint64_t frame_ns = 33333333;
+
+// host time right before the first frame
+constexpr uint64_t host_start = 5000000000ull;
+
+double error_us(uint64_t estimate, double expected)
+{
+    return std::abs((double)estimate - expected) / 1000.0;
+}
+
+} // namespace
+
+
+TEST_CASE("timestamp estimator follows constant drift")
+{
+    timestamp_estimator est;
+
+    // device clock runs 50 ppm fast and starts at an arbitrary value
+    const double rate = 1.0 + 50e-6;
+    const uint64_t device_start = 123456789000ull;
+
+    uint64_t prev = 0;
+    for (int i = 0; i < 600; ++i)
+    {
+        double host = (double)host_start + (double)i * frame_ns;
+        uint64_t device = device_start + (uint64_t)std::llround((double)i * frame_ns * rate);
+
+        uint64_t pts = est.update(device, (uint64_t)host);
+
+        CHECK(pts > prev);
+        prev = pts;
+
+        if (i > 100)
+        {
+            CHECK(error_us(pts, host) < 5.0);
+        }
+    }
+    CHECK(est.drift() == doctest::Approx(1.0 / rate).epsilon(1e-6));
+}
+
+
+TEST_CASE("timestamp estimator removes transfer jitter")
+{
+    timestamp_estimator est;
+
+    std::mt19937 rng(7);
+    // arrival is delayed by up to 3 ms, now and then the transfer stalls for 20 ms
+    std::uniform_real_distribution<double> delay(0.0, 3e6);
+    std::uniform_int_distribution<int> stall(0, 49);
+
+    const uint64_t device_start = 1000;
+    double max_error = 0.0;
+    double sum_error = 0.0;
+    int n = 0;
+    uint64_t prev = 0;
+
+    for (int i = 0; i < 1000; ++i)
+    {
+        double exposure = (double)host_start + (double)i * frame_ns;
+        double arrival = exposure + delay(rng) + (stall(rng) == 0 ? 20e6 : 0.0);
+
+        uint64_t pts = est.update(device_start + i * frame_ns, (uint64_t)arrival);
+
+        REQUIRE(pts > prev);
+        prev = pts;
+
+        if (i > 200)
+        {
+            double error = error_us(pts, exposure);
+            max_error = std::max(max_error, error);
+            sum_error += error;
+            n++;
+        }
+    }
+    MESSAGE("error after settling: mean " << sum_error / n << " us, max " << max_error << " us");
+    // arrival times are off by up to 23 ms, the estimate stays well within the jitter
+    CHECK(sum_error / n < 500.0);
+    CHECK(max_error < 3000.0);
+}
+
+
+TEST_CASE("timestamp estimator output never goes backwards")
+{
+    timestamp_estimator est;
+
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<double> delay(0.0, 10e6);
+
+    uint64_t prev = 0;
+    int jumps = 0;
+
+    for (int i = 0; i < 2000; ++i)
+    {
+        // an unusually fast arrival sets a new lower envelope,
+        // the fit then moves down by several milliseconds at once
+        double d = (i % 97 == 96) ? 0.0 : 2e6 + delay(rng);
+        uint64_t host = host_start + i * frame_ns + (uint64_t)d;
+
+        uint64_t pts = est.update(i * frame_ns + 1, host);
+
+        REQUIRE(pts > prev);
+        if (i > 0)
+        {
+            // corrections are slewed, no frame interval differs much from the device interval
+            double interval = (double)(pts - prev);
+            if (std::abs(interval - (double)frame_ns) > 0.01 * frame_ns)
+            {
+                jumps++;
+            }
+        }
+        prev = pts;
+    }
+    CHECK(jumps < 5);
+}
+
+
+TEST_CASE("timestamp estimator survives a device clock going backwards")
+{
+    timestamp_estimator est;
+
+    uint64_t prev = 0;
+    for (int i = 0; i < 300; ++i)
+    {
+        uint64_t host = host_start + i * frame_ns;
+        // the device is reset after 150 frames and counts from 0 again
+        uint64_t device = i < 150 ? 900000000000ull + i * frame_ns : (i - 150) * frame_ns;
+
+        uint64_t pts = est.update(device, host);
+
+        REQUIRE(pts > prev);
+        prev = pts;
+
+        if (i == 150)
+        {
+            // the old samples have been dropped
+            CHECK(est.sample_count() == 1);
+        }
+        if (i > 160)
+        {
+            CHECK(error_us(pts, (double)host) < 5.0);
+        }
+    }
+}
+
+
+TEST_CASE("timestamp estimator survives a device clock jump")
+{
+    timestamp_estimator est;
+
+    uint64_t prev = 0;
+    for (int i = 0; i < 300; ++i)
+    {
+        uint64_t host = host_start + i * frame_ns;
+        // after 150 frames the device clock skips 5 s ahead
+        uint64_t device = 1000 + i * frame_ns + (i < 150 ? 0 : 5000000000ull);
+
+        uint64_t pts = est.update(device, host);
+
+        REQUIRE(pts > prev);
+        prev = pts;
+
+        if (i == 150)
+        {
+            // the old samples have been dropped
+            CHECK(est.sample_count() == 1);
+        }
+        if (i > 160)
+        {
+            CHECK(error_us(pts, (double)host) < 5.0);
+        }
+    }
+
+    // reset forgets everything, including the last output
+    est.reset();
+    CHECK(est.sample_count() == 0);
+    CHECK(est.update(1000, 1000000) == 1000000);
+}
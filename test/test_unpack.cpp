@@ -0,0 +1,156 @@
+#include <doctest/doctest.h>
+#include <fmt/format.h>
+
+#include <ic4/ic4.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "../src/unpack.h"
+
+using ic4::gst::packing;
+using ic4::gst::unpack_kernel;
+
+namespace
+{
+
+const packing all_packings[] = { packing::lsb_10, packing::lsb_12, packing::msb_12 };
+
+const char* to_string(packing p)
+{
+    switch (p)
+    {
+        case packing::lsb_10:
+            return "10p";
+        case packing::lsb_12:
+            return "12p";
+        case packing::msb_12:
+            return "12Packed";
+        default:
+            return "none";
+    }
+}
+
+} // namespace
+
+
+TEST_CASE("unpack known values")
+{
+    uint16_t dst[4] = {};
+
+    // 0xABC and 0x129
+    const uint8_t p12[] = { 0xBC, 0x9A, 0x12 };
+    ic4::gst::unpack_line(unpack_kernel::reference, packing::lsb_12, p12, dst, 2);
+    CHECK(dst[0] == 0xABC0);
+    CHECK(dst[1] == 0x1290);
+
+    const uint8_t packed12[] = { 0xAB, 0x9C, 0x12 };
+    ic4::gst::unpack_line(unpack_kernel::reference, packing::msb_12, packed12, dst, 2);
+    CHECK(dst[0] == 0xABC0);
+    CHECK(dst[1] == 0x1290);
+
+    // 0x3FF, 0x000, 0x155, 0x2AA
+    const uint8_t p10[] = { 0xFF, 0x03, 0x50, 0x95, 0xAA };
+    ic4::gst::unpack_line(unpack_kernel::reference, packing::lsb_10, p10, dst, 4);
+    CHECK(dst[0] == 0xFFC0);
+    CHECK(dst[1] == 0x0000);
+    CHECK(dst[2] == 0x5540);
+    CHECK(dst[3] == 0xAA80);
+}
+
+
+TEST_CASE("unpack formats")
+{
+    CHECK(ic4::gst::get_unpacked_format(ic4::PixelFormat::Mono12p) == ic4::PixelFormat::Mono16);
+    CHECK(ic4::gst::get_unpacked_format(ic4::PixelFormat::BayerRG10p) == ic4::PixelFormat::BayerRG16);
+    CHECK(ic4::gst::get_packing(ic4::PixelFormat::BayerGR12Packed) == packing::msb_12);
+    CHECK(ic4::gst::can_unpack(ic4::PixelFormat::BayerBG12p, ic4::PixelFormat::BayerBG16));
+    CHECK(!ic4::gst::can_unpack(ic4::PixelFormat::BayerBG12p, ic4::PixelFormat::BayerRG16));
+    CHECK(!ic4::gst::can_unpack(ic4::PixelFormat::Mono8, ic4::PixelFormat::Invalid));
+    CHECK(ic4::gst::get_packing(ic4::PixelFormat::Mono16) == packing::none);
+}
+
+
+TEST_CASE("unpack kernels are bit exact")
+{
+    std::mt19937 rng(42);
+
+    // widths around every block size of the kernels and their tails
+    std::vector<size_t> widths;
+    for (size_t w = 1; w <= 70; ++w)
+    {
+        widths.push_back(w);
+    }
+    widths.insert(widths.end(), { 640, 1440, 1920, 2448, 4095, 5472 });
+
+    for (auto p : all_packings)
+    {
+        for (auto width : widths)
+        {
+            std::vector<uint8_t> src(ic4::gst::packed_line_size(p, width));
+            for (auto& b : src)
+            {
+                b = (uint8_t)rng();
+            }
+
+            std::vector<uint16_t> expected(width);
+            ic4::gst::unpack_line(unpack_kernel::reference, p, src.data(), expected.data(), width);
+
+            for (auto kernel : ic4::gst::available_unpack_kernels())
+            {
+                CAPTURE(to_string(p));
+                CAPTURE(width);
+                CAPTURE(ic4::gst::to_string(kernel));
+
+                // one guard value behind the line catches writes past the end
+                std::vector<uint16_t> dst(width + 1, 0xDEAD);
+                ic4::gst::unpack_line(kernel, p, src.data(), dst.data(), width);
+
+                CHECK(std::equal(expected.begin(), expected.end(), dst.begin()));
+                CHECK(dst.back() == 0xDEAD);
+            }
+        }
+    }
+}
+
+
+TEST_CASE("unpack benchmark")
+{
+    // one 12 MP frame
+    constexpr size_t width = 4096;
+    constexpr size_t height = 3000;
+
+    std::mt19937 rng(7);
+
+    for (auto p : all_packings)
+    {
+        const size_t pitch = ic4::gst::packed_line_size(p, width);
+        std::vector<uint8_t> src(pitch * height);
+        for (auto& b : src)
+        {
+            b = (uint8_t)rng();
+        }
+        std::vector<uint16_t> dst(width * height);
+
+        for (auto kernel : ic4::gst::available_unpack_kernels())
+        {
+            auto start = std::chrono::steady_clock::now();
+            for (size_t line = 0; line < height; ++line)
+            {
+                ic4::gst::unpack_line(kernel, p, src.data() + line * pitch, dst.data() + line * width, width);
+            }
+            auto end = std::chrono::steady_clock::now();
+
+            auto us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+            MESSAGE(fmt::format("{} {}: {} us per frame, {:.0f} MPixel/s",
+                                to_string(p),
+                                ic4::gst::to_string(kernel),
+                                us,
+                                us > 0 ? double(width * height) / us : 0.0));
+        }
+    }
+}